@@ -0,0 +1,59 @@
+#include <benchmark/benchmark.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#include "otpgen-bench.hpp"
+#include "otpauth-bench.hpp"
+#include "tokendatabase-bench.hpp"
+
+#ifdef OTPGEN_WITH_QR_CODES
+#include "qr-code-bench.hpp"
+#endif
+
+int main(int argc, char **argv)
+{
+    std::cout << "OTPGen Benchmarks" << std::endl << std::endl;
+
+    // write JSON results to otpgen-bench.json by default to track regressions
+    // between releases, --benchmark_out=<file> overrides the output file
+    std::vector<char*> args(argv, argv + argc);
+
+    bool hasOutput = false;
+    for (auto&& arg : args)
+    {
+        if (std::strncmp(arg, "--benchmark_out=", 16) == 0)
+        {
+            hasOutput = true;
+        }
+    }
+
+    static std::string defaultOutput = "--benchmark_out=otpgen-bench.json";
+    static std::string defaultFormat = "--benchmark_out_format=json";
+    if (!hasOutput)
+    {
+        args.emplace_back(defaultOutput.data());
+        args.emplace_back(defaultFormat.data());
+    }
+
+    auto args_size = static_cast<int>(args.size());
+    benchmark::Initialize(&args_size, args.data());
+    if (benchmark::ReportUnrecognizedArguments(args_size, args.data()))
+    {
+        return 1;
+    }
+
+    // run all registered benchmarks
+    // new benchmarks are registered with the BENCHMARK macro
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+
+    // cleanup the database and the pack created by the TokenDatabase benchmarks
+    TokenDatabase::closeDatabase();
+    std::remove(BENCH_DATABASE.c_str());
+    std::remove(BENCH_PACK.c_str());
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef OTPAUTHBENCH_HPP
+#define OTPAUTHBENCH_HPP
+
+#include <benchmark/benchmark.h>
+
+#include <otpauthURI.hpp>
+
+static void BM_otpauthURI_parse(benchmark::State &state)
+{
+    const std::string uri = "otpauth://totp/ACME%20Co:john.doe@email.com?secret=HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ&issuer=ACME%20Co&algorithm=SHA256&digits=6&period=30";
+
+    for (auto _ : state)
+    {
+        otpauthURI parsed(uri);
+        benchmark::DoNotOptimize(parsed.valid());
+    }
+}
+BENCHMARK(BM_otpauthURI_parse);
+
+#endif // OTPAUTHBENCH_HPP
@@ -0,0 +1,195 @@
+#ifndef OTPGENBENCH_HPP
+#define OTPGENBENCH_HPP
+
+#include <benchmark/benchmark.h>
+
+#include <OTPGen.hpp>
+#include <OTPPreparedKey.hpp>
+#include <TokenBatch.hpp>
+#include <OTPGenPool.hpp>
+
+namespace {
+    static const OTPToken::TokenSecret BENCH_SECRET = "HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ";
+    static const std::time_t BENCH_TIME = 1536573862;
+}
+
+// arguments: algorithm, digits
+static void BM_OTPGen_computeTOTP(benchmark::State &state)
+{
+    const auto algo = static_cast<OTPToken::ShaAlgorithm>(state.range(0));
+    const auto digits = static_cast<OTPToken::DigitType>(state.range(1));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::computeTOTP(BENCH_TIME, BENCH_SECRET, digits, 30, algo));
+    }
+}
+BENCHMARK(BM_OTPGen_computeTOTP)->ArgsProduct({{OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512}, {6, 8, 10}});
+
+static void BM_OTPGen_computeTOTP_PreparedKey(benchmark::State &state)
+{
+    const auto algo = static_cast<OTPToken::ShaAlgorithm>(state.range(0));
+    const auto digits = static_cast<OTPToken::DigitType>(state.range(1));
+    const OTPPreparedKey key(BENCH_SECRET, algo);
+
+    OTPGen::TokenBuffer token;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::computeTOTP(BENCH_TIME, key, digits, 30, token));
+    }
+}
+BENCHMARK(BM_OTPGen_computeTOTP_PreparedKey)->ArgsProduct({{OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512}, {6, 8, 10}});
+
+static void BM_OTPGen_computeHOTP(benchmark::State &state)
+{
+    const auto algo = static_cast<OTPToken::ShaAlgorithm>(state.range(0));
+    const auto digits = static_cast<OTPToken::DigitType>(state.range(1));
+
+    OTPToken::CounterType counter = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::computeHOTP(BENCH_SECRET, counter++, digits, algo));
+    }
+}
+BENCHMARK(BM_OTPGen_computeHOTP)->ArgsProduct({{OTPToken::SHA1, OTPToken::SHA256, OTPToken::SHA512}, {6, 8, 10}});
+
+static void BM_OTPGen_computeSteam(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::computeSteam(BENCH_TIME, BENCH_SECRET));
+    }
+}
+BENCHMARK(BM_OTPGen_computeSteam);
+
+static void BM_OTPGen_verifyTOTP(benchmark::State &state)
+{
+    const OTPPreparedKey key(BENCH_SECRET, OTPToken::SHA1);
+    const auto token = OTPGen::computeTOTP(BENCH_TIME, key, 6, 30);
+
+    OTPGen::VerifyOptions options;
+    options.window = static_cast<std::uint32_t>(state.range(0));
+
+    // worst case, the token is at the end of the window
+    const auto time = BENCH_TIME + options.window * 30;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::verifyTOTP(time, key, token, 6, 30, options));
+    }
+}
+BENCHMARK(BM_OTPGen_verifyTOTP)->Arg(1)->Arg(5);
+
+static void BM_OTPPreparedKey_decodeSecret(benchmark::State &state)
+{
+    // normalize_secret and base32_rfc4648_decode
+    const OTPToken::TokenSecret secret = "hxdm vjec jjws rb3h wizr 4ifu gftm xboz";
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPPreparedKey::decodeSecret(secret));
+    }
+}
+BENCHMARK(BM_OTPPreparedKey_decodeSecret);
+
+static void BM_OTPPreparedKey_construct(benchmark::State &state)
+{
+    const auto algo = static_cast<OTPToken::ShaAlgorithm>(state.range(0));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPPreparedKey(BENCH_SECRET, algo));
+    }
+}
+BENCHMARK(BM_OTPPreparedKey_construct)->Arg(OTPToken::SHA1)->Arg(OTPToken::SHA256)->Arg(OTPToken::SHA512);
+
+namespace {
+    // token objects with labels and icons, like the ones of the database
+    static std::vector<OTPToken> batchTokens(const std::int64_t &count)
+    {
+        std::vector<OTPToken> tokens;
+        tokens.reserve(static_cast<std::size_t>(count));
+        for (std::int64_t i = 0; i < count; ++i)
+        {
+            tokens.emplace_back(OTPToken::TOTP, "token " + std::to_string(i), OTPToken::Icon(1024, 0x42), BENCH_SECRET,
+                                6, 30, 0, OTPToken::SHA1);
+            (void) tokens.back().preparedKey();
+        }
+        return tokens;
+    }
+}
+
+// argument: token count
+static void BM_OTPGen_computeBatch_Tokens(benchmark::State &state)
+{
+    const auto tokens = batchTokens(state.range(0));
+    std::vector<OTPToken::TokenString> out;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::computeBatch(BENCH_TIME, tokens, out));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_OTPGen_computeBatch_Tokens)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_OTPGen_computeBatch_TokenBatch(benchmark::State &state)
+{
+    const TokenBatch batch(batchTokens(state.range(0)));
+    std::vector<OTPGen::TokenBuffer> out;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::computeBatch(BENCH_TIME, batch, out));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_OTPGen_computeBatch_TokenBatch)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+namespace {
+    // mixed types and algorithms, like a vault of a verification host
+    static TokenBatch mixedBatch(const std::int64_t &count)
+    {
+        std::vector<OTPToken> tokens;
+        tokens.reserve(static_cast<std::size_t>(count));
+        for (std::int64_t i = 0; i < count; ++i)
+        {
+            const OTPToken::TokenType type = (i % 3) + 1;
+            const OTPToken::ShaAlgorithm algorithm = type == OTPToken::Steam ? OTPToken::SHA1 : (i % 5) % 3 + 1;
+            tokens.emplace_back(type, "token " + std::to_string(i), OTPToken::Icon{}, BENCH_SECRET, 6, 30, 0, algorithm);
+        }
+        return TokenBatch(tokens);
+    }
+}
+
+// argument: token count
+static void BM_OTPGen_computeBatch_Mixed(benchmark::State &state)
+{
+    const auto batch = mixedBatch(state.range(0));
+    std::vector<OTPGen::TokenBuffer> out;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(OTPGen::computeBatch(BENCH_TIME, batch, out));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_OTPGen_computeBatch_Mixed)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// arguments: token count, threads
+static void BM_OTPGenPool_computeBatch(benchmark::State &state)
+{
+    const auto batch = mixedBatch(state.range(0));
+    OTPGenPool pool(static_cast<std::size_t>(state.range(1)));
+    std::vector<OTPGen::TokenBuffer> out;
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(pool.computeBatch(BENCH_TIME, batch, out));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_OTPGenPool_computeBatch)
+    ->ArgsProduct({{1000, 100000}, {1, 2, 4, 8}})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+#endif // OTPGENBENCH_HPP
@@ -0,0 +1,18 @@
+#ifndef QRCODEBENCH_HPP
+#define QRCODEBENCH_HPP
+
+#include <benchmark/benchmark.h>
+
+#include <QRCode.hpp>
+
+static void BM_QRCode_decode(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        std::string data;
+        benchmark::DoNotOptimize(QRCode::decode(OTPGEN_BENCH_QRCODE, data));
+    }
+}
+BENCHMARK(BM_QRCode_decode)->Unit(benchmark::kMillisecond);
+
+#endif // QRCODEBENCH_HPP
@@ -0,0 +1,334 @@
+#ifndef TOKENDATABASEBENCH_HPP
+#define TOKENDATABASEBENCH_HPP
+
+#include <benchmark/benchmark.h>
+
+#include <TokenDatabase.hpp>
+#include <TokenPack.hpp>
+
+namespace {
+    static const std::string BENCH_DATABASE = "otpgen-bench.db";
+    static const std::string BENCH_PACK = "otpgen-bench.pack";
+
+    static TokenDatabase::OTPTokenList benchTokens(const std::int64_t &count)
+    {
+        TokenDatabase::OTPTokenList tokens;
+        tokens.reserve(static_cast<std::size_t>(count));
+
+        for (std::int64_t i = 0; i < count; ++i)
+        {
+            const OTPToken::TokenType type = (i % 3) + 1;
+            tokens.emplace_back(type, "token " + std::to_string(i), OTPToken::Icon{}, "HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ",
+                                6, 30, 0, OTPToken::SHA1);
+        }
+
+        return tokens;
+    }
+
+    // creates a fresh database with the given amount of tokens,
+    // the database is only rebuilt when the token count changes
+    static bool prepareDatabase(const std::int64_t &count)
+    {
+        static std::int64_t current = -1;
+        if (current == count && TokenDatabase::databaseConnected())
+        {
+            return true;
+        }
+
+        TokenDatabase::setPassword("bench123");
+        TokenDatabase::setTokenDatabase(BENCH_DATABASE);
+        if (TokenDatabase::initializeTokens() != TokenDatabase::Success)
+        {
+            return false;
+        }
+
+        if (TokenDatabase::insertTokens(benchTokens(count)) != TokenDatabase::Success)
+        {
+            return false;
+        }
+
+        if (TokenDatabase::saveTokens() != TokenDatabase::Success)
+        {
+            return false;
+        }
+
+        current = count;
+        return true;
+    }
+
+    // writes a pack with the given amount of tokens, only rewritten when the arguments change
+    static bool preparePack(const std::int64_t &count, const bool &encrypted)
+    {
+        static std::int64_t current = -1;
+        static bool current_encrypted = false;
+        if (current == count && current_encrypted == encrypted)
+        {
+            return true;
+        }
+
+        if (TokenPack::write(BENCH_PACK, benchTokens(count), encrypted, "bench123") != TokenDatabase::Success)
+        {
+            return false;
+        }
+
+        current = count;
+        current_encrypted = encrypted;
+        return true;
+    }
+}
+
+// argument: token count
+static void BM_TokenDatabase_saveTokens(benchmark::State &state)
+{
+    if (!prepareDatabase(state.range(0)))
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TokenDatabase::saveTokens());
+    }
+}
+BENCHMARK(BM_TokenDatabase_saveTokens)->Arg(10)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_TokenDatabase_loadTokens(benchmark::State &state)
+{
+    if (!prepareDatabase(state.range(0)))
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TokenDatabase::loadTokens());
+    }
+}
+BENCHMARK(BM_TokenDatabase_loadTokens)->Arg(10)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// arguments: token count, storage format
+static void BM_TokenDatabase_updateAndSave(benchmark::State &state)
+{
+    TokenDatabase::setPassword("bench123");
+    TokenDatabase::setTokenDatabase(BENCH_DATABASE);
+    TokenDatabase::setStorageFormat(static_cast<TokenDatabase::StorageFormat>(state.range(1)));
+    if (TokenDatabase::initializeTokens() != TokenDatabase::Success ||
+        TokenDatabase::insertTokens(benchTokens(state.range(0))) != TokenDatabase::Success ||
+        TokenDatabase::saveTokens() != TokenDatabase::Success)
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        TokenDatabase::setStorageFormat(TokenDatabase::Container);
+        return;
+    }
+
+    // a HOTP counter bump followed by a save
+    auto token = TokenDatabase::selectToken(1);
+    for (auto _ : state)
+    {
+        token.setCounter(token.counter() + 1);
+        (void) TokenDatabase::updateToken(1, token);
+        benchmark::DoNotOptimize(TokenDatabase::saveTokens());
+    }
+
+    // the database format changed, don't reuse this database
+    TokenDatabase::closeDatabase();
+    TokenDatabase::setStorageFormat(TokenDatabase::Container);
+}
+BENCHMARK(BM_TokenDatabase_updateAndSave)
+    ->ArgsProduct({{1000, 100000}, {TokenDatabase::Container, TokenDatabase::EncryptedPages}})
+    ->Unit(benchmark::kMillisecond);
+
+// argument: token count
+static void BM_TokenDatabase_setCounterJournal(benchmark::State &state)
+{
+    if (!prepareDatabase(state.range(0)))
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    // a HOTP counter bump persisted in the journal
+    TokenDatabase::setJournal(true);
+    OTPToken::CounterType counter = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TokenDatabase::setCounter(1, ++counter));
+    }
+
+    // fold the journal into the file
+    TokenDatabase::setJournal(false);
+    (void) TokenDatabase::saveTokens();
+}
+BENCHMARK(BM_TokenDatabase_setCounterJournal)->Arg(1000)->Arg(100000)->Unit(benchmark::kMicrosecond);
+
+static void BM_TokenDatabase_selectTokens(benchmark::State &state)
+{
+    if (!prepareDatabase(state.range(0)))
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TokenDatabase::selectTokens(OTPToken::TOTP));
+    }
+}
+BENCHMARK(BM_TokenDatabase_selectTokens)->Arg(10)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// arguments: token count, projection
+static void BM_TokenDatabase_selectTokensProjection(benchmark::State &state)
+{
+    TokenDatabase::setPassword("bench123");
+    TokenDatabase::setTokenDatabase(BENCH_DATABASE);
+    auto tokens = benchTokens(state.range(0));
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        tokens[i].setIcon(OTPToken::Icon(4096, static_cast<unsigned char>(i % 16)));
+    }
+    if (TokenDatabase::initializeTokens() != TokenDatabase::Success ||
+        TokenDatabase::insertTokens(tokens) != TokenDatabase::Success)
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    const auto projection = static_cast<TokenDatabase::Projection>(state.range(1));
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TokenDatabase::selectTokens(OTPToken::None, projection));
+    }
+
+    // the icons changed, don't reuse this database
+    TokenDatabase::closeDatabase();
+}
+BENCHMARK(BM_TokenDatabase_selectTokensProjection)
+    ->ArgsProduct({{1000, 10000}, {TokenDatabase::WithIcons, TokenDatabase::WithoutIcons}})
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_TokenDatabase_selectTokensLabel(benchmark::State &state)
+{
+    if (!prepareDatabase(state.range(0)))
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TokenDatabase::selectTokens(OTPToken::Label("token 1")));
+    }
+}
+BENCHMARK(BM_TokenDatabase_selectTokensLabel)->Arg(10)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// arguments: token count, label cache
+static void BM_TokenDatabase_selectTokenLabel(benchmark::State &state)
+{
+    if (!prepareDatabase(state.range(0)))
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    TokenDatabase::setLabelCache(state.range(1) != 0);
+    const auto label = "token " + std::to_string(state.range(0) / 2);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TokenDatabase::selectToken(label));
+    }
+    TokenDatabase::setLabelCache(false);
+}
+BENCHMARK(BM_TokenDatabase_selectTokenLabel)->ArgsProduct({{1000, 100000}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
+static void BM_TokenDatabase_insertToken(benchmark::State &state)
+{
+    TokenDatabase::setPassword("bench123");
+    TokenDatabase::setTokenDatabase(BENCH_DATABASE);
+    if (TokenDatabase::initializeTokens() != TokenDatabase::Success)
+    {
+        state.SkipWithError("unable to create the benchmark database");
+        return;
+    }
+
+    std::size_t i = 0;
+    for (auto _ : state)
+    {
+        OTPToken token(OTPToken::TOTP, "insert " + std::to_string(i++), {}, "HXDMVJECJJWSRB3HWIZR4IFUGFTMXBOZ",
+                       6, 30, 0, OTPToken::SHA1);
+        benchmark::DoNotOptimize(TokenDatabase::insertToken(token));
+    }
+
+    // the token count changed, don't reuse this database
+    TokenDatabase::closeDatabase();
+}
+BENCHMARK(BM_TokenDatabase_insertToken);
+
+// argument: token count
+static void BM_TokenDatabase_insertTokens(benchmark::State &state)
+{
+    const auto tokens = benchTokens(state.range(0));
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        TokenDatabase::setPassword("bench123");
+        TokenDatabase::setTokenDatabase(BENCH_DATABASE);
+        if (TokenDatabase::initializeTokens() != TokenDatabase::Success)
+        {
+            state.SkipWithError("unable to create the benchmark database");
+            break;
+        }
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(TokenDatabase::insertTokens(tokens));
+    }
+
+    // the token count changed, don't reuse this database
+    TokenDatabase::closeDatabase();
+}
+BENCHMARK(BM_TokenDatabase_insertTokens)->Arg(1000)->Arg(10000)->Unit(benchmark::kMillisecond);
+
+// arguments: token count, encrypted
+static void BM_TokenPack_open(benchmark::State &state)
+{
+    const bool encrypted = state.range(1) != 0;
+    if (!preparePack(state.range(0), encrypted))
+    {
+        state.SkipWithError("unable to create the benchmark pack");
+        return;
+    }
+
+    TokenPack pack;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(pack.open(BENCH_PACK, encrypted ? "bench123" : ""));
+    }
+}
+BENCHMARK(BM_TokenPack_open)->ArgsProduct({{1000, 100000, 1000000}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
+// lookup by label and generation, arguments: token count, encrypted
+static void BM_TokenPack_findAndCompute(benchmark::State &state)
+{
+    const bool encrypted = state.range(1) != 0;
+    TokenPack pack;
+    if (!preparePack(state.range(0), encrypted) ||
+        pack.open(BENCH_PACK, encrypted ? "bench123" : "") != TokenDatabase::Success)
+    {
+        state.SkipWithError("unable to open the benchmark pack");
+        return;
+    }
+
+    const OTPToken::Label label = "token " + std::to_string(state.range(0) / 2);
+    const std::time_t time = 1536573862;
+    OTPGen::TokenBuffer token;
+    for (auto _ : state)
+    {
+        std::size_t index = 0;
+        benchmark::DoNotOptimize(pack.find(label, index) && pack.compute(index, time, token));
+    }
+}
+BENCHMARK(BM_TokenPack_findAndCompute)->ArgsProduct({{1000, 1000000}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
+#endif // TOKENDATABASEBENCH_HPP
@@ -8,6 +8,7 @@
 #include <CommandLineOperation.hpp>
 
 #include <TokenDatabase.hpp>
+#include <TokenAutosave.hpp>
 
 #include <StdinEchoMode.hpp>
 
@@ -20,7 +21,8 @@
 __attribute__((noreturn))
 static void graceful_terminate(int signal)
 {
-    // close database connection handle and cleanup
+    // save pending changes, close database connection handle and cleanup
+    TokenDatabase::defaultAutosave().flush();
     TokenDatabase::closeDatabase();
 
     // restore original signal handler
@@ -120,6 +122,7 @@ int main(int argc, char **argv)
 
     // TODO: cli application code goes here
 
+    TokenDatabase::defaultAutosave().flush();
     TokenDatabase::closeDatabase();
     return 0;
 }
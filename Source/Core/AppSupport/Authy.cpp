@@ -94,6 +94,7 @@ bool Authy::importTOTP(const std::string &file, std::vector<OTPToken> &target, c
         }
 
         auto array = json.GetArray();
+        target.reserve(target.size() + array.Size());
         for (auto&& elem : array)
         {
             // check if object has all required members
@@ -104,11 +105,10 @@ bool Authy::importTOTP(const std::string &file, std::vector<OTPToken> &target, c
                 continue;
             }
 
-            OTPToken token(OTPToken::TOTP);
+            auto &token = target.emplace_back(OTPToken::TOTP);
             token.setSecret(elem["decryptedSecret"].GetString());
             token.setLabel(elem["name"].GetString());
             token.setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-            target.push_back(token);
         }
     } catch (...) {
         // catch all rapidjson exceptions
@@ -140,6 +140,7 @@ bool Authy::importNative(const std::string &file, std::vector<OTPToken> &target,
         }
 
         auto array = json.GetArray();
+        target.reserve(target.size() + array.Size());
         for (auto&& elem : array)
         {
             // check if object has all required members
@@ -150,11 +151,10 @@ bool Authy::importNative(const std::string &file, std::vector<OTPToken> &target,
                 continue;
             }
 
-            OTPToken token(OTPToken::TOTP);
+            auto &token = target.emplace_back(OTPToken::TOTP);
             token.setSecret(hexToBase32Rfc4648(elem["secretSeed"].GetString()));
             token.setLabel(elem["name"].GetString());
             token.setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-            target.push_back(token);
         }
     } catch (...) {
         // catch all rapidjson exceptions
@@ -39,7 +39,7 @@ namespace AppSupport {
 const uint8_t andOTP::ANDOTP_IV_SIZE = 12U;
 const uint8_t andOTP::ANDOTP_TAG_SIZE = 16U;
 
-bool andOTP::importTokens(const std::string &file, std::vector<OTPToken*> &target, const Type &type, const std::string &password)
+bool andOTP::importTokens(const std::string &file, std::vector<OTPToken> &target, const Type &type, const std::string &password)
 {
     // read file contents into memory
     std::string out;
@@ -86,6 +86,7 @@ bool andOTP::importTokens(const std::string &file, std::vector<OTPToken*> &targe
         }
 
         auto array = json.GetArray();
+        target.reserve(target.size() + array.Size());
         for (auto&& elem : array)
         {
             // check if object has all andOTP members
@@ -96,43 +97,53 @@ bool andOTP::importTokens(const std::string &file, std::vector<OTPToken*> &targe
                 continue;
             }
 
+            // tokens are built in place, an entry with invalid members is dropped again
+            const auto size = target.size();
+
             try {
 
+            OTPToken::TokenType tokenType;
             const auto typeStr = std::string(elem["type"].GetString());
 
             if (typeStr == "TOTP")
             {
-                auto token = new OTPToken(OTPToken::TOTP);
-                token->setSecret(elem["secret"].GetString());
-                token->setLabel(elem["label"].GetString());
-                token->setPeriod(elem["period"].GetUint());
-                token->setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-                token->setAlgorithm(elem["algorithm"].GetString());
-                target.push_back(token);
+                tokenType = OTPToken::TOTP;
             }
             else if (typeStr == "HOTP")
             {
-                auto token = new OTPToken(OTPToken::HOTP);
-                token->setSecret(elem["secret"].GetString());
-                token->setLabel(elem["label"].GetString());
-                token->setCounter(elem["counter"].GetUint());
-                token->setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
-                token->setAlgorithm(elem["algorithm"].GetString());
-                target.push_back(token);
+                tokenType = OTPToken::HOTP;
             }
             else if (typeStr == "STEAM")
             {
-                auto token = new OTPToken(OTPToken::Steam);
-                token->setSecret(elem["secret"].GetString());
-                token->setLabel(elem["label"].GetString());
-                target.push_back(token);
+                tokenType = OTPToken::Steam;
             }
             else
             {
                 continue;
             }
 
+            auto &token = target.emplace_back(tokenType);
+            token.setSecret(elem["secret"].GetString());
+            token.setLabel(elem["label"].GetString());
+
+            if (tokenType == OTPToken::TOTP)
+            {
+                token.setPeriod(elem["period"].GetUint());
+                token.setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
+                token.setAlgorithm(elem["algorithm"].GetString());
+            }
+            else if (tokenType == OTPToken::HOTP)
+            {
+                token.setCounter(elem["counter"].GetUint());
+                token.setDigitLength(static_cast<OTPToken::DigitType>(elem["digits"].GetUint()));
+                token.setAlgorithm(elem["algorithm"].GetString());
+            }
+
             } catch (...) {
+                if (target.size() > size)
+                {
+                    target.pop_back();
+                }
                 continue;
             }
         }
@@ -144,7 +155,7 @@ bool andOTP::importTokens(const std::string &file, std::vector<OTPToken*> &targe
     return true;
 }
 
-bool andOTP::exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens, const Type &type, const std::string &password)
+bool andOTP::exportTokens(const std::string &target, const std::vector<OTPToken> &tokens, const Type &type, const std::string &password)
 {
     try {
         rapidjson::Document json(rapidjson::kArrayType);
@@ -152,16 +163,16 @@ bool andOTP::exportTokens(const std::string &target, const std::vector<OTPToken*
         for (auto&& token : tokens)
         {
             rapidjson::Value value(rapidjson::kObjectType);
-            value.AddMember("secret", rapidjson::Value(token->secret().c_str(), json.GetAllocator()), json.GetAllocator());
-            value.AddMember("label", rapidjson::Value(token->label().c_str(), json.GetAllocator()), json.GetAllocator());
-            value.AddMember("period", token->period(), json.GetAllocator());
-            value.AddMember("digits", token->digitLength(), json.GetAllocator());
+            value.AddMember("secret", rapidjson::Value(token.secret().c_str(), json.GetAllocator()), json.GetAllocator());
+            value.AddMember("label", rapidjson::Value(token.label().c_str(), json.GetAllocator()), json.GetAllocator());
+            value.AddMember("period", token.period(), json.GetAllocator());
+            value.AddMember("digits", token.digitLength(), json.GetAllocator());
 
-            if (token->type() == OTPToken::HOTP)
+            if (token.type() == OTPToken::HOTP)
             {
                 value.AddMember("type", "HOTP", json.GetAllocator());
             }
-            else if (token->type() == OTPToken::Steam)
+            else if (token.type() == OTPToken::Steam)
             {
                 value.AddMember("type", "STEAM", json.GetAllocator());
             }
@@ -170,14 +181,14 @@ bool andOTP::exportTokens(const std::string &target, const std::vector<OTPToken*
                 value.AddMember("type", "TOTP", json.GetAllocator());
             }
 
-            if (token->type() == OTPToken::Steam)
+            if (token.type() == OTPToken::Steam)
             {
                 value.AddMember("algorithm", "SHA1", json.GetAllocator());
                 value["digits"].SetUint(5);
             }
             else
             {
-                value.AddMember("algorithm", rapidjson::Value(token->algorithmName().c_str(), json.GetAllocator()), json.GetAllocator());
+                value.AddMember("algorithm", rapidjson::Value(token.algorithmName().c_str(), json.GetAllocator()), json.GetAllocator());
             }
 
             value.AddMember("thumbnail", "Default", json.GetAllocator());
@@ -21,8 +21,8 @@ public:
         Encrypted,
     };
 
-    static bool importTokens(const std::string &file, std::vector<OTPToken*> &target, const Type &type = PlainText, const std::string &password = std::string());
-    static bool exportTokens(const std::string &target, const std::vector<OTPToken*> &tokens, const Type &type = PlainText, const std::string &password = std::string());
+    static bool importTokens(const std::string &file, std::vector<OTPToken> &target, const Type &type = PlainText, const std::string &password = std::string());
+    static bool exportTokens(const std::string &target, const std::vector<OTPToken> &tokens, const Type &type = PlainText, const std::string &password = std::string());
 
 private:
     static const std::string sha256_password(const std::string &password);
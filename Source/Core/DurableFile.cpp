@@ -0,0 +1,117 @@
+#include "DurableFile.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+#if !defined(OS_WINDOWS)
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#else
+#include <windows.h>
+#endif
+
+bool DurableFile::sync(const std::string &path)
+{
+#if !defined(OS_WINDOWS)
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+    const auto res = fsync(fd);
+    close(fd);
+    return res == 0;
+#else
+    (void) path;
+    return true;
+#endif
+}
+
+const std::string DurableFile::directoryOf(const std::string &file)
+{
+    const auto separator = file.find_last_of('/');
+    return separator == std::string::npos ? "." : separator == 0 ? "/" : file.substr(0, separator);
+}
+
+bool DurableFile::writeTemporary(const std::string &temp_file, const unsigned char *data, const std::size_t &size)
+{
+    // left behind by a crash
+    std::remove(temp_file.c_str());
+
+#if !defined(OS_WINDOWS)
+    // never follow a link or reuse a file created by someone else
+    const auto fd = open(temp_file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    std::size_t written = 0;
+    while (written < size)
+    {
+        const auto res = ::write(fd, data + written, size - written);
+        if (res < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (res <= 0)
+        {
+            break;
+        }
+        written += static_cast<std::size_t>(res);
+    }
+
+    const auto synced = written == size && fsync(fd) == 0;
+    if (close(fd) != 0 || !synced)
+    {
+        std::remove(temp_file.c_str());
+        return false;
+    }
+    return true;
+#else
+    std::ofstream stream(temp_file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!stream)
+    {
+        return false;
+    }
+    stream.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    stream.close();
+    if (!stream)
+    {
+        std::remove(temp_file.c_str());
+        return false;
+    }
+    return true;
+#endif
+}
+
+bool DurableFile::rename(const std::string &temp_file, const std::string &file)
+{
+#if !defined(OS_WINDOWS)
+    return std::rename(temp_file.c_str(), file.c_str()) == 0;
+#else
+    // std::rename() fails when the target exists
+    return MoveFileExA(temp_file.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#endif
+}
+
+bool DurableFile::replace(const std::string &temp_file, const std::string &file)
+{
+    if (!sync(temp_file))
+    {
+        std::remove(temp_file.c_str());
+        return false;
+    }
+
+    // the target is never removed first, a failed rename keeps the old file
+    if (!rename(temp_file, file))
+    {
+        std::remove(temp_file.c_str());
+        return false;
+    }
+
+    // persist the rename
+    (void) sync(directoryOf(file));
+    return true;
+}
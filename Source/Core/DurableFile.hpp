@@ -0,0 +1,31 @@
+#ifndef DURABLEFILE_HPP
+#define DURABLEFILE_HPP
+
+#include <string>
+#include <cstddef>
+
+// crash safe file replacement shared by the token vault and the token pack,
+// a crash leaves either the old or the new file behind
+class DurableFile final
+{
+    DurableFile() = delete;
+
+public:
+    // flushes a file or directory to the disk
+    static bool sync(const std::string &path);
+
+    static const std::string directoryOf(const std::string &file);
+
+    // writes the data into a new temporary file next to the file, only the owner
+    // can read it (0600), an existing temporary file is removed first
+    static bool writeTemporary(const std::string &temp_file, const unsigned char *data, const std::size_t &size);
+
+    // replaces the file with the temporary file in one step, the file is kept when it fails
+    static bool rename(const std::string &temp_file, const std::string &file);
+
+    // replaces the file with the temporary file, removes the temporary file on failure,
+    // the content is on the disk before the rename and the rename is persisted
+    static bool replace(const std::string &temp_file, const std::string &file);
+};
+
+#endif // DURABLEFILE_HPP
@@ -0,0 +1,1066 @@
+#include "EncryptedVFS.hpp"
+
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+#include <sqlite/sqlite3.h>
+
+#include <cryptopp/cryptlib.h>
+#include <cryptopp/aes.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/misc.h>
+#include <cryptopp/osrng.h>
+
+namespace {
+    // database header
+    //   magic[8], version[1], reserved[3], page size[4], salt[16], key check[16], reserved[16]
+    // followed by the page slots: nonce[12], encrypted page, tag[16]
+    static const unsigned char DATABASE_MAGIC[8] = {'O', 'T', 'P', 'G', 'E', 'N', 'P', 'G'};
+    static const std::uint8_t DATABASE_VERSION = 1;
+    static const std::size_t DATABASE_HEADER_SIZE = 64;
+
+    // journal header
+    //   salt[16], key check[16]
+    // followed by the journal in blocks: nonce[12], used size[4], encrypted block, tag[16],
+    // the block index and the used size are authenticated with every block,
+    // only the last block can be used partially
+    static const std::size_t JOURNAL_HEADER_SIZE = 32;
+    static const std::size_t JOURNAL_BLOCK_SIZE = 4096;
+
+    // page size of new databases, must match the page size used by SQLite,
+    // other page sizes work but every page write needs to read a page first
+    static const std::uint32_t PAGE_SIZE = 4096;
+    static const std::uint32_t MAX_PAGE_SIZE = 65536;
+
+    static const std::size_t SALT_SIZE = 16;
+    static const std::size_t CHECK_SIZE = 16;
+    static const std::size_t KEY_SIZE = 32;
+    static const std::size_t NONCE_SIZE = 12;
+    static const std::size_t TAG_SIZE = 16;
+    static const std::size_t JOURNAL_SLOT_SIZE = NONCE_SIZE + 4 + JOURNAL_BLOCK_SIZE + TAG_SIZE;
+
+    static const std::string DATABASE_KEY_INFO = "otpgen database pages";
+    static const std::string JOURNAL_KEY_INFO = "otpgen database journal";
+    static const std::string CHECK_INFO = "otpgen database key check";
+
+    // passwords by the full path of the database file
+    static std::mutex vfs_mutex;
+    static std::map<std::string, std::string> vfs_passwords;
+    static sqlite3_vfs *base_vfs = nullptr;
+    static sqlite3_vfs vfs;
+
+    using Salt = std::array<unsigned char, SALT_SIZE>;
+    using Check = std::array<unsigned char, CHECK_SIZE>;
+
+    static void deriveKey(const std::string &password, const Salt &salt, const std::string &info,
+                          unsigned char *key, const std::size_t &size)
+    {
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(key, size,
+                       reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                       salt.data(), salt.size(),
+                       reinterpret_cast<const unsigned char*>(info.data()), info.size());
+    }
+
+    struct FileState {
+        std::uint32_t page_size = PAGE_SIZE;
+        std::size_t slot_size = NONCE_SIZE + PAGE_SIZE + TAG_SIZE;
+
+        // journals get a new salt (and key) when they are written from the beginning
+        bool salt_pending = false;
+        std::string password;
+
+        CryptoPP::SecByteBlock key;
+        CryptoPP::GCM<CryptoPP::AES>::Encryption encryption;
+        CryptoPP::GCM<CryptoPP::AES>::Decryption decryption;
+        CryptoPP::AutoSeededRandomPool rng;
+
+        std::vector<unsigned char> slot;
+        std::vector<unsigned char> page;
+
+        // complete journal blocks in the file and the decrypted block which was used last
+        sqlite3_int64 blocks = 0;
+        sqlite3_int64 block = -1;
+        std::uint32_t block_used = 0;
+    };
+
+    // allocated by SQLite, the file of the underlying VFS follows this struct
+    struct EncryptedFile {
+        sqlite3_file base;
+        sqlite3_file *real;
+        FileState *state;
+    };
+
+    static inline EncryptedFile *encryptedFile(sqlite3_file *file)
+    {
+        return reinterpret_cast<EncryptedFile*>(file);
+    }
+
+    static inline sqlite3_file *realFile(sqlite3_file *file)
+    {
+        return encryptedFile(file)->real;
+    }
+
+    // shared file methods, forwarded to the underlying file
+
+    static int fileClose(sqlite3_file *file)
+    {
+        auto f = encryptedFile(file);
+        auto rc = SQLITE_OK;
+        if (f->real->pMethods)
+        {
+            rc = f->real->pMethods->xClose(f->real);
+        }
+        delete f->state;
+        f->state = nullptr;
+        return rc;
+    }
+
+    static int fileRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset)
+    {
+        return realFile(file)->pMethods->xRead(realFile(file), buffer, amount, offset);
+    }
+
+    static int fileWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset)
+    {
+        return realFile(file)->pMethods->xWrite(realFile(file), buffer, amount, offset);
+    }
+
+    static int fileTruncate(sqlite3_file *file, sqlite3_int64 size)
+    {
+        return realFile(file)->pMethods->xTruncate(realFile(file), size);
+    }
+
+    static int fileSync(sqlite3_file *file, int flags)
+    {
+        return realFile(file)->pMethods->xSync(realFile(file), flags);
+    }
+
+    static int fileSize(sqlite3_file *file, sqlite3_int64 *size)
+    {
+        return realFile(file)->pMethods->xFileSize(realFile(file), size);
+    }
+
+    static int fileLock(sqlite3_file *file, int lock)
+    {
+        return realFile(file)->pMethods->xLock(realFile(file), lock);
+    }
+
+    static int fileUnlock(sqlite3_file *file, int lock)
+    {
+        return realFile(file)->pMethods->xUnlock(realFile(file), lock);
+    }
+
+    static int fileCheckReservedLock(sqlite3_file *file, int *result)
+    {
+        return realFile(file)->pMethods->xCheckReservedLock(realFile(file), result);
+    }
+
+    static int fileControl(sqlite3_file *file, int op, void *arg)
+    {
+        return realFile(file)->pMethods->xFileControl(realFile(file), op, arg);
+    }
+
+    static int fileSectorSize(sqlite3_file *file)
+    {
+        return realFile(file)->pMethods->xSectorSize(realFile(file));
+    }
+
+    static int fileDeviceCharacteristics(sqlite3_file *file)
+    {
+        return realFile(file)->pMethods->xDeviceCharacteristics(realFile(file));
+    }
+
+    // encrypted files, the physical layout differs from the logical one
+
+    static int encryptedFileControl(sqlite3_file *file, int op, void *arg)
+    {
+        // size hints are given for the logical size
+        if (op == SQLITE_FCNTL_SIZE_HINT)
+        {
+            return SQLITE_OK;
+        }
+        return fileControl(file, op, arg);
+    }
+
+    static int encryptedDeviceCharacteristics(sqlite3_file *)
+    {
+        // no atomic or append-safe writes anymore, pages are stored in larger slots
+        return 0;
+    }
+
+    // main database
+
+    static inline sqlite3_int64 slotOffset(const FileState &state, const sqlite3_int64 &page)
+    {
+        return static_cast<sqlite3_int64>(DATABASE_HEADER_SIZE) + page * static_cast<sqlite3_int64>(state.slot_size);
+    }
+
+    static inline void pageNumber(const sqlite3_int64 &page, unsigned char *out)
+    {
+        for (auto i = 0U; i < 8; ++i)
+        {
+            out[i] = static_cast<unsigned char>(static_cast<std::uint64_t>(page) >> (8 * i));
+        }
+    }
+
+    // reads and decrypts a page, pages after the end of the file are zeroed
+    static int readPage(EncryptedFile *f, const sqlite3_int64 &page, unsigned char *out)
+    {
+        auto &state = *f->state;
+        auto slot = state.slot.data();
+
+        auto rc = f->real->pMethods->xRead(f->real, slot, static_cast<int>(state.slot_size), slotOffset(state, page));
+        if (rc == SQLITE_IOERR_SHORT_READ)
+        {
+            std::memset(out, 0, state.page_size);
+            return rc;
+        }
+        if (rc != SQLITE_OK)
+        {
+            return rc;
+        }
+
+        unsigned char aad[8];
+        pageNumber(page, aad);
+        if (!state.decryption.DecryptAndVerify(out, slot + NONCE_SIZE + state.page_size, TAG_SIZE,
+                                               slot, NONCE_SIZE, aad, sizeof(aad), slot + NONCE_SIZE, state.page_size))
+        {
+            return SQLITE_IOERR_READ;
+        }
+
+        return SQLITE_OK;
+    }
+
+    // encrypts and writes a page with a fresh nonce
+    static int writePage(EncryptedFile *f, const sqlite3_int64 &page, const unsigned char *in)
+    {
+        auto &state = *f->state;
+        auto slot = state.slot.data();
+
+        unsigned char aad[8];
+        pageNumber(page, aad);
+        state.rng.GenerateBlock(slot, NONCE_SIZE);
+        state.encryption.EncryptAndAuthenticate(slot + NONCE_SIZE, slot + NONCE_SIZE + state.page_size, TAG_SIZE,
+                                                slot, NONCE_SIZE, aad, sizeof(aad), in, state.page_size);
+
+        return f->real->pMethods->xWrite(f->real, slot, static_cast<int>(state.slot_size), slotOffset(state, page));
+    }
+
+    static int databaseRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset)
+    {
+        auto f = encryptedFile(file);
+        auto &state = *f->state;
+        auto out = static_cast<unsigned char*>(buffer);
+        auto result = SQLITE_OK;
+
+        try {
+            while (amount > 0)
+            {
+                const auto page = offset / state.page_size;
+                const auto begin = static_cast<std::size_t>(offset % state.page_size);
+                const auto length = std::min<std::size_t>(static_cast<std::size_t>(amount), state.page_size - begin);
+
+                int rc;
+                if (begin == 0 && length == state.page_size)
+                {
+                    rc = readPage(f, page, out);
+                }
+                else
+                {
+                    rc = readPage(f, page, state.page.data());
+                    std::memcpy(out, state.page.data() + begin, length);
+                }
+
+                if (rc == SQLITE_IOERR_SHORT_READ)
+                {
+                    result = rc;
+                }
+                else if (rc != SQLITE_OK)
+                {
+                    return rc;
+                }
+
+                out += length;
+                offset += static_cast<sqlite3_int64>(length);
+                amount -= static_cast<int>(length);
+            }
+        } catch (...) {
+            return SQLITE_IOERR_READ;
+        }
+
+        return result;
+    }
+
+    static int databaseWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset)
+    {
+        auto f = encryptedFile(file);
+        auto &state = *f->state;
+        auto in = static_cast<const unsigned char*>(buffer);
+
+        try {
+            while (amount > 0)
+            {
+                const auto page = offset / state.page_size;
+                const auto begin = static_cast<std::size_t>(offset % state.page_size);
+                const auto length = std::min<std::size_t>(static_cast<std::size_t>(amount), state.page_size - begin);
+
+                int rc;
+                if (begin == 0 && length == state.page_size)
+                {
+                    rc = writePage(f, page, in);
+                }
+                else
+                {
+                    // partial page, only happens when SQLite uses another page size
+                    rc = readPage(f, page, state.page.data());
+                    if (rc != SQLITE_OK && rc != SQLITE_IOERR_SHORT_READ)
+                    {
+                        return rc;
+                    }
+                    std::memcpy(state.page.data() + begin, in, length);
+                    rc = writePage(f, page, state.page.data());
+                }
+
+                if (rc != SQLITE_OK)
+                {
+                    return rc;
+                }
+
+                in += length;
+                offset += static_cast<sqlite3_int64>(length);
+                amount -= static_cast<int>(length);
+            }
+        } catch (...) {
+            return SQLITE_IOERR_WRITE;
+        }
+
+        return SQLITE_OK;
+    }
+
+    static int databaseTruncate(sqlite3_file *file, sqlite3_int64 size)
+    {
+        const auto &state = *encryptedFile(file)->state;
+        const auto pages = (size + state.page_size - 1) / state.page_size;
+        return fileTruncate(file, slotOffset(state, pages));
+    }
+
+    static int databaseFileSize(sqlite3_file *file, sqlite3_int64 *size)
+    {
+        const auto &state = *encryptedFile(file)->state;
+
+        sqlite3_int64 physical = 0;
+        auto rc = fileSize(file, &physical);
+        if (rc != SQLITE_OK)
+        {
+            return rc;
+        }
+
+        // incomplete slots at the end are not part of the database
+        *size = 0;
+        if (physical > static_cast<sqlite3_int64>(DATABASE_HEADER_SIZE))
+        {
+            *size = ((physical - static_cast<sqlite3_int64>(DATABASE_HEADER_SIZE)) /
+                     static_cast<sqlite3_int64>(state.slot_size)) * state.page_size;
+        }
+        return SQLITE_OK;
+    }
+
+    // journal
+
+    static inline sqlite3_int64 journalSlotOffset(const sqlite3_int64 &block)
+    {
+        return static_cast<sqlite3_int64>(JOURNAL_HEADER_SIZE) + block * static_cast<sqlite3_int64>(JOURNAL_SLOT_SIZE);
+    }
+
+    static inline void blockData(const sqlite3_int64 &block, const std::uint32_t &used, unsigned char *out)
+    {
+        pageNumber(block, out);
+        for (auto i = 0U; i < 4; ++i)
+        {
+            out[8 + i] = static_cast<unsigned char>(used >> (8 * i));
+        }
+    }
+
+    // decrypts a block into the page buffer, blocks after the end of the journal are empty,
+    // a block which fails verification is never used
+    static int loadBlock(sqlite3_file *real, FileState &state, const sqlite3_int64 &block)
+    {
+        if (state.block == block)
+        {
+            return SQLITE_OK;
+        }
+
+        state.block = -1;
+        if (block >= state.blocks)
+        {
+            std::memset(state.page.data(), 0, JOURNAL_BLOCK_SIZE);
+            state.block = block;
+            state.block_used = 0;
+            return SQLITE_OK;
+        }
+
+        auto slot = state.slot.data();
+        auto rc = real->pMethods->xRead(real, slot, static_cast<int>(JOURNAL_SLOT_SIZE), journalSlotOffset(block));
+        if (rc != SQLITE_OK)
+        {
+            return rc == SQLITE_IOERR_SHORT_READ ? SQLITE_IOERR_READ : rc;
+        }
+
+        std::uint32_t used = 0;
+        for (auto i = 0U; i < 4; ++i)
+        {
+            used |= static_cast<std::uint32_t>(slot[NONCE_SIZE + i]) << (8 * i);
+        }
+
+        unsigned char aad[12];
+        blockData(block, used, aad);
+        const auto data = slot + NONCE_SIZE + 4;
+        if (used > JOURNAL_BLOCK_SIZE ||
+            !state.decryption.DecryptAndVerify(state.page.data(), data + JOURNAL_BLOCK_SIZE, TAG_SIZE,
+                                               slot, NONCE_SIZE, aad, sizeof(aad), data, JOURNAL_BLOCK_SIZE))
+        {
+            return SQLITE_IOERR_READ;
+        }
+
+        state.block = block;
+        state.block_used = used;
+        return SQLITE_OK;
+    }
+
+    // encrypts and writes the block in the page buffer with a fresh nonce
+    static int storeBlock(sqlite3_file *real, FileState &state, const sqlite3_int64 &block, const std::uint32_t &used)
+    {
+        auto slot = state.slot.data();
+
+        unsigned char aad[12];
+        blockData(block, used, aad);
+        state.rng.GenerateBlock(slot, NONCE_SIZE);
+        std::memcpy(slot + NONCE_SIZE, aad + 8, 4);
+        const auto data = slot + NONCE_SIZE + 4;
+        state.encryption.EncryptAndAuthenticate(data, data + JOURNAL_BLOCK_SIZE, TAG_SIZE,
+                                                slot, NONCE_SIZE, aad, sizeof(aad), state.page.data(), JOURNAL_BLOCK_SIZE);
+
+        state.block = -1;
+        auto rc = real->pMethods->xWrite(real, slot, static_cast<int>(JOURNAL_SLOT_SIZE), journalSlotOffset(block));
+        if (rc != SQLITE_OK)
+        {
+            return rc;
+        }
+
+        state.block = block;
+        state.block_used = used;
+        state.blocks = std::max(state.blocks, block + 1);
+        return SQLITE_OK;
+    }
+
+    static int journalRead(sqlite3_file *file, void *buffer, int amount, sqlite3_int64 offset)
+    {
+        auto f = encryptedFile(file);
+        auto &state = *f->state;
+        auto out = static_cast<unsigned char*>(buffer);
+        auto result = SQLITE_OK;
+
+        if (state.salt_pending)
+        {
+            std::memset(out, 0, static_cast<std::size_t>(amount));
+            return SQLITE_IOERR_SHORT_READ;
+        }
+
+        try {
+            while (amount > 0)
+            {
+                const auto block = offset / static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE);
+                const auto begin = static_cast<std::size_t>(offset % static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE));
+                const auto length = std::min<std::size_t>(static_cast<std::size_t>(amount), JOURNAL_BLOCK_SIZE - begin);
+
+                const auto rc = loadBlock(f->real, state, block);
+                if (rc != SQLITE_OK)
+                {
+                    return rc;
+                }
+
+                // only the used part of a block was written, the rest reads as zeros
+                const auto available = state.block_used > begin ? std::min<std::size_t>(length, state.block_used - begin) : 0U;
+                std::memcpy(out, state.page.data() + begin, available);
+                if (available < length)
+                {
+                    std::memset(out + available, 0, length - available);
+                    result = SQLITE_IOERR_SHORT_READ;
+                }
+
+                out += length;
+                offset += static_cast<sqlite3_int64>(length);
+                amount -= static_cast<int>(length);
+            }
+        } catch (...) {
+            return SQLITE_IOERR_READ;
+        }
+
+        return result;
+    }
+
+    static int journalStart(sqlite3_file *file);
+
+    static int journalWrite(sqlite3_file *file, const void *buffer, int amount, sqlite3_int64 offset)
+    {
+        auto f = encryptedFile(file);
+        auto &state = *f->state;
+        auto in = static_cast<const unsigned char*>(buffer);
+
+        if (state.salt_pending)
+        {
+            auto rc = journalStart(file);
+            if (rc != SQLITE_OK)
+            {
+                return rc;
+            }
+        }
+
+        try {
+            while (amount > 0)
+            {
+                const auto block = offset / static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE);
+                const auto begin = static_cast<std::size_t>(offset % static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE));
+                const auto length = std::min<std::size_t>(static_cast<std::size_t>(amount), JOURNAL_BLOCK_SIZE - begin);
+
+                // blocks before the written one are used completely
+                for (auto gap = std::max<sqlite3_int64>(0, state.blocks - 1); gap < block; ++gap)
+                {
+                    auto rc = loadBlock(f->real, state, gap);
+                    if (rc == SQLITE_OK && state.block_used < JOURNAL_BLOCK_SIZE)
+                    {
+                        rc = storeBlock(f->real, state, gap, JOURNAL_BLOCK_SIZE);
+                    }
+                    if (rc != SQLITE_OK)
+                    {
+                        return rc == SQLITE_IOERR_READ ? SQLITE_IOERR_WRITE : rc;
+                    }
+                }
+
+                auto rc = loadBlock(f->real, state, block);
+                if (rc == SQLITE_OK)
+                {
+                    std::memcpy(state.page.data() + begin, in, length);
+                    rc = storeBlock(f->real, state, block, std::max<std::uint32_t>(state.block_used, static_cast<std::uint32_t>(begin + length)));
+                }
+                if (rc != SQLITE_OK)
+                {
+                    return rc == SQLITE_IOERR_READ ? SQLITE_IOERR_WRITE : rc;
+                }
+
+                in += length;
+                offset += static_cast<sqlite3_int64>(length);
+                amount -= static_cast<int>(length);
+            }
+        } catch (...) {
+            return SQLITE_IOERR_WRITE;
+        }
+
+        return SQLITE_OK;
+    }
+
+    static int journalTruncate(sqlite3_file *file, sqlite3_int64 size)
+    {
+        auto f = encryptedFile(file);
+        auto &state = *f->state;
+
+        // an empty journal is started again with a new key
+        if (size == 0)
+        {
+            state.salt_pending = true;
+            state.blocks = 0;
+            state.block = -1;
+            return fileTruncate(file, 0);
+        }
+
+        const auto blocks = (size + static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE) - 1) / static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE);
+        if (blocks > state.blocks)
+        {
+            return SQLITE_OK;
+        }
+
+        // the last block keeps only what is left of it
+        const auto used = static_cast<std::uint32_t>(size - (blocks - 1) * static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE));
+        try {
+            auto rc = loadBlock(f->real, state, blocks - 1);
+            if (rc == SQLITE_OK && used < state.block_used)
+            {
+                std::memset(state.page.data() + used, 0, JOURNAL_BLOCK_SIZE - used);
+                rc = storeBlock(f->real, state, blocks - 1, used);
+            }
+            if (rc != SQLITE_OK)
+            {
+                return SQLITE_IOERR_TRUNCATE;
+            }
+        } catch (...) {
+            return SQLITE_IOERR_TRUNCATE;
+        }
+
+        state.blocks = blocks;
+        return fileTruncate(file, journalSlotOffset(blocks));
+    }
+
+    static int journalFileSize(sqlite3_file *file, sqlite3_int64 *size)
+    {
+        auto f = encryptedFile(file);
+        auto &state = *f->state;
+
+        *size = 0;
+        if (state.salt_pending || state.blocks == 0)
+        {
+            return SQLITE_OK;
+        }
+
+        try {
+            const auto rc = loadBlock(f->real, state, state.blocks - 1);
+            if (rc != SQLITE_OK)
+            {
+                return rc;
+            }
+        } catch (...) {
+            return SQLITE_IOERR_FSTAT;
+        }
+
+        *size = (state.blocks - 1) * static_cast<sqlite3_int64>(JOURNAL_BLOCK_SIZE) + state.block_used;
+        return SQLITE_OK;
+    }
+
+    static const sqlite3_io_methods passthrough_methods = {
+        1,
+        fileClose, fileRead, fileWrite, fileTruncate, fileSync, fileSize,
+        fileLock, fileUnlock, fileCheckReservedLock, fileControl, fileSectorSize, fileDeviceCharacteristics,
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    };
+
+    // version 1, no WAL (shared memory) and no memory-mapped I/O
+    static const sqlite3_io_methods database_methods = {
+        1,
+        fileClose, databaseRead, databaseWrite, databaseTruncate, fileSync, databaseFileSize,
+        fileLock, fileUnlock, fileCheckReservedLock, encryptedFileControl, fileSectorSize, encryptedDeviceCharacteristics,
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    };
+
+    static const sqlite3_io_methods journal_methods = {
+        1,
+        fileClose, journalRead, journalWrite, journalTruncate, fileSync, journalFileSize,
+        fileLock, fileUnlock, fileCheckReservedLock, encryptedFileControl, fileSectorSize, encryptedDeviceCharacteristics,
+        nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+    };
+
+    static const Check keyCheck(const std::string &password, const Salt &salt)
+    {
+        Check check;
+        deriveKey(password, salt, CHECK_INFO, check.data(), check.size());
+        return check;
+    }
+
+    static void setDatabaseKey(FileState &state, const std::string &password, const Salt &salt)
+    {
+        state.key.CleanNew(KEY_SIZE);
+        deriveKey(password, salt, DATABASE_KEY_INFO, state.key, state.key.size());
+
+        const unsigned char iv[NONCE_SIZE] = {};
+        state.encryption.SetKeyWithIV(state.key, state.key.size(), iv, sizeof(iv));
+        state.decryption.SetKeyWithIV(state.key, state.key.size(), iv, sizeof(iv));
+
+        state.slot_size = NONCE_SIZE + state.page_size + TAG_SIZE;
+        state.slot.resize(state.slot_size);
+        state.page.resize(state.page_size);
+    }
+
+    static void setJournalKey(FileState &state, const std::string &password, const Salt &salt)
+    {
+        state.key.CleanNew(KEY_SIZE);
+        deriveKey(password, salt, JOURNAL_KEY_INFO, state.key, state.key.size());
+
+        const unsigned char iv[NONCE_SIZE] = {};
+        state.encryption.SetKeyWithIV(state.key, state.key.size(), iv, sizeof(iv));
+        state.decryption.SetKeyWithIV(state.key, state.key.size(), iv, sizeof(iv));
+
+        state.slot.resize(JOURNAL_SLOT_SIZE);
+        state.page.resize(JOURNAL_BLOCK_SIZE);
+        state.block = -1;
+    }
+
+    static int openDatabase(sqlite3_file *real, FileState &state, const std::string &password)
+    {
+        sqlite3_int64 size = 0;
+        auto rc = real->pMethods->xFileSize(real, &size);
+        if (rc != SQLITE_OK)
+        {
+            return rc;
+        }
+
+        unsigned char header[DATABASE_HEADER_SIZE] = {};
+        Salt salt;
+
+        // new database
+        if (size == 0)
+        {
+            state.rng.GenerateBlock(salt.data(), salt.size());
+            const auto check = keyCheck(password, salt);
+
+            std::memcpy(header, DATABASE_MAGIC, sizeof(DATABASE_MAGIC));
+            header[8] = DATABASE_VERSION;
+            for (auto i = 0U; i < 4; ++i)
+            {
+                header[12 + i] = static_cast<unsigned char>(state.page_size >> (8 * i));
+            }
+            std::memcpy(header + 16, salt.data(), salt.size());
+            std::memcpy(header + 32, check.data(), check.size());
+
+            rc = real->pMethods->xWrite(real, header, sizeof(header), 0);
+            if (rc != SQLITE_OK)
+            {
+                return rc;
+            }
+
+            setDatabaseKey(state, password, salt);
+            return SQLITE_OK;
+        }
+
+        rc = real->pMethods->xRead(real, header, sizeof(header), 0);
+        if (rc != SQLITE_OK)
+        {
+            return rc == SQLITE_IOERR_SHORT_READ ? SQLITE_NOTADB : rc;
+        }
+        if (std::memcmp(header, DATABASE_MAGIC, sizeof(DATABASE_MAGIC)) != 0 || header[8] != DATABASE_VERSION)
+        {
+            return SQLITE_NOTADB;
+        }
+
+        state.page_size = 0;
+        for (auto i = 0U; i < 4; ++i)
+        {
+            state.page_size |= static_cast<std::uint32_t>(header[12 + i]) << (8 * i);
+        }
+        if (state.page_size < 512 || state.page_size > MAX_PAGE_SIZE)
+        {
+            return SQLITE_NOTADB;
+        }
+
+        std::memcpy(salt.data(), header + 16, salt.size());
+        const auto check = keyCheck(password, salt);
+        if (!CryptoPP::VerifyBufsEqual(check.data(), header + 32, check.size()))
+        {
+            return SQLITE_AUTH;
+        }
+
+        setDatabaseKey(state, password, salt);
+        return SQLITE_OK;
+    }
+
+    static int openJournal(sqlite3_file *real, FileState &state, const std::string &password)
+    {
+        sqlite3_int64 size = 0;
+        auto rc = real->pMethods->xFileSize(real, &size);
+        if (rc != SQLITE_OK)
+        {
+            return rc;
+        }
+
+        // the header is written with the first write
+        if (size < static_cast<sqlite3_int64>(JOURNAL_HEADER_SIZE))
+        {
+            state.salt_pending = true;
+            state.password = password;
+            return SQLITE_OK;
+        }
+
+        // existing (hot) journal
+        unsigned char header[JOURNAL_HEADER_SIZE];
+        rc = real->pMethods->xRead(real, header, sizeof(header), 0);
+        if (rc != SQLITE_OK)
+        {
+            return rc;
+        }
+
+        Salt salt;
+        std::memcpy(salt.data(), header, salt.size());
+        const auto check = keyCheck(password, salt);
+        if (!CryptoPP::VerifyBufsEqual(check.data(), header + SALT_SIZE, check.size()))
+        {
+            return SQLITE_AUTH;
+        }
+
+        setJournalKey(state, password, salt);
+
+        // a block which was written partially during a crash is not part of the journal
+        state.blocks = (size - static_cast<sqlite3_int64>(JOURNAL_HEADER_SIZE)) / static_cast<sqlite3_int64>(JOURNAL_SLOT_SIZE);
+
+        // SQLite writes every record it reads back into the database, the whole journal
+        // is verified first so that nothing of a modified journal is played back
+        for (sqlite3_int64 block = 0; block < state.blocks; ++block)
+        {
+            rc = loadBlock(real, state, block);
+            if (rc != SQLITE_OK)
+            {
+                return rc;
+            }
+            if (block + 1 < state.blocks && state.block_used != JOURNAL_BLOCK_SIZE)
+            {
+                return SQLITE_IOERR_READ;
+            }
+        }
+        return SQLITE_OK;
+    }
+
+    static int journalStart(sqlite3_file *file)
+    {
+        auto &state = *encryptedFile(file)->state;
+        const auto &password = state.password;
+
+        try {
+            Salt salt;
+            state.rng.GenerateBlock(salt.data(), salt.size());
+            const auto check = keyCheck(password, salt);
+
+            unsigned char header[JOURNAL_HEADER_SIZE];
+            std::memcpy(header, salt.data(), salt.size());
+            std::memcpy(header + SALT_SIZE, check.data(), check.size());
+
+            auto rc = fileWrite(file, header, sizeof(header), 0);
+            if (rc != SQLITE_OK)
+            {
+                return rc;
+            }
+
+            setJournalKey(state, password, salt);
+        } catch (...) {
+            return SQLITE_IOERR_WRITE;
+        }
+
+        state.blocks = 0;
+        state.salt_pending = false;
+        return SQLITE_OK;
+    }
+
+    // VFS methods
+
+    static int vfsOpen(sqlite3_vfs *, const char *name, sqlite3_file *file, int flags, int *out_flags)
+    {
+        auto f = encryptedFile(file);
+        std::memset(f, 0, sizeof(EncryptedFile));
+        f->real = reinterpret_cast<sqlite3_file*>(reinterpret_cast<char*>(file) + sizeof(EncryptedFile));
+
+        // journals use the password of their database
+        const auto encrypted = (flags & (SQLITE_OPEN_MAIN_DB | SQLITE_OPEN_MAIN_JOURNAL)) != 0;
+        std::string password;
+        if (encrypted)
+        {
+            std::string database = name ? name : "";
+            if (flags & SQLITE_OPEN_MAIN_JOURNAL)
+            {
+                database = database.substr(0, database.rfind("-journal"));
+            }
+
+            std::lock_guard<std::mutex> lock(vfs_mutex);
+            const auto it = vfs_passwords.find(database);
+            if (it != vfs_passwords.end())
+            {
+                password = it->second;
+            }
+        }
+
+        // never create or decrypt a file with an empty key, the file isn't touched
+        if (encrypted && password.empty())
+        {
+            return SQLITE_AUTH;
+        }
+
+        auto rc = base_vfs->xOpen(base_vfs, name, f->real, flags, out_flags);
+        if (rc != SQLITE_OK)
+        {
+            if (f->real->pMethods)
+            {
+                f->real->pMethods->xClose(f->real);
+            }
+            return rc;
+        }
+
+        // temporary files are passed through
+        if (!encrypted)
+        {
+            f->base.pMethods = &passthrough_methods;
+            return SQLITE_OK;
+        }
+
+        try {
+            auto state = std::make_unique<FileState>();
+            rc = (flags & SQLITE_OPEN_MAIN_DB) ? openDatabase(f->real, *state, password)
+                                               : openJournal(f->real, *state, password);
+            if (rc == SQLITE_OK)
+            {
+                f->state = state.release();
+                f->base.pMethods = (flags & SQLITE_OPEN_MAIN_DB) ? &database_methods : &journal_methods;
+                return SQLITE_OK;
+            }
+        } catch (...) {
+            rc = SQLITE_CANTOPEN;
+        }
+
+        f->real->pMethods->xClose(f->real);
+        return rc;
+    }
+
+    static int vfsDelete(sqlite3_vfs *, const char *name, int sync_dir)
+    {
+        return base_vfs->xDelete(base_vfs, name, sync_dir);
+    }
+
+    static int vfsAccess(sqlite3_vfs *, const char *name, int flags, int *result)
+    {
+        return base_vfs->xAccess(base_vfs, name, flags, result);
+    }
+
+    static int vfsFullPathname(sqlite3_vfs *, const char *name, int size, char *out)
+    {
+        return base_vfs->xFullPathname(base_vfs, name, size, out);
+    }
+
+    static void *vfsDlOpen(sqlite3_vfs *, const char *name)
+    {
+        return base_vfs->xDlOpen(base_vfs, name);
+    }
+
+    static void vfsDlError(sqlite3_vfs *, int size, char *out)
+    {
+        base_vfs->xDlError(base_vfs, size, out);
+    }
+
+    static void (*vfsDlSym(sqlite3_vfs *, void *handle, const char *symbol))(void)
+    {
+        return base_vfs->xDlSym(base_vfs, handle, symbol);
+    }
+
+    static void vfsDlClose(sqlite3_vfs *, void *handle)
+    {
+        base_vfs->xDlClose(base_vfs, handle);
+    }
+
+    static int vfsRandomness(sqlite3_vfs *, int size, char *out)
+    {
+        return base_vfs->xRandomness(base_vfs, size, out);
+    }
+
+    static int vfsSleep(sqlite3_vfs *, int microseconds)
+    {
+        return base_vfs->xSleep(base_vfs, microseconds);
+    }
+
+    static int vfsCurrentTime(sqlite3_vfs *, double *time)
+    {
+        return base_vfs->xCurrentTime(base_vfs, time);
+    }
+
+    static int vfsGetLastError(sqlite3_vfs *, int size, char *out)
+    {
+        return base_vfs->xGetLastError ? base_vfs->xGetLastError(base_vfs, size, out) : 0;
+    }
+
+    static int vfsCurrentTimeInt64(sqlite3_vfs *, sqlite3_int64 *time)
+    {
+        if (base_vfs->iVersion >= 2 && base_vfs->xCurrentTimeInt64)
+        {
+            return base_vfs->xCurrentTimeInt64(base_vfs, time);
+        }
+
+        double now = 0;
+        auto rc = base_vfs->xCurrentTime(base_vfs, &now);
+        *time = static_cast<sqlite3_int64>(now * 86400000.0);
+        return rc;
+    }
+}
+
+namespace {
+    // SQLite opens files by their full path
+    static const std::string fullPathname(const std::string &file)
+    {
+        if (!EncryptedVFS::registerVFS())
+        {
+            return file;
+        }
+
+        std::vector<char> path(static_cast<std::size_t>(base_vfs->mxPathname) + 1);
+        if (base_vfs->xFullPathname(base_vfs, file.c_str(), static_cast<int>(path.size()), path.data()) != SQLITE_OK)
+        {
+            return file;
+        }
+        return path.data();
+    }
+}
+
+const char *EncryptedVFS::name = "otpgen-encrypted";
+const int EncryptedVFS::pageSize = static_cast<int>(PAGE_SIZE);
+
+bool EncryptedVFS::registerVFS()
+{
+    static std::once_flag once;
+    static bool registered = false;
+
+    std::call_once(once, []{
+        base_vfs = sqlite3_vfs_find(nullptr);
+        if (!base_vfs)
+        {
+            return;
+        }
+
+        vfs.iVersion = 2;
+        vfs.szOsFile = static_cast<int>(sizeof(EncryptedFile)) + base_vfs->szOsFile;
+        vfs.mxPathname = base_vfs->mxPathname;
+        vfs.zName = EncryptedVFS::name;
+        vfs.xOpen = vfsOpen;
+        vfs.xDelete = vfsDelete;
+        vfs.xAccess = vfsAccess;
+        vfs.xFullPathname = vfsFullPathname;
+        vfs.xDlOpen = vfsDlOpen;
+        vfs.xDlError = vfsDlError;
+        vfs.xDlSym = vfsDlSym;
+        vfs.xDlClose = vfsDlClose;
+        vfs.xRandomness = vfsRandomness;
+        vfs.xSleep = vfsSleep;
+        vfs.xCurrentTime = vfsCurrentTime;
+        vfs.xGetLastError = vfsGetLastError;
+        vfs.xCurrentTimeInt64 = vfsCurrentTimeInt64;
+
+        registered = sqlite3_vfs_register(&vfs, 0) == SQLITE_OK;
+    });
+
+    return registered;
+}
+
+void EncryptedVFS::setPassword(const std::string &file, const std::string &password)
+{
+    const auto path = fullPathname(file);
+
+    std::lock_guard<std::mutex> lock(vfs_mutex);
+    vfs_passwords[path] = password;
+}
+
+void EncryptedVFS::removePassword(const std::string &file)
+{
+    const auto path = fullPathname(file);
+
+    std::lock_guard<std::mutex> lock(vfs_mutex);
+    vfs_passwords.erase(path);
+}
+
+bool EncryptedVFS::isEncryptedFile(const std::string &file)
+{
+    std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+    char magic[sizeof(DATABASE_MAGIC)];
+    if (!stream.read(magic, sizeof(magic)))
+    {
+        return false;
+    }
+    return std::memcmp(magic, DATABASE_MAGIC, sizeof(DATABASE_MAGIC)) == 0;
+}
@@ -0,0 +1,47 @@
+#ifndef ENCRYPTEDVFS_HPP
+#define ENCRYPTEDVFS_HPP
+
+#include <string>
+
+/**
+ * SQLite VFS which encrypts and authenticates every database page on its own.
+ *
+ * The VFS wraps the default VFS of the platform. Pages of the main database
+ * are stored in slots of a random nonce, the AES-256-GCM encrypted page and
+ * its tag, the page number is authenticated with every page. Only the pages
+ * which were changed by a transaction are encrypted and written again.
+ *
+ * Rollback journals are encrypted and authenticated in blocks with AES-256-GCM
+ * under a key derived from a random salt in the journal header, a journal which
+ * fails verification is not played back. Other temporary files are passed
+ * through unmodified, the connection must keep them in memory
+ * (PRAGMA temp_store = MEMORY). WAL and memory-mapped I/O are not supported.
+ *
+ * The key of a file is derived from the password of the database file and
+ * the random salt of the file header. Every database can have its own
+ * password, the password must be set before the database is opened.
+ */
+class EncryptedVFS
+{
+    EncryptedVFS() = delete;
+
+public:
+    // name of the VFS, pass it to sqlite3_open_v2()
+    static const char *name;
+
+    // page size of new databases, set it with PRAGMA page_size before the first write
+    static const int pageSize;
+
+    // register the VFS with SQLite (once), returns false on failure
+    static bool registerVFS();
+
+    // password of the database file and its journal, the file is matched by its full path,
+    // a file which is already open keeps its password
+    static void setPassword(const std::string &file, const std::string &password);
+    static void removePassword(const std::string &file);
+
+    // checks if the file starts with the header of an encrypted database
+    static bool isEncryptedFile(const std::string &file);
+};
+
+#endif // ENCRYPTEDVFS_HPP
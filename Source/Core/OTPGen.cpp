@@ -1,15 +1,15 @@
 #include "OTPGen.hpp"
 
-#include <cryptopp/filters.h>
-#include <cryptopp/base32.h>
-#include <cryptopp/base64.h>
-#include <cryptopp/hmac.h>
-#include <cryptopp/sha.h>
+#include "OTPPreparedKey.hpp"
+#include "OTPReplayCache.hpp"
+#include "TokenBatch.hpp"
+
+#include <algorithm>
+
+#include <cryptopp/misc.h>
 
 namespace {
     static const constexpr auto SHA1_DIGEST_SIZE = 20;
-    static const constexpr auto SHA256_DIGEST_SIZE = 32;
-    static const constexpr auto SHA512_DIGEST_SIZE = 64;
 
     static const constexpr std::uint64_t DIGITS_POWER[] = {
         1,
@@ -25,134 +25,46 @@ namespace {
         10000000000,
     };
 
-    static const std::string normalize_secret(const std::string &secret)
+    // "00" to "99" lookup table to format two digits at once
+    struct DigitPairTable
     {
-        auto nK = static_cast<char*>(std::calloc(1, secret.size() + 1));
+        char pairs[200];
 
-        std::size_t i = 0, j = 0;
-        while (secret[i] != '\0')
+        constexpr DigitPairTable()
+            : pairs()
         {
-            if (secret[i] != ' ')
+            for (auto i = 0; i < 100; ++i)
             {
-                if (secret[i] >= 'a' && secret[i] <= 'z')
-                {
-                    nK[j++] = static_cast<char>( (secret[i] - 32) );
-                }
-                else
-                {
-                    nK[j++] = secret[i];
-                }
+                pairs[i * 2] = static_cast<char>('0' + i / 10);
+                pairs[i * 2 + 1] = static_cast<char>('0' + i % 10);
             }
-            i++;
         }
+    };
 
-        std::string normalized(nK, nK + strlen(nK));
-        std::free(nK);
-        return normalized;
-    }
-
-    static const std::string base32_rfc4648_decode(const std::string &key)
-    {
-        if (key.empty())
-        {
-            return {};
-        }
-
-        // create an RFC 4648 base-32 decoder
-        // crypto++ uses DUDE by default which isn't TOTP compatible
-        auto decoder = new CryptoPP::Base32Decoder();
-
-        static int lookup[256];
-        static const CryptoPP::byte ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
-        static const auto init = ([&]{ CryptoPP::Base64Decoder::InitializeDecodingLookupArray(lookup, ALPHABET, 32, true); return 0; })(); (void) init;
-        static const CryptoPP::AlgorithmParameters params = CryptoPP::MakeParameters(
-                                                            CryptoPP::Name::DecodingLookupArray(),
-                                                            static_cast<const int*>(lookup));
-        decoder->IsolatedInitialize(params);
-
-        // raw pointers are automatically deleted by crypto++
-        std::string base32;
-        decoder->Attach(new CryptoPP::StringSink(base32));
-
-        // result may be binary (unsigned char)
-        try {
-            CryptoPP::StringSource(key, true, decoder);
-        } catch (...) {
-            return {};
-        }
-
-        return base32;
-    }
-
-    // template helper function to compute HMAC's of different SHA algorithms
-    template<class CryptoPPHMacClass>
-    static inline const std::string compute_hmac_helper(const std::string &key, unsigned char value[8])
-    {
-        CryptoPPHMacClass cryptoHmac(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+    static const constexpr DigitPairTable DIGIT_PAIRS;
 
-        std::string hmac;
-        CryptoPP::StringSource(value, 8, true,
-            new CryptoPP::HashFilter(cryptoHmac,
-                new CryptoPP::StringSink(hmac)));
-        return hmac;
-    }
-
-    static const std::string compute_hmac(const std::string &key, long C, const OTPToken::ShaAlgorithm &algo)
+    // writes the zero-padded token from right to left into the buffer
+    static void finalize(const OTPToken::DigitType &digits_length, std::uint32_t tk, OTPGen::TokenBuffer &out)
     {
-        // normalize and decode secret
-        const auto normalized_key = normalize_secret(key);
-        const auto secret = base32_rfc4648_decode(normalized_key);
-
-        // don't continue on empty secret
-        if (secret.empty())
-        {
-            return {};
-        }
+        auto pos = static_cast<int>(digits_length);
+        out.data[pos] = '\0';
+        out.size = digits_length;
 
-        // calculate reverse byte order of C
-        unsigned char C_reverse_byte_order[8];
-        int j, i;
-        for (j = 0, i = 7; j < 8 && i >= 0; j++, i--)
+        while (pos >= 2)
         {
-            C_reverse_byte_order[i] = (reinterpret_cast<unsigned char*>(&C))[j];
+            const auto pair = (tk % 100) * 2;
+            tk /= 100;
+            out.data[--pos] = DIGIT_PAIRS.pairs[pair + 1];
+            out.data[--pos] = DIGIT_PAIRS.pairs[pair];
         }
 
-        // compute the HMAC and store it into a string
-        std::string hmac;
-        switch (algo)
+        if (pos == 1)
         {
-            case OTPToken::SHA1:   hmac = compute_hmac_helper<CryptoPP::HMAC<CryptoPP::SHA1>>(secret, C_reverse_byte_order); break;
-            case OTPToken::SHA256: hmac = compute_hmac_helper<CryptoPP::HMAC<CryptoPP::SHA256>>(secret, C_reverse_byte_order); break;
-            case OTPToken::SHA512: hmac = compute_hmac_helper<CryptoPP::HMAC<CryptoPP::SHA512>>(secret, C_reverse_byte_order); break;
+            out.data[0] = static_cast<char>('0' + tk % 10);
         }
-
-        // validate HMAC
-        if (hmac.empty())
-        {
-            return {};
-        }
-
-        return hmac;
-    }
-
-    static const std::string finalize(const OTPToken::DigitType &digits_length, int tk)
-    {
-        auto token = static_cast<char*>(std::malloc(digits_length + 1));
-
-        int extra_char = digits_length < 10 ? 0 : 1;
-        auto fmt = static_cast<char*>(std::calloc(1, 5 + extra_char));
-        std::memcpy(fmt, "%.", 2);
-        std::snprintf(fmt + 2, 2 + extra_char, "%d", digits_length);
-        std::memcpy(fmt + 3 + extra_char, "d", 2);
-        std::snprintf(token, digits_length + 1, fmt, tk);
-        std::free(fmt);
-
-        std::string tokenStr(token, token + strlen(token));
-        std::free(token);
-        return tokenStr;
     }
 
-    static int compute_bin_code(const std::string &hmac, unsigned long offset)
+    static int compute_bin_code(const unsigned char *hmac, unsigned long offset)
     {
         // starting from the offset, take the successive 4 bytes while stripping
         // the topmost bit to prevent it being handled as a signed integer
@@ -163,50 +75,133 @@ namespace {
             ((hmac[offset + 3] & 0xff));
     }
 
-    static int truncate(const std::string &hmac,
-                        const OTPToken::DigitType &digits_length,
-                        const OTPToken::ShaAlgorithm algo)
+    static std::uint32_t truncate(const unsigned char *hmac,
+                                  const OTPToken::DigitType &digits_length,
+                                  const std::size_t &digest_size)
     {
         // take the lower four bits of the last byte
-        unsigned long offset = 0;
-        switch (algo)
-        {
-            case OTPToken::SHA1:
-                offset = (hmac[SHA1_DIGEST_SIZE-1] & 0x0f);
-                break;
-            case OTPToken::SHA256:
-                offset = (hmac[SHA256_DIGEST_SIZE-1] & 0x0f);
-                break;
-            case OTPToken::SHA512:
-                offset = (hmac[SHA512_DIGEST_SIZE-1] & 0x0f);
-                break;
-        }
+        unsigned long offset = (hmac[digest_size-1] & 0x0f);
 
         auto bin_code = compute_bin_code(hmac, offset);
-        int token = bin_code % DIGITS_POWER[digits_length];
+        auto token = static_cast<std::uint32_t>(bin_code % DIGITS_POWER[digits_length]);
         return token;
     }
 
-    static const OTPToken::TokenString hotp_helper(const OTPToken::TokenSecret &base32_secret,
-                                                   const std::time_t &counter,
-                                                   const OTPToken::DigitType &digits,
-                                                   const OTPToken::ShaAlgorithm &sha_algo,
-                                                   OTPGenErrorCode *error)
+    static bool hotp_helper(const OTPPreparedKey &key,
+                            const std::uint64_t &counter,
+                            const OTPToken::DigitType &digits,
+                            OTPGen::TokenBuffer &out,
+                            OTPGenErrorCode *error)
     {
-        const auto hmac = compute_hmac(base32_secret, counter, sha_algo);
-        if (hmac.empty())
+        unsigned char hmac[OTPPreparedKey::maxDigestSize()];
+        const auto digest_size = key.computeHmac(counter, hmac);
+        if (digest_size == 0)
         {
             if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
-            return {};
+            return false;
+        }
+
+        auto tk = truncate(hmac, digits, digest_size);
+        finalize(digits, tk, out);
+        return true;
+    }
+
+    static void steam_helper(const unsigned char *hmac, OTPGen::TokenBuffer &out)
+    {
+        static const constexpr char steam_alphabet[] = "23456789BCDFGHJKMNPQRTVWXY";
+        static const constexpr auto steam_alphabet_size = sizeof(steam_alphabet) - 1;
+
+        unsigned long offset = (hmac[SHA1_DIGEST_SIZE-1] & 0x0f);
+        auto bin_code = compute_bin_code(hmac, offset);
+
+        for (auto i = 0; i < 5; i++)
+        {
+            int mod = bin_code % steam_alphabet_size;
+            bin_code = bin_code / steam_alphabet_size;
+            out.data[i] = steam_alphabet[mod];
+        }
+        out.data[5] = '\0';
+        out.size = 5;
+    }
+
+    // searches the window around the counter for a matching token, closest offsets first
+    // tokens are compared in constant time, the search stops at the first match which is
+    // newer than the last accepted counter in the replay cache
+    template<typename Generator>
+    static bool verify_window(const OTPToken::TokenString &token,
+                              const std::uint64_t &counter,
+                              const std::uint32_t &behind,
+                              const std::uint32_t &ahead,
+                              const std::uint64_t &max_counter,
+                              const OTPGen::VerifyOptions &options,
+                              const Generator &generate,
+                              std::int64_t *offset,
+                              OTPGenErrorCode *error)
+    {
+        // id 0 belongs to no token (not stored in a database), nothing is tracked for it
+        const auto replay_cache = options.tokenId != 0 ? options.replayCache : nullptr;
+
+        // counters up to the last accepted one are replays
+        std::uint64_t last_accepted = 0;
+        const auto has_last_accepted = replay_cache && replay_cache->lastAccepted(options.tokenId, last_accepted);
+
+        bool replayed = false;
+        OTPGen::TokenBuffer expected;
+
+        const auto steps = static_cast<std::uint64_t>(std::max(behind, ahead));
+        for (std::uint64_t step = 0; step <= steps; ++step)
+        {
+            for (auto&& behind_counter : {true, false})
+            {
+                // offset 0 is only checked once, skip counters outside of the window
+                if ((step == 0 && !behind_counter) ||
+                    (behind_counter && (step > behind || step > counter)) ||
+                    (!behind_counter && (step > ahead || counter + step > max_counter)))
+                {
+                    continue;
+                }
+
+                const auto candidate = behind_counter ? counter - step : counter + step;
+                if (!generate(candidate, expected))
+                {
+                    if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
+                    return false;
+                }
+
+                if (expected.size != token.size() ||
+                    !CryptoPP::VerifyBufsEqual(reinterpret_cast<const CryptoPP::byte*>(expected.data),
+                                               reinterpret_cast<const CryptoPP::byte*>(token.data()),
+                                               expected.size))
+                {
+                    continue;
+                }
+
+                if ((has_last_accepted && candidate <= last_accepted) ||
+                    (replay_cache && !replay_cache->accept(options.tokenId, candidate)))
+                {
+                    replayed = true;
+                    continue;
+                }
+
+                if (offset)
+                {
+                    (*offset) = behind_counter ? -static_cast<std::int64_t>(step) : static_cast<std::int64_t>(step);
+                }
+                return true;
+            }
+        }
+
+        if (replayed && error)
+        {
+            (*error) = OTPGenErrorCode::TokenReplayed;
         }
 
-        auto tk = truncate(hmac, digits, sha_algo);
-        return finalize(digits, tk);
+        return false;
     }
 
     static bool check_period(const OTPToken::PeriodType &period)
     {
-        return !(period <= OTPGen::minPeriod() || period > OTPGen::maxPeriod());
+        return !(period < OTPGen::minPeriod() || period > OTPGen::maxPeriod());
     }
 
     static bool check_otp_length(const OTPToken::DigitType &digits_length)
@@ -246,21 +241,47 @@ const OTPToken::TokenString OTPGen::computeTOTP(const std::time_t &time,
                                                 const OTPToken::ShaAlgorithm &sha_algo,
                                                 OTPGenErrorCode *error)
 {
+    return computeTOTP(time, OTPPreparedKey(base32_secret, sha_algo), digits, period, error);
+}
+
+// compute totp at a given time using a prepared key
+const OTPToken::TokenString OTPGen::computeTOTP(const std::time_t &time,
+                                                const OTPPreparedKey &key,
+                                                const OTPToken::DigitType &digits,
+                                                const OTPToken::PeriodType &period,
+                                                OTPGenErrorCode *error)
+{
+    TokenBuffer token;
+    computeTOTP(time, key, digits, period, token, error);
+    return OTPToken::TokenString(token.data, token.size);
+}
+
+// compute totp at a given time using a prepared key into a fixed-size buffer
+bool OTPGen::computeTOTP(const std::time_t &time,
+                         const OTPPreparedKey &key,
+                         const OTPToken::DigitType &digits,
+                         const OTPToken::PeriodType &period,
+                         TokenBuffer &out,
+                         OTPGenErrorCode *error)
+{
+    out.clear();
+
     if (!check_otp_length(digits))
     {
         if (error) (*error) = OTPGenErrorCode::InvalidDigits;
-        return {};
+        return false;
     }
 
     if (!check_period(period))
     {
         if (error) (*error) = OTPGenErrorCode::InvalidPeriod;
+        return false;
     }
 
     auto timestamp = time / period;
 
     // use hotp with the timestamp as counter to compute a totp token
-    return hotp_helper(base32_secret, timestamp, digits, sha_algo, error);
+    return hotp_helper(key, static_cast<std::uint64_t>(timestamp), digits, out, error);
 }
 
 // compute hotp
@@ -270,19 +291,42 @@ const OTPToken::TokenString OTPGen::computeHOTP(const OTPToken::TokenSecret &bas
                                                 const OTPToken::ShaAlgorithm &sha_algo,
                                                 OTPGenErrorCode *error)
 {
-    if (!check_algo(sha_algo))
+    return computeHOTP(OTPPreparedKey(base32_secret, sha_algo), counter, digits, error);
+}
+
+// compute hotp using a prepared key
+const OTPToken::TokenString OTPGen::computeHOTP(const OTPPreparedKey &key,
+                                                const OTPToken::CounterType &counter,
+                                                const OTPToken::DigitType &digits,
+                                                OTPGenErrorCode *error)
+{
+    TokenBuffer token;
+    computeHOTP(key, counter, digits, token, error);
+    return OTPToken::TokenString(token.data, token.size);
+}
+
+// compute hotp using a prepared key into a fixed-size buffer
+bool OTPGen::computeHOTP(const OTPPreparedKey &key,
+                         const OTPToken::CounterType &counter,
+                         const OTPToken::DigitType &digits,
+                         TokenBuffer &out,
+                         OTPGenErrorCode *error)
+{
+    out.clear();
+
+    if (!check_algo(key.algorithm()))
     {
         if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
-        return {};
+        return false;
     }
 
     if (!check_otp_length(digits))
     {
         if (error) (*error) = OTPGenErrorCode::InvalidDigits;
-        return {};
+        return false;
     }
 
-    return hotp_helper(base32_secret, counter, digits, sha_algo, error);
+    return hotp_helper(key, counter, digits, out, error);
 }
 
 // compute steam token at current time
@@ -297,29 +341,321 @@ const OTPToken::TokenString OTPGen::computeSteam(const std::time_t &time,
                                                  const OTPToken::TokenSecret &base32_secret,
                                                  OTPGenErrorCode *error)
 {
-    static const std::string steam_alphabet = "23456789BCDFGHJKMNPQRTVWXY";
+    return computeSteam(time, OTPPreparedKey(base32_secret, OTPToken::SHA1), error);
+}
+
+// compute steam token at a given time using a prepared key
+const OTPToken::TokenString OTPGen::computeSteam(const std::time_t &time,
+                                                 const OTPPreparedKey &key,
+                                                 OTPGenErrorCode *error)
+{
+    TokenBuffer token;
+    computeSteam(time, key, token, error);
+    return OTPToken::TokenString(token.data, token.size);
+}
+
+// compute steam token at a given time using a prepared key into a fixed-size buffer
+bool OTPGen::computeSteam(const std::time_t &time,
+                          const OTPPreparedKey &key,
+                          TokenBuffer &out,
+                          OTPGenErrorCode *error)
+{
+    out.clear();
 
     auto timestamp = time / OTPToken::defaultPeriod(OTPToken::Steam);
 
-    const auto hmac = compute_hmac(base32_secret, timestamp, OTPToken::SHA1);
-    if (hmac.empty())
+    // steam tokens are always SHA1
+    if (key.algorithm() != OTPToken::SHA1)
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return false;
+    }
+
+    unsigned char hmac[OTPPreparedKey::maxDigestSize()];
+    if (key.computeHmac(static_cast<std::uint64_t>(timestamp), hmac) == 0)
     {
         if (error) (*error) = OTPGenErrorCode::InvalidBase32Input;
-        return {};
+        return false;
+    }
+
+    steam_helper(hmac, out);
+    return true;
+}
+
+// verify a totp token at a given time within the drift window
+bool OTPGen::verifyTOTP(const std::time_t &time,
+                        const OTPPreparedKey &key,
+                        const OTPToken::TokenString &token,
+                        const OTPToken::DigitType &digits,
+                        const OTPToken::PeriodType &period,
+                        const VerifyOptions &options,
+                        std::int64_t *offset,
+                        OTPGenErrorCode *error)
+{
+    if (error) (*error) = OTPGenErrorCode::Valid;
+
+    if (!check_otp_length(digits))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+        return false;
+    }
+
+    if (!check_period(period))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidPeriod;
+        return false;
+    }
+
+    // the length of the token is not a secret
+    if (token.size() != digits || time < 0)
+    {
+        return false;
+    }
+
+    const auto counter = static_cast<std::uint64_t>(time / period);
+
+    return verify_window(token, counter, options.window, options.window,
+                         std::numeric_limits<std::uint64_t>::max(), options,
+                         [&](const std::uint64_t &c, TokenBuffer &expected) {
+                             return hotp_helper(key, c, digits, expected, nullptr);
+                         }, offset, error);
+}
+
+// verify a hotp token within the look-ahead window of the given counter
+bool OTPGen::verifyHOTP(const OTPPreparedKey &key,
+                        const OTPToken::TokenString &token,
+                        const OTPToken::CounterType &counter,
+                        const OTPToken::DigitType &digits,
+                        const VerifyOptions &options,
+                        std::int64_t *offset,
+                        OTPGenErrorCode *error)
+{
+    if (error) (*error) = OTPGenErrorCode::Valid;
+
+    if (!check_algo(key.algorithm()))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return false;
+    }
+
+    if (!check_otp_length(digits))
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidDigits;
+        return false;
+    }
+
+    // the length of the token is not a secret
+    if (token.size() != digits)
+    {
+        return false;
+    }
+
+    return verify_window(token, counter, 0U, options.window, OTPGen::maxCounter(), options,
+                         [&](const std::uint64_t &c, TokenBuffer &expected) {
+                             return hotp_helper(key, c, digits, expected, nullptr);
+                         }, offset, error);
+}
+
+// verify a steam token at a given time within the drift window
+bool OTPGen::verifySteam(const std::time_t &time,
+                         const OTPPreparedKey &key,
+                         const OTPToken::TokenString &token,
+                         const VerifyOptions &options,
+                         std::int64_t *offset,
+                         OTPGenErrorCode *error)
+{
+    if (error) (*error) = OTPGenErrorCode::Valid;
+
+    // steam tokens are always SHA1
+    if (key.algorithm() != OTPToken::SHA1)
+    {
+        if (error) (*error) = OTPGenErrorCode::InvalidAlgorithm;
+        return false;
+    }
+
+    // the length of the token is not a secret
+    if (token.size() != 5U || time < 0)
+    {
+        return false;
+    }
+
+    const auto counter = static_cast<std::uint64_t>(time / OTPToken::defaultPeriod(OTPToken::Steam));
+
+    return verify_window(token, counter, options.window, options.window,
+                         std::numeric_limits<std::uint64_t>::max(), options,
+                         [&](const std::uint64_t &c, TokenBuffer &expected) {
+                             unsigned char hmac[OTPPreparedKey::maxDigestSize()];
+                             if (key.computeHmac(c, hmac) == 0)
+                             {
+                                 return false;
+                             }
+                             steam_helper(hmac, expected);
+                             return true;
+                         }, offset, error);
+}
+
+// verify a token for the given token object at a given time
+bool OTPGen::verifyToken(const std::time_t &time,
+                         const OTPToken &otpToken,
+                         const OTPToken::TokenString &token,
+                         const VerifyOptions &options,
+                         std::int64_t *offset,
+                         OTPGenErrorCode *error)
+{
+    auto tokenOptions = options;
+    if (tokenOptions.tokenId == 0)
+    {
+        tokenOptions.tokenId = otpToken.id();
+    }
+
+    switch (otpToken.type())
+    {
+        case OTPToken::TOTP:
+            return verifyTOTP(time, otpToken.preparedKey(), token, otpToken.digitLength(), otpToken.period(), tokenOptions, offset, error);
+        case OTPToken::HOTP:
+            return verifyHOTP(otpToken.preparedKey(), token, otpToken.counter(), otpToken.digitLength(), tokenOptions, offset, error);
+        case OTPToken::Steam:
+            return verifySteam(time, otpToken.preparedKey(), token, tokenOptions, offset, error);
+    }
+
+    if (error) (*error) = OTPGenErrorCode::InvalidType;
+    return false;
+}
+
+// compute the tokens of all given token objects at current time
+std::size_t OTPGen::computeBatch(const OTPToken *tokens, const std::size_t &count,
+                                 OTPToken::TokenString *out,
+                                 OTPGenErrorCode *errors)
+{
+    return computeBatch(time(nullptr), tokens, count, out, errors);
+}
+
+// compute the tokens of all given token objects at a given time
+std::size_t OTPGen::computeBatch(const std::time_t &time,
+                                 const OTPToken *tokens, const std::size_t &count,
+                                 OTPToken::TokenString *out,
+                                 OTPGenErrorCode *errors)
+{
+    std::size_t generated = 0;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto &token = tokens[i];
+        auto err = OTPGenErrorCode::Valid;
+
+        // the key schedule is cached in the token, only the first batch pays for the key setup
+        switch (token.type())
+        {
+            case OTPToken::TOTP:
+                out[i] = computeTOTP(time, token.preparedKey(), token.digitLength(), token.period(), &err);
+                break;
+            case OTPToken::HOTP:
+                out[i] = computeHOTP(token.preparedKey(), token.counter(), token.digitLength(), &err);
+                break;
+            case OTPToken::Steam:
+                out[i] = computeSteam(time, token.preparedKey(), &err);
+                break;
+            default:
+                out[i].clear();
+                err = OTPGenErrorCode::InvalidType;
+                break;
+        }
+
+        if (err != OTPGenErrorCode::Valid)
+        {
+            out[i].clear();
+        }
+        else if (!out[i].empty())
+        {
+            ++generated;
+        }
+
+        if (errors)
+        {
+            errors[i] = err;
+        }
     }
 
-    unsigned long offset = (hmac[SHA1_DIGEST_SIZE-1] & 0x0f);
-    auto bin_code = compute_bin_code(hmac, offset);
+    return generated;
+}
+
+// convenience wrapper for token lists
+std::size_t OTPGen::computeBatch(const std::time_t &time,
+                                 const std::vector<OTPToken> &tokens,
+                                 std::vector<OTPToken::TokenString> &out)
+{
+    out.resize(tokens.size());
+    return computeBatch(time, tokens.data(), tokens.size(), out.data());
+}
 
-    char code[6];
-    for (auto i = 0; i < 5; i++)
+// compute the tokens of a token batch
+std::size_t OTPGen::computeBatch(const std::time_t &time,
+                                 const TokenBatch &batch,
+                                 std::vector<TokenBuffer> &out,
+                                 std::vector<OTPGenErrorCode> *errors)
+{
+    const auto count = batch.size();
+    out.resize(count);
+    if (errors)
     {
-        int mod = bin_code % steam_alphabet.size();
-        bin_code = bin_code / steam_alphabet.size();
-        code[i] = steam_alphabet[mod];
+        errors->resize(count);
+    }
+
+    return computeBatch(time, batch, 0, count, out.data(), errors ? errors->data() : nullptr);
+}
+
+// compute a range of a token batch
+std::size_t OTPGen::computeBatch(const std::time_t &time,
+                                 const TokenBatch &batch,
+                                 const std::size_t &begin, const std::size_t &end,
+                                 TokenBuffer *out,
+                                 OTPGenErrorCode *errors)
+{
+    // walk the parallel arrays, labels and icons are never touched
+    const auto keys = batch.keys().data();
+    const auto types = batch.types().data();
+    const auto digits = batch.digits().data();
+    const auto periods = batch.periods().data();
+    const auto counters = batch.counters().data();
+
+    std::size_t generated = 0;
+
+    const auto last = std::min(end, batch.size());
+    for (auto i = begin; i < last; ++i)
+    {
+        auto err = OTPGenErrorCode::Valid;
+        bool res = false;
+
+        switch (types[i])
+        {
+            case OTPToken::TOTP:
+                res = computeTOTP(time, keys[i], digits[i], periods[i], out[i], &err);
+                break;
+            case OTPToken::HOTP:
+                res = computeHOTP(keys[i], counters[i], digits[i], out[i], &err);
+                break;
+            case OTPToken::Steam:
+                res = computeSteam(time, keys[i], out[i], &err);
+                break;
+            default:
+                err = OTPGenErrorCode::InvalidType;
+                break;
+        }
+
+        if (res)
+        {
+            ++generated;
+        }
+        else
+        {
+            out[i].clear();
+        }
+
+        if (errors)
+        {
+            errors[i] = err;
+        }
     }
-    code[5] = '\0';
 
-    std::string codeStr(code, code + strlen(code));
-    return codeStr;
+    return generated;
 }
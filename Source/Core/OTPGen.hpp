@@ -15,12 +15,18 @@
  */
 
 #include <string>
+#include <vector>
 #include <numeric>
+#include <limits>
 #include <ctime>
 
 #include "OTPToken.hpp"
+#include "OTPPreparedKey.hpp"
 #include "OTPGenErrorCodes.hpp"
 
+class OTPReplayCache;
+class TokenBatch;
+
 class OTPGen
 {
     OTPGen() = delete;
@@ -35,6 +41,32 @@ public:
     inline static OTPToken::CounterType minCounter() { return 0U; }
     inline static OTPToken::CounterType maxCounter() { return std::numeric_limits<OTPToken::CounterType>::max(); }
 
+    // fixed-size, null-terminated token buffer for the allocation-free API
+    // large enough to hold maxDigitLength() digits
+    struct TokenBuffer
+    {
+        char data[11] = {};
+        std::uint8_t size = 0U;
+
+        inline const char *c_str() const { return data; }
+        inline bool empty() const { return size == 0U; }
+        inline void clear() { data[0] = '\0'; size = 0U; }
+    };
+
+    // token verification options
+    struct VerifyOptions
+    {
+        // accepted clock drift in periods before and after the current time (TOTP, Steam),
+        // HOTP only looks ahead of the current counter (RFC 4226 look-ahead window)
+        std::uint32_t window = 1U;
+
+        // optional replay protection, tokens with a counter equal to or older than
+        // the last accepted counter of the given token id are rejected,
+        // id 0 (a token not stored in a database) disables replay tracking
+        OTPReplayCache *replayCache = nullptr;
+        OTPToken::sqliteTokenID tokenId = 0;
+    };
+
     // compute totp at current time
     static const OTPToken::TokenString computeTOTP(const OTPToken::TokenSecret &base32_secret,
                                                    const OTPToken::DigitType &digits,
@@ -50,6 +82,21 @@ public:
                                                    const OTPToken::ShaAlgorithm &sha_algo,
                                                    OTPGenErrorCode *error = nullptr);
 
+    // compute totp at a given time using a prepared key
+    static const OTPToken::TokenString computeTOTP(const std::time_t &time,
+                                                   const OTPPreparedKey &key,
+                                                   const OTPToken::DigitType &digits,
+                                                   const OTPToken::PeriodType &period,
+                                                   OTPGenErrorCode *error = nullptr);
+
+    // compute totp at a given time using a prepared key into a fixed-size buffer, doesn't allocate
+    static bool computeTOTP(const std::time_t &time,
+                            const OTPPreparedKey &key,
+                            const OTPToken::DigitType &digits,
+                            const OTPToken::PeriodType &period,
+                            TokenBuffer &out,
+                            OTPGenErrorCode *error = nullptr);
+
     // compute hotp
     static const OTPToken::TokenString computeHOTP(const OTPToken::TokenSecret &base32_secret,
                                                    const OTPToken::CounterType &counter,
@@ -57,6 +104,19 @@ public:
                                                    const OTPToken::ShaAlgorithm &sha_algo,
                                                    OTPGenErrorCode *error = nullptr);
 
+    // compute hotp using a prepared key
+    static const OTPToken::TokenString computeHOTP(const OTPPreparedKey &key,
+                                                   const OTPToken::CounterType &counter,
+                                                   const OTPToken::DigitType &digits,
+                                                   OTPGenErrorCode *error = nullptr);
+
+    // compute hotp using a prepared key into a fixed-size buffer, doesn't allocate
+    static bool computeHOTP(const OTPPreparedKey &key,
+                            const OTPToken::CounterType &counter,
+                            const OTPToken::DigitType &digits,
+                            TokenBuffer &out,
+                            OTPGenErrorCode *error = nullptr);
+
     // compute steam token at current time
     static const OTPToken::TokenString computeSteam(const OTPToken::TokenSecret &base32_secret,
                                                     OTPGenErrorCode *error = nullptr);
@@ -65,6 +125,92 @@ public:
     static const OTPToken::TokenString computeSteam(const std::time_t &time,
                                                     const OTPToken::TokenSecret &base32_secret,
                                                     OTPGenErrorCode *error = nullptr);
+
+    // compute steam token at a given time using a prepared key (must be SHA1)
+    static const OTPToken::TokenString computeSteam(const std::time_t &time,
+                                                    const OTPPreparedKey &key,
+                                                    OTPGenErrorCode *error = nullptr);
+
+    // compute steam token at a given time using a prepared key into a fixed-size buffer, doesn't allocate
+    static bool computeSteam(const std::time_t &time,
+                             const OTPPreparedKey &key,
+                             TokenBuffer &out,
+                             OTPGenErrorCode *error = nullptr);
+
+    // verify a totp token at a given time within the drift window
+    // on success the matched offset in periods is stored in offset (for resynchronization)
+    // a replayed token is rejected with the OTPGenErrorCode::TokenReplayed error
+    static bool verifyTOTP(const std::time_t &time,
+                           const OTPPreparedKey &key,
+                           const OTPToken::TokenString &token,
+                           const OTPToken::DigitType &digits,
+                           const OTPToken::PeriodType &period,
+                           const VerifyOptions &options,
+                           std::int64_t *offset = nullptr,
+                           OTPGenErrorCode *error = nullptr);
+
+    // verify a hotp token within the look-ahead window of the given counter
+    // on success the matched offset from the counter is stored in offset,
+    // the next expected counter is counter + offset + 1
+    static bool verifyHOTP(const OTPPreparedKey &key,
+                           const OTPToken::TokenString &token,
+                           const OTPToken::CounterType &counter,
+                           const OTPToken::DigitType &digits,
+                           const VerifyOptions &options,
+                           std::int64_t *offset = nullptr,
+                           OTPGenErrorCode *error = nullptr);
+
+    // verify a steam token at a given time within the drift window
+    static bool verifySteam(const std::time_t &time,
+                            const OTPPreparedKey &key,
+                            const OTPToken::TokenString &token,
+                            const VerifyOptions &options,
+                            std::int64_t *offset = nullptr,
+                            OTPGenErrorCode *error = nullptr);
+
+    // verify a token for the given token object at a given time, the replay
+    // cache is keyed by the token id unless options.tokenId is set
+    static bool verifyToken(const std::time_t &time,
+                            const OTPToken &otpToken,
+                            const OTPToken::TokenString &token,
+                            const VerifyOptions &options,
+                            std::int64_t *offset = nullptr,
+                            OTPGenErrorCode *error = nullptr);
+
+    // compute the tokens of all given token objects at current time
+    static std::size_t computeBatch(const OTPToken *tokens, const std::size_t &count,
+                                    OTPToken::TokenString *out,
+                                    OTPGenErrorCode *errors = nullptr);
+
+    // compute the tokens of all given token objects at a given time
+    // writes count tokens into out and, if not null, count error codes into errors
+    // returns the number of successfully generated tokens
+    static std::size_t computeBatch(const std::time_t &time,
+                                    const OTPToken *tokens, const std::size_t &count,
+                                    OTPToken::TokenString *out,
+                                    OTPGenErrorCode *errors = nullptr);
+
+    // convenience wrapper for token lists, out is resized to the size of the list
+    static std::size_t computeBatch(const std::time_t &time,
+                                    const std::vector<OTPToken> &tokens,
+                                    std::vector<OTPToken::TokenString> &out);
+
+    // compute the tokens of all entries of the batch at a given time into fixed-size buffers, doesn't allocate
+    // when out already holds the size of the batch; out and, if not null, errors are resized to the size of the batch
+    // returns the number of successfully generated tokens
+    static std::size_t computeBatch(const std::time_t &time,
+                                    const TokenBatch &batch,
+                                    std::vector<TokenBuffer> &out,
+                                    std::vector<OTPGenErrorCode> *errors = nullptr);
+
+    // compute the entries [begin, end) of the batch into out[begin, end) and, if not null, errors[begin, end),
+    // both must hold the size of the batch, disjoint ranges can be computed concurrently
+    // returns the number of successfully generated tokens
+    static std::size_t computeBatch(const std::time_t &time,
+                                    const TokenBatch &batch,
+                                    const std::size_t &begin, const std::size_t &end,
+                                    TokenBuffer *out,
+                                    OTPGenErrorCode *errors = nullptr);
 };
 
 #endif // OTPGEN_HPP
@@ -8,6 +8,7 @@ enum class OTPGenErrorCode {
     InvalidAlgorithm,
     InvalidDigits,
     InvalidPeriod,
+    TokenReplayed,
 };
 
 #endif // OTPGENERRORCODES_HPP
@@ -0,0 +1,392 @@
+#include "OTPGenPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#if defined(OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+    // smallest number of entries handed out at once, smaller jobs aren't split
+    static const std::size_t MIN_CHUNK_SIZE = 32;
+
+    // chunks per worker, more chunks balance better but cost more atomic operations
+    static const std::size_t CHUNKS_PER_THREAD = 8;
+
+    static bool verifyEntry(const std::time_t &time, const TokenBatch &batch, const OTPGenPool::VerifyRequest &request,
+                            OTPGen::VerifyOptions options, std::int64_t *offset)
+    {
+        const auto i = request.index;
+        if (i >= batch.size())
+        {
+            return false;
+        }
+
+        options.tokenId = batch.ids()[i];
+        const auto &key = batch.keys()[i];
+        switch (batch.types()[i])
+        {
+            case OTPToken::TOTP:
+                return OTPGen::verifyTOTP(time, key, request.token, batch.digits()[i], batch.periods()[i], options, offset);
+            case OTPToken::HOTP:
+                return OTPGen::verifyHOTP(key, request.token, batch.counters()[i], batch.digits()[i], options, offset);
+            case OTPToken::Steam:
+                return OTPGen::verifySteam(time, key, request.token, options, offset);
+        }
+
+        return false;
+    }
+}
+
+class OTPGenPool::Context
+{
+public:
+    // chunks of a worker, [begin, end) packed into one word, so the owner (front)
+    // and thieves (back) claim chunks with a single compare-exchange
+    struct alignas(64) Share
+    {
+        std::atomic<std::uint64_t> chunks{0};
+    };
+
+    struct Job
+    {
+        Task task;
+        Callback callback;
+        std::size_t count = 0;
+        std::size_t chunk_size = 0;
+        std::size_t share_count = 0;
+        std::unique_ptr<Share[]> shares;
+        std::atomic<std::size_t> remaining{0};
+    };
+
+    static bool take(Share &share, std::size_t &chunk)
+    {
+        auto chunks = share.chunks.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            const std::uint64_t begin = chunks >> 32, end = chunks & 0xffffffffU;
+            if (begin >= end)
+            {
+                return false;
+            }
+            if (share.chunks.compare_exchange_weak(chunks, ((begin + 1) << 32) | end, std::memory_order_relaxed))
+            {
+                chunk = static_cast<std::size_t>(begin);
+                return true;
+            }
+        }
+    }
+
+    static bool steal(Share &share, std::size_t &chunk)
+    {
+        auto chunks = share.chunks.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            const std::uint64_t begin = chunks >> 32, end = chunks & 0xffffffffU;
+            if (begin >= end)
+            {
+                return false;
+            }
+            if (share.chunks.compare_exchange_weak(chunks, (begin << 32) | (end - 1), std::memory_order_relaxed))
+            {
+                chunk = static_cast<std::size_t>(end - 1);
+                return true;
+            }
+        }
+    }
+
+    static std::size_t chunkSize(const std::size_t &count, const std::size_t &threads)
+    {
+        const auto chunks = threads * CHUNKS_PER_THREAD;
+        return std::max(MIN_CHUNK_SIZE, (count + chunks - 1) / chunks);
+    }
+
+    static void runChunk(Job &job, const std::size_t &chunk)
+    {
+        const auto begin = chunk * job.chunk_size;
+        job.task(begin, std::min(job.count, begin + job.chunk_size));
+
+        // the results of all chunks happen before the callback
+        if (job.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1 && job.callback)
+        {
+            job.callback();
+        }
+    }
+
+    // returns when every chunk of the job was claimed
+    static void work(Job &job, const std::size_t &worker)
+    {
+        std::size_t chunk = 0;
+        while (take(job.shares[worker], chunk))
+        {
+            runChunk(job, chunk);
+        }
+
+        // nothing is added to a share, a share which was emptied once stays empty
+        for (std::size_t i = 1; i < job.share_count; ++i)
+        {
+            auto &share = job.shares[(worker + i) % job.share_count];
+            while (steal(share, chunk))
+            {
+                runChunk(job, chunk);
+            }
+        }
+    }
+
+    void run(const std::size_t &worker)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        for (;;)
+        {
+            this->wakeup.wait(lock, [&]{ return !this->jobs.empty() || !this->running; });
+
+            // pending jobs are finished before the pool stops
+            if (this->jobs.empty())
+            {
+                return;
+            }
+
+            const auto job = this->jobs.front();
+            lock.unlock();
+            work(*job, worker);
+            lock.lock();
+
+            // every chunk of the job was claimed, the next job can start
+            if (!this->jobs.empty() && this->jobs.front() == job)
+            {
+                this->jobs.pop_front();
+            }
+        }
+    }
+
+    // binds every worker to one of the cores the process may run on
+    bool pin()
+    {
+#if defined(OS_LINUX)
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        {
+            return false;
+        }
+
+        std::vector<int> cores;
+        for (auto cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                cores.emplace_back(cpu);
+            }
+        }
+        if (cores.empty())
+        {
+            return false;
+        }
+
+        bool pinned = true;
+        for (std::size_t i = 0; i < this->workers.size(); ++i)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cores[i % cores.size()], &set);
+            pinned = pthread_setaffinity_np(this->workers[i].native_handle(), sizeof(set), &set) == 0 && pinned;
+        }
+        return pinned;
+#else
+        return false;
+#endif
+    }
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<std::shared_ptr<Job>> jobs;
+    bool running = true;
+
+    std::vector<std::thread> workers;
+    bool pinned = false;
+};
+
+OTPGenPool::OTPGenPool(const std::size_t &threads, const bool &pinned)
+    : _context(std::make_unique<Context>())
+{
+    try {
+        for (std::size_t i = 0; i < std::max<std::size_t>(1U, threads); ++i)
+        {
+            this->_context->workers.emplace_back(&Context::run, this->_context.get(), i);
+        }
+    } catch (std::system_error &) {
+        // continue with the threads which could be created
+    }
+
+    if (pinned && !this->_context->workers.empty())
+    {
+        this->_context->pinned = this->_context->pin();
+    }
+}
+
+OTPGenPool::~OTPGenPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_context->mutex);
+        this->_context->running = false;
+    }
+    this->_context->wakeup.notify_all();
+
+    for (auto&& worker : this->_context->workers)
+    {
+        worker.join();
+    }
+}
+
+std::size_t OTPGenPool::defaultThreads()
+{
+    return std::max(1U, std::thread::hardware_concurrency());
+}
+
+std::size_t OTPGenPool::threads() const
+{
+    return this->_context->workers.size();
+}
+
+bool OTPGenPool::pinned() const
+{
+    return this->_context->pinned;
+}
+
+std::future<void> OTPGenPool::submit(const std::size_t &count, const Task &task)
+{
+    const auto promise = std::make_shared<std::promise<void>>();
+    auto future = promise->get_future();
+    submit(count, task, [promise]{ promise->set_value(); });
+    return future;
+}
+
+void OTPGenPool::submit(const std::size_t &count, const Task &task, const Callback &callback)
+{
+    const auto threads = this->_context->workers.size();
+
+    // without workers the job runs on the calling thread
+    if (count == 0 || threads == 0)
+    {
+        if (count > 0)
+        {
+            task(0, count);
+        }
+        if (callback)
+        {
+            callback();
+        }
+        return;
+    }
+
+    const auto job = std::make_shared<Context::Job>();
+    job->task = task;
+    job->callback = callback;
+    job->count = count;
+    job->chunk_size = Context::chunkSize(count, threads);
+    job->share_count = threads;
+    job->shares.reset(new Context::Share[threads]);
+
+    // every worker gets an equal share of consecutive chunks
+    const std::uint64_t chunks = (count + job->chunk_size - 1) / job->chunk_size;
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        const auto begin = chunks * i / threads, end = chunks * (i + 1) / threads;
+        job->shares[i].chunks.store((begin << 32) | end, std::memory_order_relaxed);
+    }
+    job->remaining.store(static_cast<std::size_t>(chunks), std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(this->_context->mutex);
+        this->_context->jobs.emplace_back(job);
+    }
+    this->_context->wakeup.notify_all();
+}
+
+std::size_t OTPGenPool::computeBatch(const std::time_t &time, const TokenBatch &batch,
+                                     std::vector<OTPGen::TokenBuffer> &out,
+                                     std::vector<OTPGenErrorCode> *errors)
+{
+    // not worth waking up the pool
+    if (batch.size() <= MIN_CHUNK_SIZE)
+    {
+        return OTPGen::computeBatch(time, batch, out, errors);
+    }
+
+    return computeBatchAsync(time, batch, out, errors).get();
+}
+
+std::future<std::size_t> OTPGenPool::computeBatchAsync(const std::time_t &time, const TokenBatch &batch,
+                                                       std::vector<OTPGen::TokenBuffer> &out,
+                                                       std::vector<OTPGenErrorCode> *errors)
+{
+    const auto count = batch.size();
+    out.resize(count);
+    if (errors)
+    {
+        errors->resize(count);
+    }
+
+    const auto out_data = out.data();
+    const auto errors_data = errors ? errors->data() : nullptr;
+    const auto generated = std::make_shared<std::atomic<std::size_t>>(0);
+    const auto promise = std::make_shared<std::promise<std::size_t>>();
+    auto future = promise->get_future();
+
+    submit(count, [=, &batch](const std::size_t &begin, const std::size_t &end) {
+        *generated += OTPGen::computeBatch(time, batch, begin, end, out_data, errors_data);
+    }, [=]{
+        promise->set_value(generated->load());
+    });
+
+    return future;
+}
+
+std::size_t OTPGenPool::verifyBatch(const std::time_t &time, const TokenBatch &batch,
+                                    const std::vector<VerifyRequest> &requests,
+                                    std::vector<std::uint8_t> &valid,
+                                    const OTPGen::VerifyOptions &options,
+                                    std::vector<std::int64_t> *offsets)
+{
+    return verifyBatchAsync(time, batch, requests, valid, options, offsets).get();
+}
+
+std::future<std::size_t> OTPGenPool::verifyBatchAsync(const std::time_t &time, const TokenBatch &batch,
+                                                      const std::vector<VerifyRequest> &requests,
+                                                      std::vector<std::uint8_t> &valid,
+                                                      const OTPGen::VerifyOptions &options,
+                                                      std::vector<std::int64_t> *offsets)
+{
+    valid.assign(requests.size(), 0U);
+    if (offsets)
+    {
+        offsets->assign(requests.size(), 0);
+    }
+
+    const auto valid_data = valid.data();
+    const auto offsets_data = offsets ? offsets->data() : nullptr;
+    const auto verified = std::make_shared<std::atomic<std::size_t>>(0);
+    const auto promise = std::make_shared<std::promise<std::size_t>>();
+    auto future = promise->get_future();
+
+    submit(requests.size(), [=, &batch, &requests](const std::size_t &begin, const std::size_t &end) {
+        std::size_t count = 0;
+        for (auto i = begin; i < end; ++i)
+        {
+            valid_data[i] = verifyEntry(time, batch, requests[i], options, offsets_data ? offsets_data + i : nullptr) ? 1U : 0U;
+            count += valid_data[i];
+        }
+        *verified += count;
+    }, [=]{
+        promise->set_value(verified->load());
+    });
+
+    return future;
+}
@@ -0,0 +1,95 @@
+#ifndef OTPGENPOOL_HPP
+#define OTPGENPOOL_HPP
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <vector>
+#include <cinttypes>
+#include <ctime>
+
+#include "OTPGen.hpp"
+#include "TokenBatch.hpp"
+
+/**
+ * Thread pool which generates and verifies the tokens of large batches.
+ *
+ * A job is split into chunks of consecutive entries, every worker gets an
+ * equal share of the chunks. A worker takes chunks from the front of its own
+ * share and steals from the back of the shares of other workers when its own
+ * share is done, so a slow core doesn't hold up the job. Shares are claimed
+ * with a single atomic operation, no lock is taken while a job runs. Workers
+ * are pinned to the cores the process may run on (Linux only).
+ *
+ * Results are written into caller provided arrays, every entry by exactly one
+ * worker. The HMAC is computed into buffers on the stack of the worker
+ * (OTPPreparedKey::computeHmac()), generation doesn't allocate.
+ *
+ * The batch and the result arrays must stay alive and unmodified until the
+ * job finished. Jobs run in the order they were submitted, all functions
+ * can be called from multiple threads. Tasks and callbacks must not throw.
+ */
+class OTPGenPool final
+{
+public:
+    // computes the entries [begin, end) of a job
+    using Task = std::function<void(const std::size_t &begin, const std::size_t &end)>;
+
+    // called once on the worker which finished the last chunk of a job
+    using Callback = std::function<void()>;
+
+    // token to verify against the entry at index of the batch
+    struct VerifyRequest
+    {
+        std::size_t index = 0U;
+        OTPToken::TokenString token;
+    };
+
+    explicit OTPGenPool(const std::size_t &threads = defaultThreads(), const bool &pinned = true);
+    ~OTPGenPool();
+
+    OTPGenPool(const OTPGenPool &) = delete;
+    OTPGenPool &operator=(const OTPGenPool &) = delete;
+
+    // one thread per core
+    static std::size_t defaultThreads();
+
+    std::size_t threads() const;
+    // true when all workers could be pinned to a core
+    bool pinned() const;
+
+    // runs the task over [0, count) split across the pool
+    std::future<void> submit(const std::size_t &count, const Task &task);
+    void submit(const std::size_t &count, const Task &task, const Callback &callback);
+
+    // computes all entries of the batch, see OTPGen::computeBatch(),
+    // out and errors are resized before the job is submitted
+    std::size_t computeBatch(const std::time_t &time, const TokenBatch &batch,
+                             std::vector<OTPGen::TokenBuffer> &out,
+                             std::vector<OTPGenErrorCode> *errors = nullptr);
+    std::future<std::size_t> computeBatchAsync(const std::time_t &time, const TokenBatch &batch,
+                                               std::vector<OTPGen::TokenBuffer> &out,
+                                               std::vector<OTPGenErrorCode> *errors = nullptr);
+
+    // verifies the tokens against the entries of the batch, valid[i] is 1 when requests[i] is valid
+    // (not std::vector<bool>, workers write concurrently), offsets as in OTPGen::verifyTOTP()
+    // the replay cache of the options is keyed by the ids of the batch, entries without an id aren't tracked,
+    // HOTP counters of the batch are not advanced, use the offsets for that
+    // returns the number of valid tokens
+    std::size_t verifyBatch(const std::time_t &time, const TokenBatch &batch,
+                            const std::vector<VerifyRequest> &requests,
+                            std::vector<std::uint8_t> &valid,
+                            const OTPGen::VerifyOptions &options = {},
+                            std::vector<std::int64_t> *offsets = nullptr);
+    std::future<std::size_t> verifyBatchAsync(const std::time_t &time, const TokenBatch &batch,
+                                              const std::vector<VerifyRequest> &requests,
+                                              std::vector<std::uint8_t> &valid,
+                                              const OTPGen::VerifyOptions &options = {},
+                                              std::vector<std::int64_t> *offsets = nullptr);
+
+private:
+    class Context;
+    std::unique_ptr<Context> _context;
+};
+
+#endif // OTPGENPOOL_HPP
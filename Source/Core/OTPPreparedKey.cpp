@@ -0,0 +1,216 @@
+#include "OTPPreparedKey.hpp"
+
+#include <cstring>
+
+#include <cryptopp/filters.h>
+#include <cryptopp/base32.h>
+#include <cryptopp/base64.h>
+#include <cryptopp/secblock.h>
+#include <cryptopp/sha.h>
+
+namespace {
+    static const std::string normalize_secret(const std::string &secret)
+    {
+        // remove spaces and convert to upper case in a single pass
+        std::string normalized;
+        normalized.reserve(secret.size());
+
+        for (auto&& c : secret)
+        {
+            if (c == '\0')
+            {
+                break;
+            }
+
+            if (c != ' ')
+            {
+                if (c >= 'a' && c <= 'z')
+                {
+                    normalized.push_back(static_cast<char>( (c - 32) ));
+                }
+                else
+                {
+                    normalized.push_back(c);
+                }
+            }
+        }
+
+        return normalized;
+    }
+
+    static const std::string base32_rfc4648_decode(const std::string &key)
+    {
+        if (key.empty())
+        {
+            return {};
+        }
+
+        // create an RFC 4648 base-32 decoder
+        // crypto++ uses DUDE by default which isn't TOTP compatible
+        auto decoder = new CryptoPP::Base32Decoder();
+
+        static int lookup[256];
+        static const CryptoPP::byte ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+        static const auto init = ([&]{ CryptoPP::Base64Decoder::InitializeDecodingLookupArray(lookup, ALPHABET, 32, true); return 0; })(); (void) init;
+        static const CryptoPP::AlgorithmParameters params = CryptoPP::MakeParameters(
+                                                            CryptoPP::Name::DecodingLookupArray(),
+                                                            static_cast<const int*>(lookup));
+        decoder->IsolatedInitialize(params);
+
+        // raw pointers are automatically deleted by crypto++
+        std::string base32;
+        decoder->Attach(new CryptoPP::StringSink(base32));
+
+        // result may be binary (unsigned char)
+        try {
+            CryptoPP::StringSource(key, true, decoder);
+        } catch (...) {
+            return {};
+        }
+
+        return base32;
+    }
+}
+
+// type-erased HMAC key schedule
+class OTPPreparedKey::Context
+{
+public:
+    virtual ~Context() = default;
+    virtual std::size_t digestSize() const = 0;
+    virtual void computeHmac(const unsigned char counter[8], unsigned char *digest) const = 0;
+};
+
+// HMAC (RFC 2104) with the ipad and opad blocks already absorbed into the hash state,
+// copying a crypto++ hash object copies its midstate without any heap allocation
+template<class Hash>
+class OTPPreparedKey::HmacMidstate final : public OTPPreparedKey::Context
+{
+public:
+    HmacMidstate(const unsigned char *key, const std::size_t &size)
+    {
+        CryptoPP::SecByteBlock block(Hash::BLOCKSIZE);
+        std::memset(block.data(), 0, block.size());
+
+        // keys longer than the block size are hashed first
+        if (size > Hash::BLOCKSIZE)
+        {
+            Hash().CalculateDigest(block.data(), key, size);
+        }
+        else
+        {
+            std::memcpy(block.data(), key, size);
+        }
+
+        for (auto&& b : block) b ^= 0x36;
+        inner.Update(block.data(), block.size());
+
+        for (auto&& b : block) b ^= 0x36 ^ 0x5c;
+        outer.Update(block.data(), block.size());
+    }
+
+    std::size_t digestSize() const override
+    {
+        return Hash::DIGESTSIZE;
+    }
+
+    void computeHmac(const unsigned char counter[8], unsigned char *digest) const override
+    {
+        Hash innerHash(inner);
+        innerHash.Update(counter, 8);
+        innerHash.Final(digest);
+
+        Hash outerHash(outer);
+        outerHash.Update(digest, Hash::DIGESTSIZE);
+        outerHash.Final(digest);
+    }
+
+private:
+    Hash inner;
+    Hash outer;
+};
+
+OTPPreparedKey::OTPPreparedKey()
+{
+}
+
+OTPPreparedKey::OTPPreparedKey(const OTPToken::TokenSecret &base32_secret,
+                               const OTPToken::ShaAlgorithm &algorithm)
+{
+    this->_algorithm = algorithm;
+
+    // normalize and decode secret
+    auto secret = decodeSecret(base32_secret);
+
+    // don't continue on empty secret
+    if (secret.empty())
+    {
+        return;
+    }
+
+    prepare(reinterpret_cast<const unsigned char*>(secret.data()), secret.size());
+
+    // wipe the decoded secret, only the hash midstates are kept
+    std::memset(&secret[0], 0, secret.size());
+}
+
+OTPPreparedKey::~OTPPreparedKey()
+{
+}
+
+OTPPreparedKey OTPPreparedKey::fromKey(const unsigned char *key, const std::size_t &size,
+                                       const OTPToken::ShaAlgorithm &algorithm)
+{
+    OTPPreparedKey prepared;
+    prepared._algorithm = algorithm;
+
+    // don't continue on empty key
+    if (size > 0)
+    {
+        prepared.prepare(key, size);
+    }
+    return prepared;
+}
+
+void OTPPreparedKey::prepare(const unsigned char *key, const std::size_t &size)
+{
+    switch (this->_algorithm)
+    {
+        case OTPToken::SHA1:   this->_context = std::make_shared<HmacMidstate<CryptoPP::SHA1>>(key, size); break;
+        case OTPToken::SHA256: this->_context = std::make_shared<HmacMidstate<CryptoPP::SHA256>>(key, size); break;
+        case OTPToken::SHA512: this->_context = std::make_shared<HmacMidstate<CryptoPP::SHA512>>(key, size); break;
+    }
+}
+
+const std::string OTPPreparedKey::decodeSecret(const OTPToken::TokenSecret &base32_secret)
+{
+    return base32_rfc4648_decode(normalize_secret(base32_secret));
+}
+
+std::size_t OTPPreparedKey::digestSize() const
+{
+    if (!this->_context)
+    {
+        return 0U;
+    }
+
+    return this->_context->digestSize();
+}
+
+std::size_t OTPPreparedKey::computeHmac(const std::uint64_t &counter, unsigned char *digest) const
+{
+    if (!this->_context)
+    {
+        return 0U;
+    }
+
+    // big-endian byte order of the counter
+    unsigned char C[8];
+    for (auto i = 0; i < 8; ++i)
+    {
+        C[i] = static_cast<unsigned char>(counter >> (56 - 8 * i));
+    }
+
+    this->_context->computeHmac(C, digest);
+    return this->_context->digestSize();
+}
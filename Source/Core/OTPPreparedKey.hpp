@@ -0,0 +1,75 @@
+#ifndef OTPPREPAREDKEY_HPP
+#define OTPPREPAREDKEY_HPP
+
+#include <memory>
+#include <cinttypes>
+
+#include "OTPToken.hpp"
+
+/**
+ * Decoded token secret with a precomputed HMAC key schedule.
+ *
+ * The base-32 secret is normalized and decoded only once and the inner and
+ * outer pad blocks of the HMAC are absorbed into two hash midstates upfront.
+ * Computing the HMAC of a counter only needs to copy those midstates and hash
+ * the 8 byte counter and the inner digest, no key setup is done anymore.
+ *
+ * Objects are immutable after construction and cheap to copy, the
+ * internal state is shared between all copies.
+ */
+class OTPPreparedKey final
+{
+public:
+    /**
+     * construct an empty (invalid) key
+     */
+    OTPPreparedKey();
+
+    /**
+     * decode the base-32 secret and prepare the HMAC key schedule for
+     * the given algorithm, the key is invalid when the secret can't be
+     * decoded or the algorithm is not supported
+     */
+    OTPPreparedKey(const OTPToken::TokenSecret &base32_secret,
+                   const OTPToken::ShaAlgorithm &algorithm);
+
+    ~OTPPreparedKey();
+
+    // prepare the HMAC key schedule from already decoded key bytes
+    static OTPPreparedKey fromKey(const unsigned char *key, const std::size_t &size,
+                                  const OTPToken::ShaAlgorithm &algorithm);
+
+    // normalize (remove spaces, upper case) and decode a base-32 (RFC 4648) secret
+    // returns the raw key bytes or an empty string on error
+    static const std::string decodeSecret(const OTPToken::TokenSecret &base32_secret);
+
+    // largest digest size of all supported algorithms (SHA512)
+    static constexpr std::size_t maxDigestSize() { return 64U; }
+
+    inline bool isValid() const
+    { return this->_context != nullptr; }
+
+    inline const OTPToken::ShaAlgorithm &algorithm() const
+    { return this->_algorithm; }
+
+    // digest size of the algorithm, 0 if the key is invalid
+    std::size_t digestSize() const;
+
+    /**
+     * computes the HMAC of the big-endian encoded counter into the given
+     * buffer, which must hold at least maxDigestSize() bytes
+     * returns the digest size or 0 if the key is invalid
+     */
+    std::size_t computeHmac(const std::uint64_t &counter, unsigned char *digest) const;
+
+private:
+    void prepare(const unsigned char *key, const std::size_t &size);
+
+    class Context;
+    template<class Hash> class HmacMidstate;
+
+    OTPToken::ShaAlgorithm _algorithm = OTPToken::Invalid;
+    std::shared_ptr<const Context> _context;
+};
+
+#endif // OTPPREPAREDKEY_HPP
@@ -0,0 +1,80 @@
+#include "OTPReplayCache.hpp"
+
+OTPReplayCache::OTPReplayCache(const std::size_t &capacity)
+    : _capacity(capacity == 0U ? 1U : capacity)
+{
+}
+
+OTPReplayCache::~OTPReplayCache()
+{
+}
+
+bool OTPReplayCache::lastAccepted(const Key &id, std::uint64_t &counter) const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    const auto it = this->_index.find(id);
+    if (it == this->_index.end())
+    {
+        return false;
+    }
+
+    counter = it->second->second;
+    return true;
+}
+
+bool OTPReplayCache::accept(const Key &id, const std::uint64_t &counter)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    const auto it = this->_index.find(id);
+    if (it != this->_index.end())
+    {
+        // reject replays of the same or older counters
+        if (it->second->second >= counter)
+        {
+            return false;
+        }
+
+        it->second->second = counter;
+        this->_entries.splice(this->_entries.begin(), this->_entries, it->second);
+        return true;
+    }
+
+    // evict the least recently used entry
+    if (this->_entries.size() >= this->_capacity)
+    {
+        this->_index.erase(this->_entries.back().first);
+        this->_entries.pop_back();
+    }
+
+    this->_entries.emplace_front(id, counter);
+    this->_index.emplace(id, this->_entries.begin());
+    return true;
+}
+
+void OTPReplayCache::remove(const Key &id)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    const auto it = this->_index.find(id);
+    if (it != this->_index.end())
+    {
+        this->_entries.erase(it->second);
+        this->_index.erase(it);
+    }
+}
+
+void OTPReplayCache::clear()
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    this->_entries.clear();
+    this->_index.clear();
+}
+
+std::size_t OTPReplayCache::size() const
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    return this->_entries.size();
+}
@@ -0,0 +1,57 @@
+#ifndef OTPREPLAYCACHE_HPP
+#define OTPREPLAYCACHE_HPP
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <cinttypes>
+
+#include "OTPToken.hpp"
+
+/**
+ * Bounded cache of the last accepted counter per token.
+ *
+ * Used by the OTPGen verification functions to reject tokens which were
+ * already accepted once (RFC 6238 section 5.2). When the cache is full the
+ * least recently used entry is evicted, so the capacity should be at least
+ * the number of tokens which are verified concurrently.
+ *
+ * All functions are thread-safe.
+ */
+class OTPReplayCache final
+{
+public:
+    using Key = OTPToken::sqliteTokenID;
+
+    OTPReplayCache(const std::size_t &capacity = 1024U);
+    ~OTPReplayCache();
+
+    // get the last accepted counter of the given token, returns false if there is none
+    bool lastAccepted(const Key &id, std::uint64_t &counter) const;
+
+    // remember the counter as accepted, returns false if the same
+    // or a newer counter was already accepted for this token
+    bool accept(const Key &id, const std::uint64_t &counter);
+
+    // forget the given token or all tokens
+    void remove(const Key &id);
+    void clear();
+
+    std::size_t size() const;
+    inline const std::size_t &capacity() const
+    { return this->_capacity; }
+
+private:
+    using Entry = std::pair<Key, std::uint64_t>;
+    using EntryList = std::list<Entry>;
+
+    std::size_t _capacity;
+
+    // most recently used entries are at the front
+    EntryList _entries;
+    std::unordered_map<Key, EntryList::iterator> _index;
+
+    mutable std::mutex _mutex;
+};
+
+#endif // OTPREPLAYCACHE_HPP
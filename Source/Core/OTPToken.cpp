@@ -1,5 +1,6 @@
 #include "OTPToken.hpp"
 #include "OTPGen.hpp"
+#include "OTPPreparedKey.hpp"
 
 #include "TokenDatabase.hpp"
 
@@ -24,18 +25,18 @@ OTPToken::OTPToken(const TokenType &type)
 }
 
 OTPToken::OTPToken(const TokenType &type,
-                   const Label &label,
-                   const Icon &icon,
-                   const TokenSecret &secret,
+                   Label label,
+                   Icon icon,
+                   TokenSecret secret,
                    const DigitType &digits,
                    const PeriodType &period,
                    const CounterType &counter,
                    const ShaAlgorithm &algorithm)
 {
     this->_type = type;
-    this->_label = label;
-    this->_icon = icon;
-    this->_secret = secret;
+    this->_label = std::move(label);
+    this->_icon = std::move(icon);
+    this->_secret = std::move(secret);
     this->_digits = digits;
     this->_period = period;
     this->_counter = counter;
@@ -43,21 +44,21 @@ OTPToken::OTPToken(const TokenType &type,
 }
 
 OTPToken::OTPToken(const TokenType &type,
-                   const Label &label,
-                   const Icon &icon,
-                   const TokenSecret &secret)
+                   Label label,
+                   Icon icon,
+                   TokenSecret secret)
     : OTPToken(type)
 {
-    this->_label = label;
-    this->_icon = icon;
-    this->_secret = secret;
+    this->_label = std::move(label);
+    this->_icon = std::move(icon);
+    this->_secret = std::move(secret);
 }
 
 OTPToken::OTPToken(const TokenType &type,
-                   const Label &label)
+                   Label label)
     : OTPToken(type)
 {
-    this->_label = label;
+    this->_label = std::move(label);
 }
 
 OTPToken::OTPToken(const OTPToken &other)
@@ -73,8 +74,31 @@ OTPToken::OTPToken(const OTPToken &other)
     this->_algorithm = other._algorithm;
 
     this->_id = other._id;
+
+    // the other token may prepare its key on another thread right now
+    this->_preparedKey = std::atomic_load(&other._preparedKey);
 }
 
+OTPToken::OTPToken(OTPToken &&other) noexcept = default;
+
+OTPToken &OTPToken::operator= (const OTPToken &other)
+{
+    this->_type = other._type;
+    this->_label = other._label;
+    this->_icon = other._icon;
+    this->_secret = other._secret;
+    this->_digits = other._digits;
+    this->_period = other._period;
+    this->_counter = other._counter;
+    this->_algorithm = other._algorithm;
+
+    this->_id = other._id;
+
+    this->_preparedKey = std::atomic_load(&other._preparedKey);
+    return *this;
+}
+OTPToken &OTPToken::operator= (OTPToken &&other) noexcept = default;
+
 OTPToken::~OTPToken()
 {
     this->_type = None;
@@ -87,6 +111,8 @@ OTPToken::~OTPToken()
     this->_algorithm = Invalid;
 
     this->_id = 0U;
+
+    this->_preparedKey.reset();
 }
 
 bool OTPToken::importBase64Secret(const std::string &base64_str)
@@ -97,6 +123,8 @@ bool OTPToken::importBase64Secret(const std::string &base64_str)
         return false;
     }
 
+    _preparedKey.reset();
+
     try {
 
         // create an RFC 4648 base-32 encoder
@@ -174,6 +202,8 @@ void OTPToken::setAlgorithm(const std::string &algorithm_name)
     {
         _algorithm = Invalid;
     }
+
+    _preparedKey.reset();
 }
 
 const std::string OTPToken::algorithmName() const
@@ -354,15 +384,15 @@ const OTPToken::TokenString OTPToken::generateToken(OTPGenErrorCode *error) cons
     // generate token based on type
     if (_type == TOTP)
     {
-        token = OTPGen::computeTOTP(_secret, _digits, _period, _algorithm, &err);
+        token = OTPGen::computeTOTP(std::time(nullptr), preparedKey(), _digits, _period, &err);
     }
     else if (_type == HOTP)
     {
-        token = OTPGen::computeHOTP(_secret, _counter, _digits, _algorithm, &err);
+        token = OTPGen::computeHOTP(preparedKey(), _counter, _digits, &err);
     }
     else if (_type == Steam)
     {
-        token = OTPGen::computeSteam(_secret, &err);
+        token = OTPGen::computeSteam(std::time(nullptr), preparedKey(), &err);
     }
     else
     {
@@ -388,30 +418,39 @@ const OTPToken::TokenString OTPToken::generateToken(OTPGenErrorCode *error) cons
     return TokenString();
 }
 
-std::uint64_t OTPToken::remainingTokenValidity() const
+const OTPPreparedKey &OTPToken::preparedKey() const
 {
-    if (_period == 0U)
+    // const functions can be called from many threads, the first prepared key is kept
+    // and never replaced, so the returned reference stays valid for all of them
+    auto key = std::atomic_load(&_preparedKey);
+    if (!key)
     {
-        return 0U;
+        // Steam tokens are always SHA1, regardless of the stored algorithm
+        auto prepared = std::make_shared<const OTPPreparedKey>(_secret, _type == Steam ? static_cast<ShaAlgorithm>(SHA1) : _algorithm);
+        if (std::atomic_compare_exchange_strong(&_preparedKey, &key, prepared))
+        {
+            key = std::move(prepared);
+        }
     }
 
-    // get remaining seconds since last minute
-    auto now = std::time(nullptr);
-    auto local = std::localtime(&now);
+    return *key;
+}
 
-    // calculate token validity with 1 second update threshold
-    auto sec_expired = local->tm_sec;
-    auto token_validity = ( static_cast<int>(_period) - sec_expired );
-    if (token_validity < 0)
-    {
-        token_validity = ( static_cast<int>(_period) - (sec_expired % static_cast<int>(_period)) ) + 1;
-    }
-    else
+std::uint64_t OTPToken::remainingTokenValidity() const
+{
+    return remainingTokenValidity(std::time(nullptr), this->_period);
+}
+
+std::uint64_t OTPToken::remainingTokenValidity(const std::time_t &time, const PeriodType &period)
+{
+    if (period == 0U)
     {
-        token_validity++;
+        return 0U;
     }
 
-    return static_cast<std::uint64_t>(token_validity);
+    // periods are aligned to the unix epoch, the token changes when the period ends
+    const auto length = static_cast<std::time_t>(period);
+    return static_cast<std::uint64_t>(length - (time % length));
 }
 
 bool OTPToken::validateSecret(const TokenSecret &secret, OTPGenErrorCode *error)
@@ -4,9 +4,13 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <memory>
+#include <utility>
 #include <cinttypes>
+#include <ctime>
 
 enum class OTPGenErrorCode;
+class OTPPreparedKey;
 
 class OTPToken
 {
@@ -61,9 +65,9 @@ public:
      * construct a (valid) token with all the required parameters
      */
     OTPToken(const TokenType &type,
-             const Label &label,
-             const Icon &icon,
-             const TokenSecret &secret,
+             Label label,
+             Icon icon,
+             TokenSecret secret,
              const DigitType &digits,
              const PeriodType &period,
              const CounterType &counter,
@@ -74,21 +78,32 @@ public:
      * values depending on the given type
      */
     OTPToken(const TokenType &type,
-             const Label &label,
-             const Icon &icon,
-             const TokenSecret &secret);
+             Label label,
+             Icon icon,
+             TokenSecret secret);
 
     /**
      * construct an invalid token of the given type and a label
      */
     OTPToken(const TokenType &type,
-             const Label &label);
+             Label label);
 
     /**
      * copy constructor
      */
     OTPToken(const OTPToken &other);
 
+    /**
+     * move constructor, lets containers of tokens grow without copying
+     */
+    OTPToken(OTPToken &&other) noexcept;
+
+    /**
+     * copy and move assignment
+     */
+    OTPToken &operator= (const OTPToken &other);
+    OTPToken &operator= (OTPToken &&other) noexcept;
+
     /**
      * destroy token object
      */
@@ -107,21 +122,21 @@ public:
 
     // Type
     inline void setType(const TokenType &type)
-    { this->_type = type; }
+    { this->_type = type; this->_preparedKey.reset(); }
     inline const TokenType &type() const
     { return this->_type; }
     const std::string typeName() const;
 
     // Label
-    inline void setLabel(const Label &label)
-    { this->_label = label; }
+    inline void setLabel(Label label)
+    { this->_label = std::move(label); }
     inline const Label &label() const
     { return this->_label; }
 
     // Icon
     // images are stored as std::strings for easier management
-    inline void setIcon(const Icon &icon)
-    { this->_icon = icon; }
+    inline void setIcon(Icon icon)
+    { this->_icon = std::move(icon); }
     inline void setIcon(const unsigned char *icon, const std::size_t &size)
     { this->_icon = Icon(icon, icon + size); }
     inline const Icon &icon() const
@@ -132,8 +147,8 @@ public:
     { return this->_icon.size(); }
 
     // Secret
-    inline void setSecret(const TokenSecret &secret)
-    { this->_secret = secret; }
+    inline void setSecret(TokenSecret secret)
+    { this->_secret = std::move(secret); this->_preparedKey.reset(); }
     inline const TokenSecret &secret() const
     { return this->_secret; }
 
@@ -161,7 +176,7 @@ public:
 
     // Algorithm
     inline void setAlgorithm(const ShaAlgorithm &algorithm)
-    { this->_algorithm = algorithm; }
+    { this->_algorithm = algorithm; this->_preparedKey.reset(); }
     inline const ShaAlgorithm &algorithm() const
     { return this->_algorithm; }
     void setAlgorithm(const std::string &algorithm_name);
@@ -224,11 +239,22 @@ public:
      */
     const TokenString generateToken(OTPGenErrorCode *error = nullptr) const;
 
+    /**
+     * decoded secret and HMAC key schedule of this token, prepared on first use and
+     * cached until the type, secret or algorithm changes
+     */
+    const OTPPreparedKey &preparedKey() const;
+
     /**
      * calculates the remaining token validity from the current system time
      */
     std::uint64_t remainingTokenValidity() const;
 
+    /**
+     * calculates the remaining token validity at a given time, between 1 and period seconds
+     */
+    static std::uint64_t remainingTokenValidity(const std::time_t &time, const PeriodType &period);
+
     /**
      * equality check
      */
@@ -254,7 +280,7 @@ public:
     { return this->_id != 0; }
 
 private:
-    friend class TokenDatabase;
+    friend class TokenVault;
 
     TokenType _type = 0U;
     Label _label;
@@ -267,6 +293,10 @@ private:
 
     sqliteTokenID _id = 0U;
 
+    // cached key schedule for generateToken(), shared between copies,
+    // only accessed with the std::atomic_* functions by const functions
+    mutable std::shared_ptr<const OTPPreparedKey> _preparedKey;
+
     static bool validateSecret(const TokenSecret &secret, OTPGenErrorCode *error);
 };
 
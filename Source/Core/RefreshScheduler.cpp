@@ -0,0 +1,242 @@
+#include "RefreshScheduler.hpp"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef OS_LINUX
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#endif
+
+class RefreshScheduler::Context
+{
+public:
+    Context()
+    {
+#ifdef OS_LINUX
+        this->timer = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+        this->event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+#endif
+    }
+
+    ~Context()
+    {
+#ifdef OS_LINUX
+        if (this->timer != -1) close(this->timer);
+        if (this->event != -1) close(this->event);
+#endif
+    }
+
+    bool valid() const
+    {
+#ifdef OS_LINUX
+        return this->timer != -1 && this->event != -1;
+#else
+        return true;
+#endif
+    }
+
+    // interrupt wait()
+    void wake()
+    {
+#ifdef OS_LINUX
+        const std::uint64_t value = 1;
+        (void) write(this->event, &value, sizeof(value));
+#else
+        {
+            std::lock_guard<std::mutex> lock(this->wait_mutex);
+            this->woken = true;
+        }
+        this->wakeup.notify_all();
+#endif
+    }
+
+    // sleep until the given time (0 = until woken)
+    void wait(const std::time_t &until)
+    {
+#ifdef OS_LINUX
+        // absolute realtime timer, a change of the system clock cancels it
+        itimerspec spec{};
+        spec.it_value.tv_sec = until;
+        (void) timerfd_settime(this->timer, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, nullptr);
+
+        pollfd fds[2] = {
+            {this->timer, POLLIN, 0},
+            {this->event, POLLIN, 0},
+        };
+        if (poll(fds, 2, -1) > 0)
+        {
+            std::uint64_t value = 0;
+            if (fds[0].revents) (void) read(this->timer, &value, sizeof(value));
+            if (fds[1].revents) (void) read(this->event, &value, sizeof(value));
+        }
+#else
+        std::unique_lock<std::mutex> lock(this->wait_mutex);
+        if (until == 0)
+        {
+            this->wakeup.wait(lock, [&]{ return this->woken; });
+        }
+        else
+        {
+            this->wakeup.wait_until(lock, std::chrono::system_clock::from_time_t(until), [&]{ return this->woken; });
+        }
+        this->woken = false;
+#endif
+    }
+
+    // computes the tokens of the group which are valid at the given time
+    static void generate(Group &group, const std::time_t &time)
+    {
+        OTPGen::computeBatch(time, group.batch, group.tokens);
+        group.expires = nextBoundary(time, group.period);
+    }
+
+    void run()
+    {
+        while (this->running)
+        {
+            std::time_t next = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                const auto now = std::time(nullptr);
+
+                // only the groups whose period ended are generated again
+                for (auto&& group : this->groups)
+                {
+                    if (this->regenerate || group.expires <= now)
+                    {
+                        generate(group, now);
+                        this->callback(group);
+                    }
+
+                    if (next == 0 || group.expires < next)
+                    {
+                        next = group.expires;
+                    }
+                }
+                this->regenerate = false;
+            }
+
+            if (!this->running)
+            {
+                break;
+            }
+
+            wait(next);
+        }
+    }
+
+    std::mutex mutex;
+    std::vector<Group> groups;
+    bool regenerate = true;
+    Callback callback;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+
+#ifdef OS_LINUX
+    int timer = -1;
+    int event = -1;
+#else
+    std::mutex wait_mutex;
+    std::condition_variable wakeup;
+    bool woken = false;
+#endif
+};
+
+RefreshScheduler::RefreshScheduler()
+    : _context(std::make_unique<Context>())
+{
+}
+
+RefreshScheduler::~RefreshScheduler()
+{
+    stop();
+}
+
+void RefreshScheduler::setBatch(const TokenBatch &batch)
+{
+    // group the time based tokens by period
+    std::map<OTPToken::PeriodType, Group> groups;
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+        const auto type = batch.types()[i];
+        const auto period = batch.periods()[i];
+        if ((type != OTPToken::TOTP && type != OTPToken::Steam) || period == 0U)
+        {
+            continue;
+        }
+
+        auto &group = groups[period];
+        group.period = period;
+        group.entries.emplace_back(i);
+        group.batch.append(batch, i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_context->mutex);
+        this->_context->groups.clear();
+        this->_context->groups.reserve(groups.size());
+        for (auto&& group : groups)
+        {
+            this->_context->groups.emplace_back(std::move(group.second));
+        }
+        this->_context->regenerate = true;
+    }
+
+    this->_context->wake();
+}
+
+bool RefreshScheduler::start(const Callback &callback)
+{
+    if (this->_context->running || !callback || !this->_context->valid())
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->_context->mutex);
+        this->_context->callback = callback;
+        this->_context->regenerate = true;
+    }
+
+    this->_context->running = true;
+    this->_context->thread = std::thread(&Context::run, this->_context.get());
+    return true;
+}
+
+void RefreshScheduler::stop()
+{
+    if (!this->_context->running)
+    {
+        return;
+    }
+
+    this->_context->running = false;
+    this->_context->wake();
+    this->_context->thread.join();
+}
+
+bool RefreshScheduler::running() const
+{
+    return this->_context->running;
+}
+
+std::time_t RefreshScheduler::nextBoundary(const std::time_t &time, const OTPToken::PeriodType &period)
+{
+    if (period == 0U)
+    {
+        return 0;
+    }
+
+    const auto length = static_cast<std::time_t>(period);
+    return time - (time % length) + length;
+}
@@ -0,0 +1,64 @@
+#ifndef REFRESHSCHEDULER_HPP
+#define REFRESHSCHEDULER_HPP
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <ctime>
+
+#include "OTPGen.hpp"
+#include "TokenBatch.hpp"
+
+/**
+ * Regenerates time based tokens (TOTP, Steam) when their period ends.
+ *
+ * The tokens of a batch are grouped by their period. A single thread sleeps
+ * until the next epoch-aligned boundary of any group (timerfd on Linux) and
+ * then regenerates only the groups whose period ended, so there is one
+ * wakeup per group and period instead of polling every token.
+ *
+ * The callback runs on the scheduler thread while the groups are locked,
+ * it must not call setBatch() or stop().
+ */
+class RefreshScheduler final
+{
+public:
+    // tokens of the same period, entries are indices into the batch given to setBatch()
+    struct Group
+    {
+        OTPToken::PeriodType period = 0U;
+        std::vector<std::size_t> entries;
+        TokenBatch batch;
+
+        // current tokens (parallel to entries) and the time they expire
+        std::vector<OTPGen::TokenBuffer> tokens;
+        std::time_t expires = 0;
+    };
+
+    using Callback = std::function<void(const Group &group)>;
+
+    RefreshScheduler();
+    ~RefreshScheduler();
+
+    RefreshScheduler(const RefreshScheduler &) = delete;
+    RefreshScheduler &operator=(const RefreshScheduler &) = delete;
+
+    // replace the scheduled tokens, HOTP tokens are not scheduled,
+    // all groups are generated and reported again
+    void setBatch(const TokenBatch &batch);
+
+    // start the scheduler thread, the callback receives every group once
+    // after start and after every setBatch(), and then every time its period ends
+    bool start(const Callback &callback);
+    void stop();
+    bool running() const;
+
+    // epoch-aligned end of the period which contains time
+    static std::time_t nextBoundary(const std::time_t &time, const OTPToken::PeriodType &period);
+
+private:
+    class Context;
+    std::unique_ptr<Context> _context;
+};
+
+#endif // REFRESHSCHEDULER_HPP
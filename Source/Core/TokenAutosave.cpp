@@ -0,0 +1,153 @@
+#include "TokenAutosave.hpp"
+#include "TokenVault.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class TokenAutosave::Context
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Context(TokenVault &vault, const std::chrono::milliseconds &delay)
+        : vault(vault), delay(delay)
+    {
+    }
+
+    // saves the vault, waits for a save which is already running,
+    // the lock is released during the save
+    void save(std::unique_lock<std::mutex> &lock)
+    {
+        this->saved.wait(lock, [&]{ return !this->saving; });
+        if (!this->dirty)
+        {
+            return;
+        }
+
+        this->dirty = false;
+        this->saving = true;
+        lock.unlock();
+        const auto status = this->vault.saveTokens();
+        lock.lock();
+        this->saving = false;
+        this->last_error = status;
+        ++this->saves;
+
+        // retry after the next quiet period
+        if (status != TokenDatabase::Success && !this->dirty)
+        {
+            this->dirty = true;
+            this->changed = Clock::now();
+        }
+        this->saved.notify_all();
+        this->wakeup.notify_all();
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        while (this->running)
+        {
+            if (!this->dirty || this->saving)
+            {
+                this->wakeup.wait(lock);
+                continue;
+            }
+
+            // markDirty() restarts the quiet period
+            const auto deadline = this->changed + this->delay;
+            if (Clock::now() < deadline)
+            {
+                this->wakeup.wait_until(lock, deadline);
+                continue;
+            }
+
+            save(lock);
+        }
+    }
+
+    TokenVault &vault;
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable saved;
+
+    std::chrono::milliseconds delay;
+    Clock::time_point changed;
+    bool dirty = false;
+    bool saving = false;
+    Error last_error = TokenDatabase::Success;
+    std::size_t saves = 0;
+
+    bool running = true;
+    std::thread thread;
+};
+
+TokenAutosave::TokenAutosave(TokenVault &vault, const std::chrono::milliseconds &delay)
+    : _context(std::make_unique<Context>(vault, delay))
+{
+    this->_context->thread = std::thread(&Context::run, this->_context.get());
+}
+
+TokenAutosave::~TokenAutosave()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_context->mutex);
+        this->_context->running = false;
+    }
+    this->_context->wakeup.notify_all();
+    this->_context->thread.join();
+
+    (void) flush();
+}
+
+void TokenAutosave::setDelay(const std::chrono::milliseconds &delay)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_context->mutex);
+        this->_context->delay = delay;
+    }
+    this->_context->wakeup.notify_all();
+}
+
+std::chrono::milliseconds TokenAutosave::delay() const
+{
+    std::lock_guard<std::mutex> lock(this->_context->mutex);
+    return this->_context->delay;
+}
+
+void TokenAutosave::markDirty()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_context->mutex);
+        this->_context->dirty = true;
+        this->_context->changed = Context::Clock::now();
+    }
+    this->_context->wakeup.notify_all();
+}
+
+bool TokenAutosave::dirty() const
+{
+    std::lock_guard<std::mutex> lock(this->_context->mutex);
+    return this->_context->dirty;
+}
+
+TokenAutosave::Error TokenAutosave::flush()
+{
+    std::unique_lock<std::mutex> lock(this->_context->mutex);
+    this->_context->save(lock);
+    return this->_context->last_error;
+}
+
+TokenAutosave::Error TokenAutosave::lastError() const
+{
+    std::lock_guard<std::mutex> lock(this->_context->mutex);
+    return this->_context->last_error;
+}
+
+std::size_t TokenAutosave::saveCount() const
+{
+    std::lock_guard<std::mutex> lock(this->_context->mutex);
+    return this->_context->saves;
+}
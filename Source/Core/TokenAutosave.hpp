@@ -0,0 +1,57 @@
+#ifndef TOKENAUTOSAVE_HPP
+#define TOKENAUTOSAVE_HPP
+
+#include <chrono>
+#include <memory>
+
+#include "TokenDatabase.hpp"
+
+class TokenVault;
+
+/**
+ * Saves a vault on a background thread after it was modified.
+ *
+ * Call markDirty() after every modification instead of saveTokens().
+ * The save starts once the vault wasn't marked dirty for the quiet period,
+ * so a burst of edits is saved only once. Queries of the vault keep running
+ * during the save (see TokenVault::saveTokens()). A failed save is retried
+ * after the next quiet period.
+ *
+ * flush() saves pending modifications right away on the calling thread,
+ * call it before the vault is closed or the application exits.
+ * The destructor flushes as well.
+ */
+class TokenAutosave final
+{
+public:
+    using Error = TokenDatabase::Error;
+
+    explicit TokenAutosave(TokenVault &vault, const std::chrono::milliseconds &delay = defaultDelay());
+    ~TokenAutosave();
+
+    TokenAutosave(const TokenAutosave &) = delete;
+    TokenAutosave &operator=(const TokenAutosave &) = delete;
+
+    // quiet period after the last modification
+    void setDelay(const std::chrono::milliseconds &delay);
+    std::chrono::milliseconds delay() const;
+    static constexpr std::chrono::milliseconds defaultDelay() { return std::chrono::milliseconds(500); }
+
+    // schedule a save, restarts the quiet period
+    void markDirty();
+    bool dirty() const;
+
+    // save pending modifications now, waits for a running save,
+    // returns the result of the last save (Success when nothing was saved yet)
+    Error flush();
+    Error lastError() const;
+
+    // number of saves, including failed ones
+    std::size_t saveCount() const;
+
+private:
+    class Context;
+    std::unique_ptr<Context> _context;
+};
+
+#endif // TOKENAUTOSAVE_HPP
@@ -0,0 +1,87 @@
+#include "TokenBatch.hpp"
+#include "TokenDatabase.hpp"
+#include "TokenVault.hpp"
+
+TokenBatch::TokenBatch()
+{
+}
+
+TokenBatch::TokenBatch(const std::vector<OTPToken> &tokens)
+{
+    assign(tokens);
+}
+
+TokenBatch::~TokenBatch()
+{
+}
+
+void TokenBatch::assign(const std::vector<OTPToken> &tokens)
+{
+    clear();
+
+    const auto count = tokens.size();
+    this->_ids.reserve(count);
+    this->_keys.reserve(count);
+    this->_types.reserve(count);
+    this->_digits.reserve(count);
+    this->_periods.reserve(count);
+    this->_counters.reserve(count);
+
+    for (auto&& token : tokens)
+    {
+        this->_ids.emplace_back(token.id());
+        this->_keys.emplace_back(token.preparedKey());
+        this->_types.emplace_back(token.type());
+        this->_digits.emplace_back(token.digitLength());
+        this->_periods.emplace_back(token.period());
+        this->_counters.emplace_back(token.counter());
+    }
+}
+
+void TokenBatch::clear()
+{
+    this->_ids.clear();
+    this->_keys.clear();
+    this->_types.clear();
+    this->_digits.clear();
+    this->_periods.clear();
+    this->_counters.clear();
+
+    this->_vault = nullptr;
+    this->_revision = 0;
+}
+
+void TokenBatch::append(const TokenBatch &batch, const std::size_t &index)
+{
+    this->_ids.emplace_back(batch._ids.at(index));
+    this->_keys.emplace_back(batch._keys.at(index));
+    this->_types.emplace_back(batch._types.at(index));
+    this->_digits.emplace_back(batch._digits.at(index));
+    this->_periods.emplace_back(batch._periods.at(index));
+    this->_counters.emplace_back(batch._counters.at(index));
+}
+
+void TokenBatch::setCounter(const std::size_t &index, const OTPToken::CounterType &counter)
+{
+    this->_counters.at(index) = counter;
+}
+
+bool TokenBatch::refresh(const TokenVault &vault)
+{
+    // read the revision first, a change during the select causes another rebuild
+    const auto revision = vault.revision();
+    if (this->_vault == &vault && this->_revision == revision)
+    {
+        return false;
+    }
+
+    assign(vault.selectTokens(OTPToken::None, TokenDatabase::WithoutIcons));
+    this->_vault = &vault;
+    this->_revision = revision;
+    return true;
+}
+
+bool TokenBatch::refresh()
+{
+    return refresh(TokenDatabase::defaultVault());
+}
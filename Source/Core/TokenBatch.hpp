@@ -0,0 +1,79 @@
+#ifndef TOKENBATCH_HPP
+#define TOKENBATCH_HPP
+
+#include <vector>
+#include <cinttypes>
+
+#include "OTPToken.hpp"
+#include "OTPPreparedKey.hpp"
+
+class TokenVault;
+
+/**
+ * Generation data of many tokens in parallel arrays.
+ *
+ * Only what is needed to compute the tokens is kept: the prepared key
+ * (decoded secret and HMAC key schedule), the type, digits, period and
+ * counter. Labels and icons are not loaded. Index i of every array
+ * describes the same token, tokens are in display order.
+ *
+ * Use OTPGen::computeBatch() to compute the tokens of all entries.
+ *
+ * The batch is rebuilt by refresh() only when the tokens of the vault
+ * changed since the last refresh (TokenVault::revision()).
+ */
+class TokenBatch final
+{
+public:
+    TokenBatch();
+    explicit TokenBatch(const std::vector<OTPToken> &tokens);
+    ~TokenBatch();
+
+    // replace the contents with the given tokens, the batch is no longer bound to a vault
+    void assign(const std::vector<OTPToken> &tokens);
+    void clear();
+
+    // append the entry at index of another batch
+    void append(const TokenBatch &batch, const std::size_t &index);
+
+    // update the counter of the entry at index after the vault stored it
+    void setCounter(const std::size_t &index, const OTPToken::CounterType &counter);
+
+    // rebuild the batch from the vault or the default vault (TokenDatabase)
+    // returns true when the batch was rebuilt, false when it is up-to-date
+    bool refresh(const TokenVault &vault);
+    bool refresh();
+
+    inline std::size_t size() const
+    { return this->_ids.size(); }
+    inline bool empty() const
+    { return this->_ids.empty(); }
+
+    // parallel arrays
+    inline const std::vector<OTPToken::sqliteTokenID> &ids() const
+    { return this->_ids; }
+    inline const std::vector<OTPPreparedKey> &keys() const
+    { return this->_keys; }
+    inline const std::vector<OTPToken::TokenType> &types() const
+    { return this->_types; }
+    inline const std::vector<OTPToken::DigitType> &digits() const
+    { return this->_digits; }
+    inline const std::vector<OTPToken::PeriodType> &periods() const
+    { return this->_periods; }
+    inline const std::vector<OTPToken::CounterType> &counters() const
+    { return this->_counters; }
+
+private:
+    std::vector<OTPToken::sqliteTokenID> _ids;
+    std::vector<OTPPreparedKey> _keys;
+    std::vector<OTPToken::TokenType> _types;
+    std::vector<OTPToken::DigitType> _digits;
+    std::vector<OTPToken::PeriodType> _periods;
+    std::vector<OTPToken::CounterType> _counters;
+
+    // vault and revision the batch was built from
+    const TokenVault *_vault = nullptr;
+    std::uint64_t _revision = 0;
+};
+
+#endif // TOKENBATCH_HPP
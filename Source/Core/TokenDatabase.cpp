@@ -1,1386 +1,268 @@
 #include "TokenDatabase.hpp"
+#include "TokenVault.hpp"
+#include "TokenAutosave.hpp"
 
 #include <fstream>
-#include <ostream>
-#include <sstream>
-#include <memory>
-
-#include <sqlite/sqlite3.h>
-#include <sqlite_modern_cpp.h>
+#include <algorithm>
 
 #include <cryptopp/cryptlib.h>
-#include <cryptopp/algparam.h>
 #include <cryptopp/aes.h>
 #include <cryptopp/sha.h>
-#include <cryptopp/base64.h>
 #include <cryptopp/hkdf.h>
 #include <cryptopp/modes.h>
 #include <cryptopp/filters.h>
 
-#include <cereal/types/vector.hpp>
-#include <cereal/types/memory.hpp>
-#include <cereal/archives/portable_binary.hpp>
-
-namespace {
-    // database version, used for possible migrations
-    static const std::uint32_t DATABASE_VERSION = 0x0f000005;
-
-    // SQLite3 connection handle
-    static std::shared_ptr<sqlite::database> db;
-    static bool db_status;
-    static std::string db_data;
-}
-
-template<typename T, class L = std::vector<T>>
-static bool contains(const L &list, const T &value)
-{
-    return std::find(list.begin(), list.end(), value) != list.end();
-}
-
-template<typename T, class L = std::vector<T>>
-static auto positionOf(const L &list, const T &value)
-{
-    return std::distance(list.begin(), std::find(list.begin(), list.end(), value));
-}
-
-template<typename POSITION = std::size_t, typename LENGTH = std::size_t, typename LIST = TokenDatabase::DisplayOrder>
-static void moveRange(POSITION start, LENGTH length, POSITION dst, LIST &list)
-{
-    const auto final_dst = dst > start ? dst - length : dst;
-
-    LIST tmp(list.begin() + start, list.begin() + start + length);
-    list.erase(list.begin() + start, list.begin() + start + length);
-    list.insert(list.begin() + final_dst, tmp.begin(), tmp.end());
-}
-
-std::string TokenDatabase::databasePassword;
-std::string TokenDatabase::databasePath;
-
 const std::string TokenDatabase::getErrorMessage(const Error &error)
 {
-    switch (error)
-    {
-        case Success: return {};
-
-        case FileReadFailure:     return "Unable to read file.";
-        case FileWriteFailure:    return "Unable to write file.";
-        case FileEmpty:           return "File is empty.";
-        case InvalidTokenFile:    return "Not a valid token database.";
-
-        case EncryptionFailure:   return "Failed to encrypt data.";
-        case DecryptionFailure:   return "Failed to decrypt data.";
-        case InvalidCiphertext:   return "Failed to decrypt data. Either the password is incorrect or the file is corrupt.";
-        case PasswordEmpty:       return "Password is empty.";
-        case PasswordHashFailure: return "Failed to hash password.";
-
-        case SqlDatabaseNotOpen:           return "Database is not connected.";
-        case SqlMemoryAllocationError:     return "Failed to allocate memory for database.";
-        case SqlSerializationError:        return "Failed to serialize the database for encryption.";
-        case SqlDeserializationError:      return "Failed to deserialize the database after decrypting it.";
-        case SqlSystemTableCreationError:  return "Failed to create system tables.";
-        case SqlStaticRecordCreationError: return "Failed to create system records.";
-        case SqlStatementPrepareFailed:    return "Failed to prepare SQL statement.";
-        case SqlBindBinaryDataFailed:      return "Faled to bind binary data to SQL statement.";
-        case SqlExecutionFailed:           return "Failed to execute SQL statement.";
-        case SqlConstraintViolation:       return "A SQL constraint violation happened.";
-        case SqlDisplayOrderStoreFailed:   return "Failed to store the display order.";
-        case SqlDisplayOrderUpdateFailed:  return "Failed to update the display order.";
-        case SqlDisplayOrderGetFailed:     return "Failed to receive the display order.";
-        case SqlDisplayOrderIncomplete:    return "The display order list is incomplete.";
-        case SqlEmptyResults:              return "SQL statement returned nothing.";
-        case SqlSchemaValidationFailed:    return "Database schema is invalid / was user-modified.";
-
-        case UnknownFailure: return "An unknown error occurred!";
-    }
-
-    return {};
-}
-
-bool TokenDatabase::databaseConnected()
-{
-    return db_status;
-}
-
-TokenDatabase::Error TokenDatabase::initDatabase()
-{
-    if (db_status)
-    {
-        closeDatabase();
-    }
-
-    // create in-memory database
-    try {
-        db = std::make_shared<sqlite::database>(":memory:");
-        db_status = true;
-    } catch (sqlite::sqlite_exception &) {
-        db_status = false;
-        return SqlMemoryAllocationError;
-    }
-
-    return Success;
-}
-
-void TokenDatabase::closeDatabase()
-{
-    if (db_status)
-    {
-        // force close database
-        (void) sqlite3_close_v2(db->connection().get());
-        db = nullptr;
-        db_status = false;
-        db_data.clear();
-    }
-}
-
-bool TokenDatabase::setPassword(const std::string &password)
-{
-    if (password.empty())
-        return false;
-
-    // remove old password
-    TokenDatabase::databasePassword.clear();
-
-    // don't use smart pointers here, already managed/deleted by crypto++ itself
-    CryptoPP::SHA256 hash;
-    CryptoPP::StringSource src(password, true,
-        new CryptoPP::HashFilter(hash,
-            new CryptoPP::Base64Encoder(
-                new CryptoPP::StringSink(TokenDatabase::databasePassword))));
-
-    return true;
-}
-
-bool TokenDatabase::setTokenDatabase(const std::string &file)
-{
-    if (file.empty())
-    {
-        return false;
-    }
-
-    databasePath = file;
-    return true;
-}
-
-TokenDatabase::Error TokenDatabase::changePassword(const std::string &newPassword)
-{
-    Error status = Success;
-
-    if (newPassword.empty())
-    {
-        return PasswordEmpty;
-    }
-
-    auto pwdStatus = setPassword(newPassword);
-    if (!pwdStatus)
-    {
-        return PasswordHashFailure;
-    }
-
-    status = saveTokens();
-    return status;
-}
-
-namespace {
-    // sanitize SQL query and return it as a managed std::string, C pointer from sqlite3_mprintf() is deleted
-    template<class... Args>
-    static inline const std::string sanitizeQuery(const std::string &_template, Args&&... args)
-    {
-        auto statement = sqlite3_mprintf(_template.c_str(), std::forward<Args>(args)...);
-        std::string query(statement);
-        sqlite3_free(statement);
-        return query;
-    }
-}
-
-TokenDatabase::Error TokenDatabase::executeGenericTokenStatement(const std::string &statement, const OTPToken &token)
-{
-    // BLOB == std::vector<T> in this C++ SQL library
-    // requires exactly 8 '?' placeholders
-    try {
-        (*db) << statement
-              << token.type()
-              << token.label()
-              << token.icon() // already a std::vector<>
-              << mangleTokenSecret(token.secret())
-              << std::vector<OTPToken::DigitType>{token.digitLength()}
-              << std::vector<OTPToken::PeriodType>{token.period()}
-              << std::vector<OTPToken::CounterType>{token.counter()}
-              << token.algorithm();
-    } catch (sqlite::sqlite_exception &e) {
-        if (e.get_code() == SQLITE_CONSTRAINT)
-        {
-            return SqlConstraintViolation;
-        }
-        else
-        {
-            return SqlExecutionFailed;
-        }
-    }
-
-    return Success;
-}
-
-const OTPToken TokenDatabase::selectToken(const OTPToken::sqliteTokenID &id)
-{
-    if (!db_status)
-    {
-        return {};
-    }
-
-    const auto statement = sanitizeQuery("select * from %Q where id = %u limit 1;", "tokens", id);
-
-    OTPToken token;
-
-    // BLOB == std::vector<T> in this C++ SQL library
-    std::vector<OTPToken::DigitType> digits;
-    std::vector<OTPToken::PeriodType> period;
-    std::vector<OTPToken::CounterType> counter;
-
-    try {
-        (*db) << statement
-              >> [&](const OTPToken::sqliteLongID &id,
-                     const OTPToken::TokenType &type,
-                     const OTPToken::Label &label,
-                     const OTPToken::Icon &icon,
-                     const OTPToken::TokenSecret &secret,
-                     const std::vector<OTPToken::DigitType> &digits,
-                     const std::vector<OTPToken::PeriodType> &period,
-                     const std::vector<OTPToken::CounterType> &counter,
-                     const OTPToken::ShaAlgorithm &algorithm)
-        {
-            token._id = id;
-            token.setType(type);
-            token.setLabel(label);
-            token.setIcon(icon);
-            token.setSecret(unmangleTokenSecret(secret));
-            token.setDigitLength(digits.empty() ? 0U : digits.at(0));
-            token.setPeriod(period.empty() ? 0U : period.at(0));
-            token.setCounter(counter.empty() ? 0U : counter.at(0));
-            token.setAlgorithm(algorithm);
-        };
-    } catch (sqlite::sqlite_exception &) {
-        return {};
-    }
-
-    return token;
-}
-
-const OTPToken TokenDatabase::selectToken(const OTPToken::Label &label)
-{
-    if (!db_status)
-    {
-        return {};
-    }
-
-    // get token which matches the label absolute
-    auto results = selectTokens(escapeStringLIKE(label));
-
-    if (results.empty())
-    {
-        return {};
-    }
-
-    return results.at(0);
-}
-
-const TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::sqliteTypesID &type)
-{
-    if (!db_status)
-    {
-        return {};
-    }
-
-    // prepare query
-    auto statement = sanitizeQuery("select id from %Q ", "tokens");
-    std::string order_by_query;
-    auto ret = displayOrderQuery(order_by_query);
-
-    if (type != OTPToken::None)
-    {
-        statement += sanitizeQuery("where type = %u ", type);
-    }
-
-    if (ret)
-    {
-        statement += order_by_query;
-    }
-    else
-    {
-        statement += "order by id asc;";
-    }
-
-    std::vector<OTPToken::sqliteLongID> ids;
-
-    // fetch all ids
-    try {
-        (*db) << statement
-              >> [&](const OTPToken::sqliteLongID &id)
-        {
-            ids.emplace_back(id);
-        };
-    } catch (sqlite::sqlite_exception &) {
-        return {};
-    }
-
-    // fetch all tokens
-    OTPTokenList tokens;
-
-    for (auto&& id : ids)
-    {
-        tokens.emplace_back(selectToken(id));
-    }
-
-    return tokens;
-}
-
-const TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::Label &label_like)
-{
-    if (!db_status)
-    {
-        return {};
-    }
-
-    // prepare query
-    auto statement = sanitizeQuery("select * from %Q where label like %Q escape '\\' ", "tokens", label_like.c_str());
-    std::string order_by_query;
-    auto ret = displayOrderQuery(order_by_query);
-
-    if (ret)
-    {
-        statement += order_by_query;
-    }
-    else
-    {
-        statement += "order by id asc;";
-    }
-
-    OTPTokenList tokens;
-
-    // BLOB == std::vector<T> in this C++ SQL library
-    std::vector<OTPToken::DigitType> digits;
-    std::vector<OTPToken::PeriodType> period;
-    std::vector<OTPToken::CounterType> counter;
-
-    try {
-        (*db) << statement
-              >> [&](const OTPToken::sqliteLongID &id,
-                     const OTPToken::TokenType &type,
-                     const OTPToken::Label &label,
-                     const OTPToken::Icon &icon,
-                     const OTPToken::TokenSecret &secret,
-                     const std::vector<OTPToken::DigitType> &digits,
-                     const std::vector<OTPToken::PeriodType> &period,
-                     const std::vector<OTPToken::CounterType> &counter,
-                     const OTPToken::ShaAlgorithm &algorithm)
-        {
-            OTPToken token;
-            token._id = id;
-            token.setType(type);
-            token.setLabel(label);
-            token.setIcon(icon);
-            token.setSecret(unmangleTokenSecret(secret));
-            token.setDigitLength(digits.empty() ? 0U : digits.at(0));
-            token.setPeriod(period.empty() ? 0U : period.at(0));
-            token.setCounter(counter.empty() ? 0U : counter.at(0));
-            token.setAlgorithm(algorithm);
-            tokens.emplace_back(token);
-        };
-    } catch (sqlite::sqlite_exception &) {
-        return {};
-    }
-
-    return tokens;
-}
-
-TokenDatabase::Error TokenDatabase::insertToken(const OTPToken &token)
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // prepare insert query
-    const auto statement = genInsertQuery("tokens",
-        {"type", "label", "icon", "secret", "digits", "period", "counter", "algorithm"});
-
-    auto status = executeGenericTokenStatement(statement, token);
-    if (status != Success)
-    {
-        return status;
-    }
-
-    // append last insert id to display order
-    DisplayOrder order;
-    status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-    order.emplace_back(db->last_insert_rowid());
-    status = updateDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-
-    return Success;
-}
-
-TokenDatabase::Error TokenDatabase::updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token)
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // prepare update query
-    const auto statement = genUpdateQuery("tokens",
-        {"type", "label", "icon", "secret", "digits", "period", "counter", "algorithm"},
-        sanitizeQuery("id = %u", id));
-
-    return executeGenericTokenStatement(statement, token);
-}
-
-TokenDatabase::Error TokenDatabase::renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label)
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    auto token = selectToken(id);
-    if (token.id() == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    token.setLabel(label);
-
-    return updateToken(id, token);
-}
-
-TokenDatabase::Error TokenDatabase::deleteToken(const OTPToken::sqliteTokenID &id)
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    const auto statement = sanitizeQuery("delete from %Q where id = %u;", "tokens", id);
-
-    try {
-        (*db) << statement;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlExecutionFailed;
-    }
-
-    // update display order, remove deleted id
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-    std::remove_if(order.begin(), order.end(), [&](const OTPToken::sqliteSortOrder &lid) {
-        return lid == id;
-    });
-    status = updateDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-
-    return Success;
-}
-
-OTPToken::sqliteTokenID TokenDatabase::tokenCount(const OTPToken::sqliteTypesID &type)
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    std::string statement;
-
-    if (type == OTPToken::None)
-    {
-        statement = sanitizeQuery("select count(*) from %Q;", "tokens");
-    }
-    else
-    {
-        statement = sanitizeQuery("select count(*) from %Q where type = %u;", "tokens", type);
-    }
-
-    OTPToken::sqliteTokenID count = 0;
-
-    try {
-        (*db) << statement >> count;
-    } catch (sqlite::sqlite_exception &) {
-        return -1;
-    }
-
-    return count;
-}
-
-TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken &token1, const OTPToken &token2)
-{
-    return swapTokens(token1.label(), token2.label());
-}
-
-TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken::Label &label1, const OTPToken::Label &label2)
-{
-    auto tokenId1 = selectToken(label1).id();
-    if (tokenId1 == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    auto tokenId2 = selectToken(label2).id();
-    if (tokenId2 == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-
-    if (!contains(order, tokenId1) || !contains(order, tokenId2))
-    {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
-    }
-
-    unsigned long pos1 = static_cast<unsigned long>(positionOf(order, tokenId1));
-    unsigned long pos2 = static_cast<unsigned long>(positionOf(order, tokenId2));
-
-    std::swap(order[pos1], order[pos2]);
-
-    return updateDisplayOrder(order);
-}
-
-TokenDatabase::Error TokenDatabase::moveToken(const OTPToken &token, const std::size_t &newPos)
-{
-    return moveToken(token.label(), newPos);
-}
-
-TokenDatabase::Error TokenDatabase::moveToken(const OTPToken::Label &token, const std::size_t &newPos)
-{
-    auto tokenId = selectToken(token).id();
-    if (tokenId == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-
-    if (!contains(order, tokenId))
-    {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
-    }
-
-    long oldPos = static_cast<long>(positionOf(order, tokenId));
-
-    // rebuild list, splits up the list and puts it back again in a different order
-    moveRange(static_cast<std::size_t>(std::distance(order.begin(), order.begin() + oldPos)), 1, newPos, order);
-
-    return updateDisplayOrder(order);
-}
-
-TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken &token, const OTPToken &below)
-{
-    return moveTokenBelow(token.label(), below.label());
-}
-
-TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken::Label &token, const OTPToken::Label &below)
-{
-    auto tokenId1 = selectToken(token).id();
-    if (tokenId1 == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    auto tokenId2 = selectToken(below).id();
-    if (tokenId2 == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-
-    if (!contains(order, tokenId1) || !contains(order, tokenId2))
-    {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
-    }
-
-    long pos1 = static_cast<long>(positionOf(order, tokenId1));
-    long pos2 = static_cast<long>(positionOf(order, tokenId2));
-
-    // rebuild list, splits up the list and puts it back again in a different order
-    moveRange(std::distance(order.begin(), order.begin() + pos1), 1, std::distance(order.begin(), order.begin() + pos2) + 1, order);
-
-    return updateDisplayOrder(order);
-}
-
-TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken &token, const OTPToken &above)
-{
-    return moveTokenAbove(token.label(), above.label());
-}
-
-TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken::Label &token, const OTPToken::Label &above)
-{
-    auto tokenId1 = selectToken(token).id();
-    if (tokenId1 == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    auto tokenId2 = selectToken(above).id();
-    if (tokenId2 == 0)
-    {
-        return SqlEmptyResults;
-    }
-
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return status;
-    }
-
-    if (!contains(order, tokenId1) || !contains(order, tokenId2))
-    {
-        // TODO: implement resetDisplayOrder() function to restore all ids
-        return SqlDisplayOrderIncomplete;
-    }
-
-    long pos1 = static_cast<long>(positionOf(order, tokenId1));
-    long pos2 = static_cast<long>(positionOf(order, tokenId2));
-
-    // rebuild list, splits up the list and puts it back again in a different order
-    moveRange(std::distance(order.begin(), order.begin() + pos1), 1, std::distance(order.begin(), order.begin() + pos2), order);
-
-    return updateDisplayOrder(order);
-}
-
-const std::string TokenDatabase::selectTokenTypeName(const OTPToken::sqliteTypesID &id)
-{
-    return selectStaticValue("types", id);
-}
-
-const std::string TokenDatabase::selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id)
-{
-    return selectStaticValue("algorithms", id);
-}
-
-TokenDatabase::Error TokenDatabase::bootstrapDatabase()
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // create tables to store types and algorithms
-    for (auto&& table : {"types", "algorithms"})
-    {
-        auto res = createTable(table, {
-            {"id",   "int(1) PRIMARY KEY NOT NULL"},
-            {"name", "text UNIQUE"},
-        });
-        if (res != Success)
-        {
-            return res;
-        }
-    }
-
-    // insert static types
-    auto res = insertStaticValues("types", {
-        {OTPToken::TOTP,  "TOTP"},
-        {OTPToken::HOTP,  "HOTP"},
-        {OTPToken::Steam, "Steam"},
-    });
-    if (res != Success)
-    {
-        return res;
-    }
-
-    // insert static algorithms
-    res = insertStaticValues("algorithms", {
-        {OTPToken::SHA1,   "SHA1"},
-        {OTPToken::SHA256, "SHA256"},
-        {OTPToken::SHA512, "SHA512"},
-    });
-    if (res != Success)
-    {
-        return res;
-    }
-
-    // create config table
-    res = createTable("config", {
-        {"id",   "text PRIMARY KEY NOT NULL"},
-        {"data", "blob"},
-    });
-    if (res != Success)
-    {
-        return res;
-    }
-
-    // store database version into config
-    res = storeDatabaseVersion();
-    if (res != Success)
-    {
-        return res;
-    }
-
-    // create record to store the sort order (display order)
-    res = storeDisplayOrder({});
-    if (res != Success)
-    {
-        return res;
-    }
-
-    // create table to store the tokens
-    res = createTable("tokens", {
-        {"id",        "INTEGER PRIMARY KEY NOT NULL"},
-        {"type",      "int(1) NOT NULL"},
-        {"label",     "text NOT NULL UNIQUE COLLATE NOCASE"},
-        {"icon",      "blob"},
-        {"secret",    "text NOT NULL"},
-        {"digits",    "blob"},
-        {"period",    "blob"},
-        {"counter",   "blob"},
-        {"algorithm", "int(1) NOT NULL"},
-    },
-        "FOREIGN KEY(type) REFERENCES types(id), "
-        "FOREIGN KEY(algorithm) REFERENCES algorithms(id)");
-    if (res != Success)
-    {
-        return res;
-    }
-
-    return Success;
-}
-
-TokenDatabase::Error TokenDatabase::createTable(const std::string &table_name, const std::vector<SchemaField> &schema, const std::string &additional)
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // sanitize table name
-    auto query = sanitizeQuery("create table %Q ", table_name.c_str());
-
-    // prepare schema
-    query += "(";
-    for (auto&& s : schema)
-    {
-        query += sanitizeQuery("%Q %s, ", s.name.c_str(), s.datatype.c_str());
-    }
-    query.erase(query.find_last_of(','));
-
-    // add additional content to query
-    if (!additional.empty())
-    {
-        query += ", " + additional;
-    }
-
-    // finalize query
-    query += ");";
-
-    // execute query
-    try {
-        (*db) << query;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlSystemTableCreationError;
-    }
-
-    return Success;
-}
-
-TokenDatabase::Error TokenDatabase::insertStaticValues(const std::string &table_name, const std::vector<StaticValueSet> &values)
-{
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // sanitize table name
-    auto query = sanitizeQuery("insert into %Q ", table_name.c_str());
-
-    // prepare values
-    query += "values ";
-    for (auto&& v : values)
-    {
-        query += sanitizeQuery("(%u, %Q), ", v.id, v.value.c_str());
-    }
-    query.erase(query.find_last_of(','));
-
-    // finalize query
-    query += ";";
-
-    // execute query
-    try {
-        (*db) << query;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlStaticRecordCreationError;
-    }
-
-    return Success;
-}
-
-const std::string TokenDatabase::selectStaticValue(const std::string &table, const OTPToken::sqliteShortID &id)
-{
-    if (!db_status)
+    switch (error)
     {
-        return {};
-    }
+        case Success: return {};
 
-    const auto statement = sanitizeQuery("select name from %Q where id = %i limit 1;", table.c_str(), id);
+        case FileReadFailure:     return "Unable to read file.";
+        case FileWriteFailure:    return "Unable to write file.";
+        case FileEmpty:           return "File is empty.";
+        case InvalidTokenFile:    return "Not a valid token database.";
 
-    std::string name;
+        case EncryptionFailure:   return "Failed to encrypt data.";
+        case DecryptionFailure:   return "Failed to decrypt data.";
+        case InvalidCiphertext:   return "Failed to decrypt data. Either the password is incorrect or the file is corrupt.";
+        case PasswordEmpty:       return "Password is empty.";
+        case PasswordHashFailure: return "Failed to hash password.";
 
-    try {
-        (*db) << statement >> name;
-    } catch (sqlite::sqlite_exception &) {
+        case SqlDatabaseNotOpen:           return "Database is not connected.";
+        case SqlMemoryAllocationError:     return "Failed to allocate memory for database.";
+        case SqlSerializationError:        return "Failed to serialize the database for encryption.";
+        case SqlDeserializationError:      return "Failed to deserialize the database after decrypting it.";
+        case SqlSystemTableCreationError:  return "Failed to create system tables.";
+        case SqlStaticRecordCreationError: return "Failed to create system records.";
+        case SqlStatementPrepareFailed:    return "Failed to prepare SQL statement.";
+        case SqlBindBinaryDataFailed:      return "Faled to bind binary data to SQL statement.";
+        case SqlExecutionFailed:           return "Failed to execute SQL statement.";
+        case SqlConstraintViolation:       return "A SQL constraint violation happened.";
+        case SqlDisplayOrderStoreFailed:   return "Failed to store the display order.";
+        case SqlDisplayOrderUpdateFailed:  return "Failed to update the display order.";
+        case SqlDisplayOrderGetFailed:     return "Failed to receive the display order.";
+        case SqlDisplayOrderIncomplete:    return "The display order list is incomplete.";
+        case SqlEmptyResults:              return "SQL statement returned nothing.";
+        case SqlSchemaValidationFailed:    return "Database schema is invalid / was user-modified.";
+
+        case UnknownFailure: return "An unknown error occurred!";
     }
 
-    return name;
+    return {};
 }
 
-const std::string TokenDatabase::genUpdateQuery(const std::string &table, const std::vector<std::string> &fields, const std::string &condition)
+TokenVault &TokenDatabase::defaultVault()
 {
-    auto query = sanitizeQuery("update %Q set ", table.c_str());
-
-    for (auto&& f : fields)
-    {
-        query += sanitizeQuery("%s=?, ", f.c_str());
-    }
-    query.erase(query.find_last_of(','));
-
-    if (!condition.empty())
-    {
-        query += " where " + condition;
-    }
-
-    query += ";";
-
-    return query;
+    static TokenVault vault;
+    return vault;
 }
 
-const std::string TokenDatabase::genInsertQuery(const std::string &table, const std::vector<std::string> &fields)
+TokenAutosave &TokenDatabase::defaultAutosave()
 {
-    auto query = sanitizeQuery("insert into %Q (", table.c_str());
-
-    for (auto&& f : fields)
-    {
-        query += sanitizeQuery("%s, ", f.c_str());
-    }
-    query.erase(query.find_last_of(','));
-
-    query += ") values (";
-
-    for (auto i = 0U; i < fields.size(); ++i)
-    {
-        query += "?, ";
-    }
-    query.erase(query.find_last_of(','));
-
-    query += ");";
-
-    return query;
+    // destroyed before the vault, pending changes are saved on exit
+    static TokenAutosave autosave(defaultVault());
+    return autosave;
 }
 
-const std::string TokenDatabase::escapeStringLIKE(const std::string &input)
+bool TokenDatabase::databaseConnected()
 {
-    // escape string to match absolute in a SQL LIKE expression
-    // ... LIKE "input" ESCAPE '\';
-    std::string str = input;
-    for (auto i = 0U; i < str.size(); ++i)
-    {
-        if (str.at(i) == '%')
-        {
-            str.replace(i, 1, "\\%");
-            ++i;
-        }
-        else if (str.at(i) == '_')
-        {
-            str.replace(i, 1, "\\_");
-            ++i;
-        }
-        else if (str.at(i) == '\\')
-        {
-            str.replace(i, 1, "\\\\");
-            ++i;
-        }
-    }
-    return str;
+    return defaultVault().databaseConnected();
 }
 
-bool TokenDatabase::displayOrderQuery(std::string &query)
+TokenDatabase::Error TokenDatabase::initDatabase()
 {
-    query = sanitizeQuery("order by case %s ", "id");
-
-    DisplayOrder order;
-    if (getDisplayOrder(order) != Success)
-    {
-        return false;
-    }
-
-    if (order.empty())
-    {
-        return false;
-    }
-
-    auto pos = 0U;
-    for (auto&& id : order)
-    {
-        query += sanitizeQuery("when %u then %u ", id, pos);
-        ++pos;
-    }
-
-    query += "end;";
-    return true;
+    return defaultVault().initDatabase();
 }
 
-TokenDatabase::Error TokenDatabase::storeDatabaseVersion()
+void TokenDatabase::closeDatabase()
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // prepare statement
-    const auto statement = sanitizeQuery("insert into %Q values (?, ?);",
-                                         "config");
-
-    try {
-        (*db) << statement << "database" << std::vector<std::uint32_t>{DATABASE_VERSION};
-    } catch (sqlite::sqlite_exception &) {
-        return SqlExecutionFailed;
-    }
-
-    return Success;
+    defaultVault().closeDatabase();
 }
 
-TokenDatabase::Error TokenDatabase::getDatabaseVersion(std::uint32_t &version)
+TokenDatabase::Error TokenDatabase::initializeTokens()
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // prepare statement
-    const auto statement = sanitizeQuery("select %s from %Q where %s = %Q limit 1;",
-                                         "data", "config", "id", "database");
-
-    std::vector<std::uint32_t> data;
-
-    try {
-        (*db) << statement >> data;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlExecutionFailed;
-    }
-
-    if (data.empty())
-    {
-        // assume user manipulation when this field is empty or
-        // doesn't contain a serialized std::vector<>
-        return SqlSchemaValidationFailed;
-    }
-
-    // the database version is the first element
-    version = data.at(0);
-
-    return Success;
+    return defaultVault().initializeTokens();
 }
 
-TokenDatabase::Error TokenDatabase::storeDisplayOrder(const DisplayOrder &order)
+TokenDatabase::Error TokenDatabase::saveTokens()
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // prepare statement
-    const auto statement = sanitizeQuery("insert into %Q values (?, ?);",
-                                         "config");
-
-    try {
-        (*db) << statement << "order" << order;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlDisplayOrderStoreFailed;
-    }
-
-    return Success;
+    return defaultVault().saveTokens();
 }
 
-TokenDatabase::Error TokenDatabase::updateDisplayOrder(const DisplayOrder &order)
+TokenDatabase::Error TokenDatabase::loadTokens()
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // prepare statement
-    const auto statement = sanitizeQuery("update %Q set %s=? where %s = %Q;",
-                                         "config", "data", "id", "order");
-
-    try {
-        (*db) << statement << order;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlDisplayOrderUpdateFailed;
-    }
-
-    return Success;
+    return defaultVault().loadTokens();
 }
 
-TokenDatabase::Error TokenDatabase::getDisplayOrder(DisplayOrder &order)
+const TokenDatabase::DisplayOrder TokenDatabase::displayOrder()
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
-
-    // prepare statement
-    const auto statement = sanitizeQuery("select %s from %Q where %s = %Q limit 1;",
-                                         "data", "config", "id", "order");
-
-    try {
-        (*db) << statement >> order;
-    } catch (sqlite::sqlite_exception &) {
-        return SqlDisplayOrderGetFailed;
-    }
+    return defaultVault().displayOrder();
+}
 
-    return Success;
+bool TokenDatabase::setPassword(const std::string &password)
+{
+    return defaultVault().setPassword(password);
 }
 
-bool TokenDatabase::serializeDatabase(std::string &out)
+bool TokenDatabase::setTokenDatabase(const std::string &file)
 {
-    // database must be open
-    sqlite3_int64 size = 0;
-    auto data = sqlite3_serialize(db->connection().get(), "main", &size, 0);
+    return defaultVault().setTokenDatabase(file);
+}
 
-    if (!data)
-    {
-        out.clear();
-        return false;
-    }
+void TokenDatabase::setStorageFormat(const StorageFormat &format)
+{
+    defaultVault().setStorageFormat(format);
+}
 
-    out = std::string(reinterpret_cast<const char*>(data), static_cast<std::size_t>(size));
-    sqlite3_free(data);
-    return true;
+TokenDatabase::StorageFormat TokenDatabase::storageFormat()
+{
+    return defaultVault().storageFormat();
 }
 
-bool TokenDatabase::deserializeDatabase(const std::string &data)
+TokenDatabase::Error TokenDatabase::changePassword(const std::string &newPassword)
 {
-    if (data.empty())
-    {
-        return false;
-    }
+    return defaultVault().changePassword(newPassword);
+}
 
-    // copy stream, sqlite uses this
-    // clearing it or changing its content will cause failure later
-    db_data = data;
-
-    // empty database must be open
-    auto rc = sqlite3_deserialize(db->connection().get(), "main",
-                                  const_cast<unsigned char*>(
-                                      reinterpret_cast<const unsigned char*>(db_data.data())
-                                  ),
-                                  static_cast<sqlite3_int64>(db_data.size()),
-                                  static_cast<sqlite3_int64>(db_data.size()),
-                                  0);
-    if (rc)
-    {
-        return false;
-    }
+void TokenDatabase::setJournal(const bool &enabled)
+{
+    defaultVault().setJournal(enabled);
+}
 
-    return true;
+std::size_t TokenDatabase::journalSize()
+{
+    return defaultVault().journalSize();
 }
 
-TokenDatabase::Error TokenDatabase::validateSchema()
+void TokenDatabase::setLabelCache(const bool &enabled)
 {
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
+    defaultVault().setLabelCache(enabled);
+}
 
-    const auto pragma = "pragma table_info(%Q)";
-
-#define SQLITE_PRAGMA_ARGLIST \
-    const sqlite3_int64 &/*cid*/, \
-    const std::string &name, \
-    const std::string &type, \
-    const bool &notnull, \
-    const std::string &dflt_value, \
-    const bool &pk
-
-    const auto verifyStatics = [&](const std::string &table) {
-        const auto statement = sanitizeQuery(pragma, table.c_str());
-
-        bool validId = false, validName = false;
-
-        try {
-            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
-            {
-                if (name == "id")
-                {
-                    validId = (type == "int(1)" && notnull && dflt_value.empty() && pk);
-                }
-                else if (name == "name")
-                {
-                    validName = (type == "text" && !notnull && dflt_value.empty() && !pk);
-                }
-            };
-        } catch (sqlite::sqlite_exception &) {
-            return false;
-        }
+std::uint64_t TokenDatabase::revision()
+{
+    return defaultVault().revision();
+}
 
-        return validId && validName;
-    };
-
-    const auto verifyConfig = [&] {
-        const auto statement = sanitizeQuery(pragma, "config");
-
-        bool validId = false, validData = false;
-
-        try {
-            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
-            {
-                if (name == "id")
-                {
-                    validId = (type == "text" && notnull && dflt_value.empty() && pk);
-                }
-                else if (name == "data")
-                {
-                    validData = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-            };
-        } catch (sqlite::sqlite_exception &) {
-            return false;
-        }
+bool TokenDatabase::changes(const std::uint64_t &since, ChangeList &changes)
+{
+    return defaultVault().changes(since, changes);
+}
 
-        return validId && validData;
-    };
-
-    const auto verifyTokens = [&] {
-        const auto statement = sanitizeQuery(pragma, "tokens");
-
-        bool validId = false,
-             validType = false,
-             validLabel = false,
-             validIcon = false,
-             validSecret = false,
-             validDigits = false,
-             validPeriod = false,
-             validCounter = false,
-             validAlgorithm = false;
-
-        try {
-            (*db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
-            {
-                if (name == "id")
-                {
-                    validId = (type == "INTEGER" && notnull && dflt_value.empty() && pk);
-                }
-                else if (name == "type")
-                {
-                    validType = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "label")
-                {
-                    validLabel = (type == "text" && notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "icon")
-                {
-                    validIcon = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "secret")
-                {
-                    validSecret = (type == "text" && notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "digits")
-                {
-                    validDigits = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "period")
-                {
-                    validPeriod = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "counter")
-                {
-                    validCounter = (type == "blob" && !notnull && dflt_value.empty() && !pk);
-                }
-                else if (name == "algorithm")
-                {
-                    validAlgorithm = (type == "int(1)" && notnull && dflt_value.empty() && !pk);
-                }
-            };
-        } catch (sqlite::sqlite_exception &) {
-            return false;
-        }
+OTPToken TokenDatabase::selectToken(const OTPToken::sqliteTokenID &id)
+{
+    return defaultVault().selectToken(id);
+}
 
-        return validId &&
-               validType &&
-               validLabel &&
-               validIcon &&
-               validSecret &&
-               validDigits &&
-               validPeriod &&
-               validCounter &&
-               validAlgorithm;
-    };
+OTPToken TokenDatabase::selectToken(const OTPToken::Label &label)
+{
+    return defaultVault().selectToken(label);
+}
 
-    auto ret = verifyStatics("types");
-    if (!ret) return SqlSchemaValidationFailed;
+TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::sqliteTypesID &type)
+{
+    return defaultVault().selectTokens(type);
+}
 
-    ret = verifyStatics("algorithms");
-    if (!ret) return SqlSchemaValidationFailed;
+TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::sqliteTypesID &type, const Projection &projection)
+{
+    return defaultVault().selectTokens(type, projection);
+}
 
-    ret = verifyConfig();
-    if (!ret) return SqlSchemaValidationFailed;
+TokenDatabase::OTPTokenList TokenDatabase::selectTokens(const OTPToken::Label &label_like)
+{
+    return defaultVault().selectTokens(label_like);
+}
 
-    ret = verifyTokens();
-    if (!ret) return SqlSchemaValidationFailed;
+TokenDatabase::Error TokenDatabase::insertToken(const OTPToken &token)
+{
+    return defaultVault().insertToken(token);
+}
 
-    return Success;
+const OTPToken::Icon TokenDatabase::selectIcon(const OTPToken::sqliteTokenID &id)
+{
+    return defaultVault().selectIcon(id);
 }
 
-TokenDatabase::Error TokenDatabase::initializeTokens()
+TokenDatabase::Error TokenDatabase::insertTokens(const OTPTokenList &tokens, std::vector<Error> *errors)
 {
-    // allocate a new sqlite database in-memory
-    auto status = initDatabase();
-    if (status != Success)
-    {
-        return status;
-    }
+    return defaultVault().insertTokens(tokens, errors);
+}
 
-    // bootstrap a new database from the built-in schema
-    status = bootstrapDatabase();
-    if (status != Success)
-    {
-        return status;
-    }
+TokenDatabase::Error TokenDatabase::updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token)
+{
+    return defaultVault().updateToken(id, token);
+}
 
-    // write to disk
-    status = saveTokens();
-    if (status != Success)
-    {
-        return status;
-    }
+TokenDatabase::Error TokenDatabase::renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label)
+{
+    return defaultVault().renameToken(id, label);
+}
 
-    return Success;
+TokenDatabase::Error TokenDatabase::setCounter(const OTPToken::sqliteTokenID &id, const OTPToken::CounterType &counter)
+{
+    return defaultVault().setCounter(id, counter);
 }
 
-TokenDatabase::Error TokenDatabase::saveTokens()
+TokenDatabase::Error TokenDatabase::deleteToken(const OTPToken::sqliteTokenID &id)
 {
-    // check if the database is open
-    if (!db_status)
-    {
-        return SqlDatabaseNotOpen;
-    }
+    return defaultVault().deleteToken(id);
+}
 
-    // serialize the sqlite database
-    std::string sqlitedb;
-    auto ret = serializeDatabase(sqlitedb);
-    if (!ret)
-    {
-        return SqlSerializationError;
-    }
+OTPToken::sqliteTokenID TokenDatabase::tokenCount(const OTPToken::sqliteTypesID &type)
+{
+    return defaultVault().tokenCount(type);
+}
 
-    // encrypt the stream
-    std::string encrypted;
-    auto status = encrypt(databasePassword, sqlitedb, encrypted);
-    sqlitedb.clear();
-    if (status != Success)
-    {
-        return status;
-    }
+TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken &token1, const OTPToken &token2)
+{
+    return defaultVault().swapTokens(token1, token2);
+}
 
-    // write the encrypted stream to a file
-    status = writeFile(databasePath, encrypted);
-    encrypted.clear();
-    return status;
+TokenDatabase::Error TokenDatabase::swapTokens(const OTPToken::Label &label1, const OTPToken::Label &label2)
+{
+    return defaultVault().swapTokens(label1, label2);
 }
 
-TokenDatabase::Error TokenDatabase::loadTokens()
+TokenDatabase::Error TokenDatabase::moveToken(const OTPToken &token, const std::size_t &newPos)
 {
-    // read the encrypted file
-    std::string in;
-    auto status = readFile(databasePath, in);
-    if (status != Success)
-    {
-        return status;
-    }
+    return defaultVault().moveToken(token, newPos);
+}
 
-    // decrypt the stream
-    std::string decrypted;
-    status = decrypt(databasePassword, in, decrypted);
-    in.clear();
-    if (status != Success)
-    {
-        return status;
-    }
+TokenDatabase::Error TokenDatabase::moveToken(const OTPToken::Label &token, const std::size_t &newPos)
+{
+    return defaultVault().moveToken(token, newPos);
+}
 
-    // allocate memory for a database, if not yet initialized
-    if (!db_status)
-    {
-        status = initDatabase();
-        if (status != Success)
-        {
-            return status;
-        }
-    }
+TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken &token, const OTPToken &below)
+{
+    return defaultVault().moveTokenBelow(token, below);
+}
 
-    // deserialize the sqlite database
-    auto ret = deserializeDatabase(decrypted);
-    decrypted.clear();
-    if (!ret)
-    {
-        return SqlDeserializationError;
-    }
+TokenDatabase::Error TokenDatabase::moveTokenBelow(const OTPToken::Label &token, const OTPToken::Label &below)
+{
+    return defaultVault().moveTokenBelow(token, below);
+}
 
-    // perform a query in this function to avoid failure later
-    // FIXME: still couldn't figure out why this happens, but
-    // it works after the first execution in the same function
-    std::uint32_t version = 0;
-    (void) getDatabaseVersion(version);
+TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken &token, const OTPToken &above)
+{
+    return defaultVault().moveTokenAbove(token, above);
+}
 
-    // validate the schema of the database
-    status = validateSchema();
-    if (status != Success)
-    {
-        return status;
-    }
+TokenDatabase::Error TokenDatabase::moveTokenAbove(const OTPToken::Label &token, const OTPToken::Label &above)
+{
+    return defaultVault().moveTokenAbove(token, above);
+}
 
-    return Success;
+const std::string TokenDatabase::selectTokenTypeName(const OTPToken::sqliteTypesID &id)
+{
+    return defaultVault().selectTokenTypeName(id);
 }
 
-const TokenDatabase::DisplayOrder TokenDatabase::displayOrder()
+const std::string TokenDatabase::selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id)
 {
-    DisplayOrder order;
-    auto status = getDisplayOrder(order);
-    if (status != Success)
-    {
-        return {};
-    }
-    return order;
+    return defaultVault().selectAlgorithmName(id);
 }
 
 const OTPToken::TokenSecret TokenDatabase::mangleTokenSecret(const OTPToken::TokenSecret &secret)
@@ -1408,21 +290,14 @@ TokenDatabase::Error TokenDatabase::encrypt(const std::string &password,
                        reinterpret_cast<const unsigned char*>(password.data()), password.size(),
                        reinterpret_cast<const unsigned char*>(password.data()), password.size(), nullptr, 0);
 
-        std::string ciphertext;
-
         CryptoPP::AES::Encryption aesEncryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
         CryptoPP::CBC_Mode_ExternalCipher::Encryption cbcEncryption(aesEncryption, reinterpret_cast<const unsigned char*>(password.data()));
 
-        CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, new CryptoPP::StringSink(ciphertext));
+        CryptoPP::StreamTransformationFilter stfEncryptor(cbcEncryption, new CryptoPP::StringSink(out));
         auto input_buffer_size = (size == -1 ? input_buffer.size() : static_cast<std::size_t>(size));
         stfEncryptor.Put(reinterpret_cast<const unsigned char*>(input_buffer.data()), input_buffer_size);
         stfEncryptor.MessageEnd();
 
-        for (auto&& c : ciphertext)
-        {
-            out.push_back(c);
-        }
-
         return Success;
     } catch (CryptoPP::InvalidCiphertext e) {
         // e.what();
@@ -1461,21 +336,14 @@ TokenDatabase::Error TokenDatabase::decrypt(const std::string &password,
                        reinterpret_cast<const unsigned char*>(password.data()), password.size(),
                        reinterpret_cast<const unsigned char*>(password.data()), password.size(), nullptr, 0);
 
-        std::string decryptedtext;
-
         CryptoPP::AES::Decryption aesDecryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
         CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(aesDecryption, reinterpret_cast<const unsigned char*>(password.data()));
 
-        CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, new CryptoPP::StringSink(decryptedtext));
+        CryptoPP::StreamTransformationFilter stfDecryptor(cbcDecryption, new CryptoPP::StringSink(out));
         auto input_buffer_size = (size == -1 ? input_buffer.size() : static_cast<std::size_t>(size));
         stfDecryptor.Put(reinterpret_cast<const unsigned char*>(input_buffer.data()), input_buffer_size);
         stfDecryptor.MessageEnd();
 
-        for (auto&& c : decryptedtext)
-        {
-            out.push_back(c);
-        }
-
         return Success;
     } catch (CryptoPP::InvalidCiphertext e) {
         // e.what();
@@ -8,6 +8,10 @@
 #include <string>
 #include <vector>
 
+class TokenVault;
+class TokenAutosave;
+
+// static interface of the default token vault, see TokenVault.hpp
 class TokenDatabase final
 {
     TokenDatabase() = delete;
@@ -17,8 +21,8 @@ class TokenDatabase final
     friend class AppSupport::Authy;
     friend class AppSupport::Steam;
 
-    static std::string databasePassword;
-    static std::string databasePath;
+    // for mangleTokenSecret()
+    friend class TokenVault;
 
 public:
     enum Error {
@@ -59,9 +63,42 @@ public:
     using OTPTokenList = std::vector<OTPToken>;
     using DisplayOrder = std::vector<OTPToken::sqliteSortOrder>;
 
+    // storage format of the database file
+    enum StorageFormat {
+        Container = 0,  // kept in memory, saveTokens() encrypts and writes the whole database
+        EncryptedPages, // kept on disk, every page is encrypted on its own (EncryptedVFS),
+                        // saveTokens() only writes the pages which were changed
+    };
+
+    // columns returned by selectTokens()
+    enum Projection {
+        WithIcons = 0,
+        WithoutIcons,   // icons are left empty, fetch them with selectIcon() when needed
+    };
+
+    // change of a token, see TokenVault::changes()
+    struct Change {
+        enum Operation : std::uint8_t {
+            Insert = 0,
+            Update,
+            Delete,
+            Reorder,    // the position of the token in the display order changed
+        };
+
+        Operation operation;
+        OTPToken::sqliteTokenID id;
+    };
+    using ChangeList = std::vector<Change>;
+
     // translate error enum to a human readable message describing the error
     static const std::string getErrorMessage(const Error &error);
 
+    // vault used by all functions below, created on first use
+    static TokenVault &defaultVault();
+
+    // background saving of the default vault, created on first use, see TokenAutosave
+    static TokenAutosave &defaultAutosave();
+
     // get database connection status
     static bool databaseConnected();
 
@@ -81,17 +118,44 @@ public:
     static bool setPassword(const std::string &password);
     static bool setTokenDatabase(const std::string &file);
 
+    // format of new databases, files are always loaded in their own format,
+    // container files are converted on the next save when EncryptedPages is set
+    static void setStorageFormat(const StorageFormat &format);
+    static StorageFormat storageFormat();
+
     // change database password
     static Error changePassword(const std::string &newPassword);
 
+    // persist small changes in a journal, see TokenVault::setJournal()
+    static void setJournal(const bool &enabled);
+    static std::size_t journalSize();
+
+    // cache the ids of labels which were looked up, see TokenVault::setLabelCache()
+    static void setLabelCache(const bool &enabled);
+
+    // revision of the tokens, see TokenVault::revision()
+    static std::uint64_t revision();
+
+    // changes of the tokens after a revision, see TokenVault::changes()
+    static bool changes(const std::uint64_t &since, ChangeList &changes);
+
     // sqlite SQL statement wrappers
-    static const OTPToken selectToken(const OTPToken::sqliteTokenID &id);
-    static const OTPToken selectToken(const OTPToken::Label &label);
-    static const OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type = OTPToken::None);
-    static const OTPTokenList selectTokens(const OTPToken::Label &label_like);
+    static OTPToken selectToken(const OTPToken::sqliteTokenID &id);
+    static OTPToken selectToken(const OTPToken::Label &label);
+    static OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type = OTPToken::None);
+    static OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type, const Projection &projection);
+    static OTPTokenList selectTokens(const OTPToken::Label &label_like);
     static Error insertToken(const OTPToken &token);
+    static const OTPToken::Icon selectIcon(const OTPToken::sqliteTokenID &id);
+
+    // inserts all tokens in a single transaction and appends them to the display order,
+    // failed tokens are skipped and reported in errors (same order as tokens)
+    // returns the first error which occurred or Success
+    static Error insertTokens(const OTPTokenList &tokens, std::vector<Error> *errors = nullptr);
+
     static Error updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token);
     static Error renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label);
+    static Error setCounter(const OTPToken::sqliteTokenID &id, const OTPToken::CounterType &counter);
     static Error deleteToken(const OTPToken::sqliteTokenID &id);
     static OTPToken::sqliteTokenID tokenCount(const OTPToken::sqliteTypesID &type = OTPToken::None);
 
@@ -108,44 +172,6 @@ public:
     static const std::string selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id);
 
 private:
-    struct SchemaField {
-        const std::string name;
-        const std::string datatype;
-    };
-    struct StaticValueSet {
-        const OTPToken::sqliteShortID id;
-        const std::string value;
-    };
-
-    // creates an empty database with all the tables required for operation
-    // types, algorithms and config are also created there
-    static Error bootstrapDatabase();
-    static Error createTable(const std::string &table_name, const std::vector<SchemaField> &schema, const std::string &additional = {});
-    static Error insertStaticValues(const std::string &table_name, const std::vector<StaticValueSet> &values);
-    static const std::string selectStaticValue(const std::string &table, const OTPToken::sqliteShortID &id);
-
-    static Error executeGenericTokenStatement(const std::string &statement, const OTPToken &token);
-
-    static const std::string genUpdateQuery(const std::string &table, const std::vector<std::string> &fields, const std::string &condition = {});
-    static const std::string genInsertQuery(const std::string &table, const std::vector<std::string> &fields);
-
-    static const std::string escapeStringLIKE(const std::string &input);
-    static bool displayOrderQuery(std::string &query);
-
-    // database config functions
-    static Error storeDatabaseVersion();
-    static Error getDatabaseVersion(std::uint32_t &version);
-    static Error storeDisplayOrder(const DisplayOrder &order);
-    static Error updateDisplayOrder(const DisplayOrder &order);
-    static Error getDisplayOrder(DisplayOrder &order);
-
-    // serialization functions
-    static bool serializeDatabase(std::string &out);
-    static bool deserializeDatabase(const std::string &data);
-
-    // validate the schema of user-loaded (encrypted file on disk) databases
-    static Error validateSchema();
-
     // additional token obfuscation
     static const OTPToken::TokenSecret mangleTokenSecret(const OTPToken::TokenSecret &secret);
     static const OTPToken::TokenSecret unmangleTokenSecret(const OTPToken::TokenSecret &secret);
@@ -0,0 +1,659 @@
+#include "TokenPack.hpp"
+#include "DurableFile.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <array>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+
+#include <cryptopp/cryptlib.h>
+#include <cryptopp/aes.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/osrng.h>
+#include <cryptopp/secblock.h>
+
+#if !defined(OS_WINDOWS)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    static const char PACK_MAGIC[8] = {'O', 'T', 'P', 'G', 'E', 'N', 'P', 'K'};
+
+    static const std::size_t PACK_HEADER_SIZE = 96;
+    static const std::size_t PACK_RECORD_SIZE = 48;
+    static const std::size_t PACK_ALIGNMENT = 8;
+
+    static const std::size_t PACK_SALT_SIZE = 16;
+    static const std::size_t PACK_NONCE_SIZE = 8;
+    static const std::size_t PACK_IV_SIZE = 12;
+    static const std::size_t PACK_TAG_SIZE = 16;
+    static const std::size_t PACK_KEY_SIZE = 32;
+
+    // header flags
+    static const std::uint32_t PACK_ENCRYPTED = 0x1;
+
+    // header field offsets
+    enum : std::size_t {
+        HeaderVersion = 8,
+        HeaderFlags = 12,
+        HeaderCount = 16,
+        HeaderBuckets = 24,
+        HeaderRecords = 32,
+        HeaderTable = 40,
+        HeaderData = 48,
+        HeaderSize = 56,
+        HeaderSalt = 64,
+        HeaderNonce = 80,
+    };
+
+    // record field offsets
+    enum : std::size_t {
+        RecordId = 0,
+        RecordLabelOffset = 8,
+        RecordLabelSize = 16,
+        RecordKeySize = 20,
+        RecordKeyOffset = 24,
+        RecordPeriod = 32,
+        RecordCounter = 36,
+        RecordType = 40,
+        RecordAlgorithm = 41,
+        RecordDigits = 42,
+    };
+
+    // little-endian integers, compiles to a plain load on little-endian hosts
+    template<typename T>
+    static T load(const unsigned char *data)
+    {
+        std::uint64_t v = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+        {
+            v |= static_cast<std::uint64_t>(data[i]) << (8 * i);
+        }
+        return static_cast<T>(v);
+    }
+
+    template<typename T>
+    static void store(unsigned char *data, const T &value)
+    {
+        const auto v = static_cast<std::uint64_t>(value);
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+        {
+            data[i] = static_cast<unsigned char>((v >> (8 * i)) & 0xff);
+        }
+    }
+
+    static std::uint64_t align(const std::uint64_t &offset)
+    {
+        return (offset + PACK_ALIGNMENT - 1) & ~static_cast<std::uint64_t>(PACK_ALIGNMENT - 1);
+    }
+
+    static char lower(const char &c)
+    {
+        return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+
+    // FNV-1a of the lower case label, must never change for a pack version
+    static std::uint64_t labelHash(const char *label, const std::size_t &size)
+    {
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            hash ^= static_cast<unsigned char>(lower(label[i]));
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    static bool labelEquals(const char *a, const std::size_t &a_size, const OTPToken::Label &b)
+    {
+        if (a_size != b.size())
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < a_size; ++i)
+        {
+            if (lower(a[i]) != lower(b[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static CryptoPP::SecByteBlock packKey(const std::string &password, const unsigned char *salt)
+    {
+        static const std::string info = "otpgen token pack v1";
+
+        CryptoPP::SecByteBlock key(PACK_KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(key, key.size(),
+                       reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                       salt, PACK_SALT_SIZE,
+                       reinterpret_cast<const unsigned char*>(info.data()), info.size());
+        return key;
+    }
+
+    // nonce of the pack followed by the big-endian record index
+    static void recordIV(const unsigned char *nonce, const std::size_t &index, unsigned char *iv)
+    {
+        std::memcpy(iv, nonce, PACK_NONCE_SIZE);
+        for (std::size_t i = 0; i < 4; ++i)
+        {
+            iv[PACK_NONCE_SIZE + i] = static_cast<unsigned char>(index >> (8 * (3 - i)));
+        }
+    }
+}
+
+class TokenPack::Context
+{
+public:
+    ~Context()
+    {
+        unmap();
+    }
+
+    void unmap()
+    {
+#if !defined(OS_WINDOWS)
+        if (this->data)
+        {
+            munmap(const_cast<unsigned char*>(this->data), this->size);
+        }
+#else
+        this->buffer.clear();
+        this->buffer.shrink_to_fit();
+#endif
+        this->data = nullptr;
+        this->size = 0;
+        this->count = 0;
+        this->buckets = 0;
+        this->encrypted = false;
+        this->key.CleanNew(0);
+    }
+
+    // maps the whole file read-only, there is no mmap on Windows, the file is read instead
+    Error map(const std::string &file)
+    {
+#if !defined(OS_WINDOWS)
+        const auto fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat status{};
+        if (fd == -1 || fstat(fd, &status) != 0 || !S_ISREG(status.st_mode))
+        {
+            if (fd != -1)
+            {
+                ::close(fd);
+            }
+            return TokenDatabase::FileReadFailure;
+        }
+        if (status.st_size == 0)
+        {
+            ::close(fd);
+            return TokenDatabase::FileEmpty;
+        }
+
+        const auto mapping = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            return TokenDatabase::FileReadFailure;
+        }
+
+        // records are visited by lookups, not in order
+        (void) madvise(mapping, static_cast<std::size_t>(status.st_size), MADV_RANDOM);
+
+        this->data = static_cast<const unsigned char*>(mapping);
+        this->size = static_cast<std::size_t>(status.st_size);
+#else
+        std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+        if (!stream)
+        {
+            return TokenDatabase::FileReadFailure;
+        }
+        this->buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+        if (this->buffer.empty())
+        {
+            return TokenDatabase::FileEmpty;
+        }
+
+        this->data = reinterpret_cast<const unsigned char*>(this->buffer.data());
+        this->size = this->buffer.size();
+#endif
+        return TokenDatabase::Success;
+    }
+
+    // checks the header and the section bounds, records are checked on access
+    bool validate()
+    {
+        if (this->size < PACK_HEADER_SIZE || std::memcmp(this->data, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+            load<std::uint32_t>(this->data + HeaderVersion) != TokenPack::version() ||
+            load<std::uint64_t>(this->data + HeaderSize) != this->size)
+        {
+            return false;
+        }
+
+        this->count = load<std::uint64_t>(this->data + HeaderCount);
+        this->buckets = load<std::uint64_t>(this->data + HeaderBuckets);
+        this->encrypted = (load<std::uint32_t>(this->data + HeaderFlags) & PACK_ENCRYPTED) != 0;
+        const auto records = load<std::uint64_t>(this->data + HeaderRecords);
+        const auto table = load<std::uint64_t>(this->data + HeaderTable);
+        const auto data = load<std::uint64_t>(this->data + HeaderData);
+
+        // the table always has an empty bucket, so lookups terminate
+        if (this->count >= std::numeric_limits<std::uint32_t>::max() ||
+            this->buckets <= this->count || (this->buckets & (this->buckets - 1)) != 0 ||
+            records != PACK_HEADER_SIZE ||
+            (this->size - records) / PACK_RECORD_SIZE < this->count ||
+            table != align(records + this->count * PACK_RECORD_SIZE) ||
+            table > this->size || (this->size - table) / sizeof(std::uint32_t) < this->buckets ||
+            data != align(table + this->buckets * sizeof(std::uint32_t)) || data > this->size)
+        {
+            this->count = this->buckets = 0;
+            return false;
+        }
+
+        this->records = this->data + records;
+        this->table = this->data + table;
+        return true;
+    }
+
+    inline const unsigned char *record(const std::size_t &index) const
+    {
+        return index < this->count ? this->records + index * PACK_RECORD_SIZE : nullptr;
+    }
+
+    // bounds checked pointer to the label or key bytes of a record
+    inline const unsigned char *section(const std::uint64_t &offset, const std::uint64_t &size) const
+    {
+        return offset <= this->size && this->size - offset >= size ? this->data + offset : nullptr;
+    }
+
+    // bounds checked key bytes of a record, followed by the tag for encrypted packs
+    bool keyData(const unsigned char *record, const unsigned char *&data, std::size_t &size) const
+    {
+        size = load<std::uint32_t>(record + RecordKeySize);
+        data = section(load<std::uint64_t>(record + RecordKeyOffset), size + (this->encrypted ? PACK_TAG_SIZE : 0));
+        return data != nullptr;
+    }
+
+    bool decryptKey(const std::size_t &index, CryptoPP::SecByteBlock &out) const
+    {
+        const auto record = this->record(index);
+        const unsigned char *data = nullptr;
+        std::size_t size = 0;
+        if (!record || !keyData(record, data, size))
+        {
+            return false;
+        }
+
+        unsigned char iv[PACK_IV_SIZE];
+        recordIV(this->data + HeaderNonce, index, iv);
+
+        out.CleanNew(size);
+        try {
+            CryptoPP::GCM<CryptoPP::AES>::Decryption gcm;
+            gcm.SetKeyWithIV(this->key, this->key.size(), iv, sizeof(iv));
+            return gcm.DecryptAndVerify(out.data(), data + size, PACK_TAG_SIZE, iv, sizeof(iv),
+                                        record, PACK_RECORD_SIZE, data, size);
+        } catch (...) {
+            return false;
+        }
+    }
+
+    const unsigned char *data = nullptr;
+    std::size_t size = 0;
+#if defined(OS_WINDOWS)
+    std::vector<char> buffer;
+#endif
+
+    const unsigned char *records = nullptr;
+    const unsigned char *table = nullptr;
+    std::uint64_t count = 0;
+    std::uint64_t buckets = 0;
+
+    bool encrypted = false;
+    CryptoPP::SecByteBlock key;
+};
+
+TokenPack::TokenPack()
+    : _context(std::make_unique<Context>())
+{
+}
+
+TokenPack::~TokenPack()
+{
+}
+
+TokenPack::Error TokenPack::write(const std::string &file, const TokenDatabase::OTPTokenList &tokens,
+                                  const bool &encrypted, const std::string &password)
+{
+    if (encrypted && password.empty())
+    {
+        return TokenDatabase::PasswordEmpty;
+    }
+
+    const std::uint64_t count = tokens.size();
+    if (count >= std::numeric_limits<std::uint32_t>::max())
+    {
+        return TokenDatabase::FileWriteFailure;
+    }
+
+    const auto tag_size = encrypted ? PACK_TAG_SIZE : 0;
+
+    // at most half of the buckets are used
+    std::uint64_t buckets = 8;
+    while (buckets < count * 2)
+    {
+        buckets <<= 1;
+    }
+
+    // the keys are decoded upfront to know the size of the data section,
+    // secure blocks wipe them on every return
+    std::vector<CryptoPP::SecByteBlock> keys;
+    keys.reserve(tokens.size());
+    std::uint64_t data_size = 0;
+    for (auto&& token : tokens)
+    {
+        auto secret = OTPPreparedKey::decodeSecret(token.secret());
+        keys.emplace_back(reinterpret_cast<const CryptoPP::byte*>(secret.data()), secret.size());
+        std::memset(&secret[0], 0, secret.size());
+        data_size += align(token.label().size()) + align(keys.back().size() + tag_size);
+    }
+
+    const std::uint64_t records = PACK_HEADER_SIZE;
+    const auto table = align(records + count * PACK_RECORD_SIZE);
+    const auto data = align(table + buckets * sizeof(std::uint32_t));
+    const auto size = data + data_size;
+
+    CryptoPP::SecByteBlock pack(static_cast<std::size_t>(size));
+    std::memset(pack.data(), 0, pack.size());
+
+    auto header = pack.data();
+    std::memcpy(header, PACK_MAGIC, sizeof(PACK_MAGIC));
+    store(header + HeaderVersion, version());
+    store(header + HeaderFlags, encrypted ? PACK_ENCRYPTED : 0U);
+    store(header + HeaderCount, count);
+    store(header + HeaderBuckets, buckets);
+    store(header + HeaderRecords, records);
+    store(header + HeaderTable, table);
+    store(header + HeaderData, data);
+    store(header + HeaderSize, size);
+
+    CryptoPP::SecByteBlock key;
+    if (encrypted)
+    {
+        CryptoPP::AutoSeededRandomPool rng;
+        rng.GenerateBlock(header + HeaderSalt, PACK_SALT_SIZE);
+        rng.GenerateBlock(header + HeaderNonce, PACK_NONCE_SIZE);
+        key = packKey(password, header + HeaderSalt);
+    }
+
+    auto offset = data;
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        const auto &token = tokens[i];
+        const auto &label = token.label();
+        const auto &secret = keys[i];
+        auto record = pack.data() + records + i * PACK_RECORD_SIZE;
+
+        store(record + RecordId, token.id());
+        store(record + RecordLabelOffset, offset);
+        store(record + RecordLabelSize, static_cast<std::uint32_t>(label.size()));
+        std::memcpy(pack.data() + offset, label.data(), label.size());
+        offset += align(label.size());
+
+        store(record + RecordKeySize, static_cast<std::uint32_t>(secret.size()));
+        store(record + RecordKeyOffset, offset);
+        store(record + RecordPeriod, token.period());
+        store(record + RecordCounter, token.counter());
+        store(record + RecordType, token.type());
+        store(record + RecordAlgorithm, token.algorithm());
+        store(record + RecordDigits, token.digitLength());
+
+        auto out = pack.data() + offset;
+        if (encrypted)
+        {
+            unsigned char iv[PACK_IV_SIZE];
+            recordIV(header + HeaderNonce, i, iv);
+
+            try {
+                CryptoPP::GCM<CryptoPP::AES>::Encryption gcm;
+                gcm.SetKeyWithIV(key, key.size(), iv, sizeof(iv));
+                gcm.EncryptAndAuthenticate(out, out + secret.size(), PACK_TAG_SIZE, iv, sizeof(iv),
+                                           record, PACK_RECORD_SIZE,
+                                           secret.data(), secret.size());
+            } catch (...) {
+                return TokenDatabase::EncryptionFailure;
+            }
+        }
+        else
+        {
+            std::memcpy(out, secret.data(), secret.size());
+        }
+        offset += align(secret.size() + tag_size);
+
+        // the first token wins when labels are equal
+        auto bucket = labelHash(label.data(), label.size()) & (buckets - 1);
+        while (load<std::uint32_t>(pack.data() + table + bucket * sizeof(std::uint32_t)) != 0)
+        {
+            bucket = (bucket + 1) & (buckets - 1);
+        }
+        store(pack.data() + table + bucket * sizeof(std::uint32_t), static_cast<std::uint32_t>(i + 1));
+    }
+
+    // the pack is replaced by renaming, so a mapped pack is never written to
+    const auto temp_file = file + ".tmp";
+    if (!DurableFile::writeTemporary(temp_file, pack.data(), pack.size()) ||
+        !DurableFile::replace(temp_file, file))
+    {
+        return TokenDatabase::FileWriteFailure;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenPack::Error TokenPack::open(const std::string &file, const std::string &password)
+{
+    close();
+
+    const auto status = this->_context->map(file);
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+
+    if (!this->_context->validate())
+    {
+        close();
+        return TokenDatabase::InvalidTokenFile;
+    }
+
+    if (this->_context->encrypted)
+    {
+        if (password.empty())
+        {
+            close();
+            return TokenDatabase::PasswordEmpty;
+        }
+        this->_context->key = packKey(password, this->_context->data + HeaderSalt);
+
+        // a wrong password is noticed on the first record instead of every generation
+        CryptoPP::SecByteBlock key;
+        if (this->_context->count > 0 && !this->_context->decryptKey(0, key))
+        {
+            close();
+            return TokenDatabase::InvalidCiphertext;
+        }
+    }
+
+    return TokenDatabase::Success;
+}
+
+void TokenPack::close()
+{
+    this->_context->unmap();
+}
+
+bool TokenPack::isOpen() const
+{
+    return this->_context->data != nullptr;
+}
+
+bool TokenPack::encrypted() const
+{
+    return this->_context->encrypted;
+}
+
+std::size_t TokenPack::size() const
+{
+    return static_cast<std::size_t>(this->_context->count);
+}
+
+bool TokenPack::find(const OTPToken::Label &label, std::size_t &index) const
+{
+    const auto buckets = this->_context->buckets;
+    if (buckets == 0)
+    {
+        return false;
+    }
+
+    auto bucket = labelHash(label.data(), label.size()) & (buckets - 1);
+    for (std::uint64_t probe = 0; probe < buckets; ++probe)
+    {
+        const auto entry = load<std::uint32_t>(this->_context->table + bucket * sizeof(std::uint32_t));
+        if (entry == 0)
+        {
+            return false;
+        }
+
+        const auto record = this->_context->record(entry - 1);
+        if (record)
+        {
+            const auto size = load<std::uint32_t>(record + RecordLabelSize);
+            const auto data = this->_context->section(load<std::uint64_t>(record + RecordLabelOffset), size);
+            if (data && labelEquals(reinterpret_cast<const char*>(data), size, label))
+            {
+                index = entry - 1;
+                return true;
+            }
+        }
+
+        bucket = (bucket + 1) & (buckets - 1);
+    }
+
+    return false;
+}
+
+OTPToken::sqliteTokenID TokenPack::id(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    return record ? load<OTPToken::sqliteTokenID>(record + RecordId) : 0;
+}
+
+OTPToken::Label TokenPack::label(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    if (!record)
+    {
+        return {};
+    }
+
+    const auto size = load<std::uint32_t>(record + RecordLabelSize);
+    const auto data = this->_context->section(load<std::uint64_t>(record + RecordLabelOffset), size);
+    return data ? OTPToken::Label(reinterpret_cast<const char*>(data), size) : OTPToken::Label();
+}
+
+OTPToken::TokenType TokenPack::type(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    return record ? record[RecordType] : static_cast<OTPToken::TokenType>(OTPToken::None);
+}
+
+OTPToken::ShaAlgorithm TokenPack::algorithm(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    return record ? record[RecordAlgorithm] : static_cast<OTPToken::ShaAlgorithm>(OTPToken::Invalid);
+}
+
+OTPToken::DigitType TokenPack::digits(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    return record ? record[RecordDigits] : 0U;
+}
+
+OTPToken::PeriodType TokenPack::period(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    return record ? load<OTPToken::PeriodType>(record + RecordPeriod) : 0U;
+}
+
+OTPToken::CounterType TokenPack::counter(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    return record ? load<OTPToken::CounterType>(record + RecordCounter) : 0U;
+}
+
+OTPPreparedKey TokenPack::key(const std::size_t &index) const
+{
+    const auto record = this->_context->record(index);
+    if (!record)
+    {
+        return {};
+    }
+
+    if (!this->_context->encrypted)
+    {
+        const unsigned char *data = nullptr;
+        std::size_t size = 0;
+        return this->_context->keyData(record, data, size) ?
+               OTPPreparedKey::fromKey(data, size, record[RecordAlgorithm]) : OTPPreparedKey();
+    }
+
+    CryptoPP::SecByteBlock key;
+    if (!this->_context->decryptKey(index, key))
+    {
+        return {};
+    }
+    return OTPPreparedKey::fromKey(key.data(), key.size(), record[RecordAlgorithm]);
+}
+
+bool TokenPack::compute(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out) const
+{
+    const auto key = this->key(index);
+    switch (type(index))
+    {
+        case OTPToken::TOTP:
+            return OTPGen::computeTOTP(time, key, digits(index), period(index), out);
+        case OTPToken::HOTP:
+            return OTPGen::computeHOTP(key, counter(index), digits(index), out);
+        case OTPToken::Steam:
+            return OTPGen::computeSteam(time, key, out);
+    }
+
+    out.clear();
+    return false;
+}
+
+bool TokenPack::verify(const std::size_t &index, const std::time_t &time, const OTPToken::TokenString &token,
+                       const OTPGen::VerifyOptions &options, std::int64_t *offset) const
+{
+    const auto key = this->key(index);
+    switch (type(index))
+    {
+        case OTPToken::TOTP:
+            return OTPGen::verifyTOTP(time, key, token, digits(index), period(index), options, offset);
+        case OTPToken::HOTP:
+            return OTPGen::verifyHOTP(key, token, counter(index), digits(index), options, offset);
+        case OTPToken::Steam:
+            return OTPGen::verifySteam(time, key, token, options, offset);
+    }
+
+    return false;
+}
@@ -0,0 +1,96 @@
+#ifndef TOKENPACK_HPP
+#define TOKENPACK_HPP
+
+#include <string>
+#include <memory>
+#include <cinttypes>
+#include <ctime>
+
+#include "OTPToken.hpp"
+#include "OTPPreparedKey.hpp"
+#include "OTPGen.hpp"
+#include "TokenDatabase.hpp"
+
+/**
+ * Read-only token pack for hosts which only generate and verify tokens.
+ *
+ * A pack is a flat file with the decoded keys and the generation parameters
+ * of all tokens. Opening a pack maps the file into memory and only checks the
+ * header, records are read in place when they are used. There is no database,
+ * no deserialization and no base-32 decoding involved.
+ *
+ * Layout (integers are little-endian, every section is 8 byte aligned):
+ *  header:  magic "OTPGENPK", u32 version, u32 flags, u64 count, u64 buckets,
+ *           u64 records offset, u64 table offset, u64 data offset, u64 file size,
+ *           salt[16], nonce[8], reserved[8]
+ *  records: count * (i64 id, u64 label offset, u32 label size, u32 key size, u64 key offset,
+ *           u32 period, u32 counter, u8 type, u8 algorithm, u8 digits, reserved[5])
+ *  table:   buckets * u32 (record index + 1, 0 is empty), open addressing with
+ *           linear probing over the FNV-1a hash of the lower case label
+ *  data:    labels and keys
+ *
+ * With a password every key is encrypted with AES-256-GCM and followed by its tag,
+ * the record is authenticated as additional data. Ids, labels and parameters are
+ * not encrypted. HOTP counters are stored as they were at the time of the export,
+ * the pack is never modified.
+ *
+ * All const member functions can be called from multiple threads.
+ */
+class TokenPack final
+{
+public:
+    using Error = TokenDatabase::Error;
+
+    // format version of written packs
+    static constexpr std::uint32_t version() { return 1U; }
+
+    TokenPack();
+    ~TokenPack();
+
+    TokenPack(const TokenPack &) = delete;
+    TokenPack &operator=(const TokenPack &) = delete;
+
+    // writes a pack of the tokens, the keys of an encrypted pack are encrypted with the password,
+    // which must not be empty, an existing pack is replaced atomically (processes which mapped it keep the old one)
+    static Error write(const std::string &file, const TokenDatabase::OTPTokenList &tokens,
+                       const bool &encrypted = false, const std::string &password = {});
+
+    // maps the pack into memory, the password is required for encrypted packs
+    Error open(const std::string &file, const std::string &password = {});
+    void close();
+
+    bool isOpen() const;
+    bool encrypted() const;
+
+    // number of tokens
+    std::size_t size() const;
+
+    // index of the token with the given label (case-insensitive, ASCII only)
+    bool find(const OTPToken::Label &label, std::size_t &index) const;
+
+    // token parameters, defaults for an index out of range
+    OTPToken::sqliteTokenID id(const std::size_t &index) const;
+    OTPToken::Label label(const std::size_t &index) const;
+    OTPToken::TokenType type(const std::size_t &index) const;
+    OTPToken::ShaAlgorithm algorithm(const std::size_t &index) const;
+    OTPToken::DigitType digits(const std::size_t &index) const;
+    OTPToken::PeriodType period(const std::size_t &index) const;
+    OTPToken::CounterType counter(const std::size_t &index) const;
+
+    // prepared key of the token, decrypted on every call for encrypted packs,
+    // invalid for an index out of range or a corrupt record
+    OTPPreparedKey key(const std::size_t &index) const;
+
+    // generates the token at the given time (the stored counter for HOTP)
+    bool compute(const std::size_t &index, const std::time_t &time, OTPGen::TokenBuffer &out) const;
+
+    // verifies a token at the given time (within the look-ahead window of the stored counter for HOTP)
+    bool verify(const std::size_t &index, const std::time_t &time, const OTPToken::TokenString &token,
+                const OTPGen::VerifyOptions &options, std::int64_t *offset = nullptr) const;
+
+private:
+    class Context;
+    std::unique_ptr<Context> _context;
+};
+
+#endif // TOKENPACK_HPP
@@ -0,0 +1,418 @@
+#include "TokenService.hpp"
+#include "TokenVault.hpp"
+#include "OTPGen.hpp"
+
+#include <algorithm>
+
+namespace {
+    // status, total and count of a List or GenerateBatch response
+    static const std::size_t PAGE_HEADER_SIZE = 1U + 4U + 4U;
+
+    // id, status and size of a GenerateBatch entry
+    static const std::size_t BATCH_ENTRY_SIZE = 8U + 1U + 1U;
+
+    // id, type, digits, period and size of a List entry
+    static const std::size_t LIST_ENTRY_SIZE = 8U + 1U + 1U + 4U + 2U;
+
+    // little-endian encoding of the protocol integers
+    template<typename T>
+    void put(std::string &buffer, const T &value)
+    {
+        auto v = static_cast<std::uint64_t>(value);
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+        {
+            buffer.push_back(static_cast<char>(v & 0xff));
+            v >>= 8;
+        }
+    }
+
+    // bounds checked reader of a request payload
+    class Reader
+    {
+    public:
+        Reader(const std::string &buffer)
+            : _buffer(buffer)
+        {
+        }
+
+        template<typename T>
+        bool get(T &value)
+        {
+            if (this->_buffer.size() - this->_offset < sizeof(T))
+            {
+                return false;
+            }
+
+            std::uint64_t v = 0;
+            for (std::size_t i = 0; i < sizeof(T); ++i)
+            {
+                v |= static_cast<std::uint64_t>(static_cast<unsigned char>(this->_buffer[this->_offset + i])) << (8 * i);
+            }
+            value = static_cast<T>(v);
+            this->_offset += sizeof(T);
+            return true;
+        }
+
+        bool get(std::string &value, const std::size_t &size)
+        {
+            if (this->_buffer.size() - this->_offset < size)
+            {
+                return false;
+            }
+
+            value.assign(this->_buffer, this->_offset, size);
+            this->_offset += size;
+            return true;
+        }
+
+        inline bool atEnd() const
+        { return this->_offset == this->_buffer.size(); }
+
+    private:
+        const std::string &_buffer;
+        std::size_t _offset = 0;
+    };
+
+    // labels are compared case-insensitive like in the database (ASCII only)
+    static const std::string labelKey(const OTPToken::Label &label)
+    {
+        auto key = label;
+        for (auto&& c : key)
+        {
+            if (c >= 'A' && c <= 'Z')
+            {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        return key;
+    }
+
+    static bool generate(const TokenBatch &batch, const std::size_t &i, const std::time_t &time, OTPGen::TokenBuffer &out)
+    {
+        switch (batch.types()[i])
+        {
+            case OTPToken::TOTP:
+                return OTPGen::computeTOTP(time, batch.keys()[i], batch.digits()[i], batch.periods()[i], out);
+            case OTPToken::HOTP:
+                return OTPGen::computeHOTP(batch.keys()[i], batch.counters()[i], batch.digits()[i], out);
+            case OTPToken::Steam:
+                return OTPGen::computeSteam(time, batch.keys()[i], out);
+        }
+
+        out.clear();
+        return false;
+    }
+}
+
+TokenService::TokenService(TokenVault &vault)
+    : _vault(vault)
+{
+}
+
+TokenService::~TokenService()
+{
+}
+
+void TokenService::handle(const std::string &request, std::string &response)
+{
+    handle(request, response, std::time(nullptr));
+}
+
+void TokenService::handle(const std::string &request, std::string &response, const std::time_t &time)
+{
+    Reader reader(request);
+
+    std::uint8_t type = 0;
+    if (!reader.get(type))
+    {
+        put(response, MalformedRequest);
+        return;
+    }
+
+    refresh();
+
+    switch (type)
+    {
+        case Generate: {
+            OTPToken::sqliteTokenID id = 0;
+            std::uint16_t size = 0;
+            OTPToken::Label label;
+            if (!reader.get(id) || !reader.get(size) || !reader.get(label, size) || !reader.atEnd())
+            {
+                put(response, MalformedRequest);
+                return;
+            }
+
+            std::size_t i = 0;
+            if (!find(id, label, i))
+            {
+                put(response, TokenNotFound);
+                return;
+            }
+
+            OTPGen::TokenBuffer token;
+            if (!generate(this->_batch, i, time, token))
+            {
+                put(response, GenerationFailed);
+                return;
+            }
+
+            const auto validity = this->_batch.types()[i] == OTPToken::HOTP ? 0U :
+                                  OTPToken::remainingTokenValidity(time, this->_batch.periods()[i]);
+            put(response, Ok);
+            put(response, token.size);
+            response.append(token.data, token.size);
+            put(response, static_cast<std::uint32_t>(validity));
+            return;
+        }
+
+        case GenerateBatch: {
+            std::uint32_t offset = 0, count = 0;
+            if (!reader.get(offset) || !reader.get(count) || count > maxBatchSize() || (count != 0 && offset != 0))
+            {
+                put(response, MalformedRequest);
+                return;
+            }
+
+            std::vector<OTPToken::sqliteTokenID> ids(count);
+            for (auto&& id : ids)
+            {
+                if (!reader.get(id))
+                {
+                    put(response, MalformedRequest);
+                    return;
+                }
+            }
+            if (!reader.atEnd())
+            {
+                put(response, MalformedRequest);
+                return;
+            }
+
+            // a page of all tokens in display order
+            auto total = count;
+            if (ids.empty())
+            {
+                const auto &all = this->_batch.ids();
+                total = static_cast<std::uint32_t>(all.size());
+                const auto first = std::min<std::size_t>(offset, all.size());
+                const auto last = std::min(all.size(), first + maxBatchSize());
+                ids.assign(all.begin() + static_cast<std::ptrdiff_t>(first), all.begin() + static_cast<std::ptrdiff_t>(last));
+            }
+
+            put(response, Ok);
+            put(response, total);
+            put(response, static_cast<std::uint32_t>(ids.size()));
+
+            OTPGen::TokenBuffer token;
+            for (auto&& id : ids)
+            {
+                std::size_t i = 0;
+                Status status = Ok;
+                if (!find(id, {}, i))
+                {
+                    status = TokenNotFound;
+                    token.clear();
+                }
+                else if (!generate(this->_batch, i, time, token))
+                {
+                    status = GenerationFailed;
+                }
+
+                put(response, id);
+                put(response, status);
+                put(response, token.size);
+                response.append(token.data, token.size);
+            }
+            return;
+        }
+
+        case Verify: {
+            OTPToken::sqliteTokenID id = 0;
+            std::uint8_t size = 0;
+            OTPToken::TokenString code;
+            if (!reader.get(id) || !reader.get(size) || !reader.get(code, size) || !reader.atEnd())
+            {
+                put(response, MalformedRequest);
+                return;
+            }
+
+            std::size_t i = 0;
+            if (!find(id, {}, i))
+            {
+                put(response, TokenNotFound);
+                return;
+            }
+
+            OTPGen::VerifyOptions options;
+            options.replayCache = &this->_replayCache;
+            options.tokenId = id;
+
+            std::int64_t offset = 0;
+            bool valid = false;
+            const auto &key = this->_batch.keys()[i];
+            switch (this->_batch.types()[i])
+            {
+                case OTPToken::TOTP:
+                    valid = OTPGen::verifyTOTP(time, key, code, this->_batch.digits()[i], this->_batch.periods()[i], options, &offset);
+                    break;
+                case OTPToken::HOTP:
+                    valid = OTPGen::verifyHOTP(key, code, this->_batch.counters()[i], this->_batch.digits()[i], options, &offset);
+                    break;
+                case OTPToken::Steam:
+                    valid = OTPGen::verifySteam(time, key, code, options, &offset);
+                    break;
+            }
+
+            if (valid && this->_batch.types()[i] == OTPToken::HOTP)
+            {
+                // the next expected counter is stored in the database,
+                // a vault with a journal persists it without writing the whole file
+                const auto counter = static_cast<OTPToken::CounterType>(this->_batch.counters()[i] + offset + 1);
+                if (this->_vault.setCounter(id, counter) != TokenDatabase::Success)
+                {
+                    valid = false;
+                }
+                else
+                {
+                    // the batch is updated in place instead of rebuilt when nothing else changed
+                    TokenDatabase::ChangeList changes;
+                    if (this->_vault.changes(this->_revision, changes) && changes.size() == 1 &&
+                        changes.front().operation == TokenDatabase::Change::Update && changes.front().id == id)
+                    {
+                        this->_batch.setCounter(i, counter);
+                        ++this->_revision;
+                    }
+
+                    if (!this->_vault.journal() && this->_vault.saveTokens() != TokenDatabase::Success)
+                    {
+                        valid = false;
+                    }
+                }
+            }
+
+            put(response, valid ? Ok : VerificationFailed);
+            return;
+        }
+
+        case List: {
+            std::uint32_t offset = 0, limit = 0;
+            if (!reader.get(offset) || !reader.get(limit) || !reader.atEnd())
+            {
+                put(response, MalformedRequest);
+                return;
+            }
+
+            // entries are added while they fit into the frame, a label is cut to fit on its own
+            const auto total = this->_batch.size();
+            const auto last = limit == 0 ? total : std::min<std::size_t>(total, std::size_t(offset) + limit);
+            const auto max_label_size = std::min<std::size_t>(0xffff, maxFrameSize() - PAGE_HEADER_SIZE - LIST_ENTRY_SIZE);
+            std::string entries;
+            std::uint32_t count = 0;
+            for (std::size_t i = offset; i < last; ++i, ++count)
+            {
+                const auto &label = this->_labels[i];
+                const auto size = static_cast<std::uint16_t>(std::min(label.size(), max_label_size));
+                if (PAGE_HEADER_SIZE + entries.size() + LIST_ENTRY_SIZE + size > maxFrameSize())
+                {
+                    break;
+                }
+
+                put(entries, this->_batch.ids()[i]);
+                put(entries, this->_batch.types()[i]);
+                put(entries, this->_batch.digits()[i]);
+                put(entries, this->_batch.periods()[i]);
+                put(entries, size);
+                entries.append(label, 0, size);
+            }
+
+            put(response, Ok);
+            put(response, static_cast<std::uint32_t>(total));
+            put(response, count);
+            response.append(entries);
+            return;
+        }
+    }
+
+    put(response, UnknownRequest);
+}
+
+std::size_t TokenService::maxBatchSize()
+{
+    return (maxFrameSize() - PAGE_HEADER_SIZE) / (BATCH_ENTRY_SIZE + sizeof(OTPGen::TokenBuffer::data) - 1U);
+}
+
+void TokenService::appendFrame(std::string &buffer, const std::string &payload)
+{
+    put(buffer, static_cast<std::uint32_t>(payload.size()));
+    buffer.append(payload);
+}
+
+TokenService::Frame TokenService::frame(const std::string &buffer, const std::size_t &offset, std::size_t &payload_size)
+{
+    if (buffer.size() - offset < sizeof(std::uint32_t))
+    {
+        return Incomplete;
+    }
+
+    std::uint32_t size = 0;
+    for (std::size_t i = 0; i < sizeof(size); ++i)
+    {
+        size |= static_cast<std::uint32_t>(static_cast<unsigned char>(buffer[offset + i])) << (8 * i);
+    }
+
+    if (size > maxFrameSize())
+    {
+        return Oversized;
+    }
+
+    payload_size = size;
+    return buffer.size() - offset - sizeof(size) < size ? Incomplete : Complete;
+}
+
+void TokenService::refresh()
+{
+    const auto revision = this->_vault.revision();
+    if (revision == this->_revision)
+    {
+        return;
+    }
+
+    const auto tokens = this->_vault.selectTokens(OTPToken::None, TokenDatabase::WithoutIcons);
+    this->_batch.assign(tokens);
+
+    this->_labels.clear();
+    this->_ids.clear();
+    this->_labelIds.clear();
+    this->_labels.reserve(tokens.size());
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        this->_labels.emplace_back(tokens[i].label());
+        this->_ids.emplace(tokens[i].id(), i);
+        this->_labelIds.emplace(labelKey(tokens[i].label()), i);
+    }
+
+    this->_revision = revision;
+}
+
+bool TokenService::find(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label, std::size_t &index) const
+{
+    if (id != 0)
+    {
+        const auto it = this->_ids.find(id);
+        if (it == this->_ids.end())
+        {
+            return false;
+        }
+        index = it->second;
+        return true;
+    }
+
+    const auto it = this->_labelIds.find(labelKey(label));
+    if (it == this->_labelIds.end())
+    {
+        return false;
+    }
+    index = it->second;
+    return true;
+}
@@ -0,0 +1,108 @@
+#ifndef TOKENSERVICE_HPP
+#define TOKENSERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cinttypes>
+#include <ctime>
+
+#include "OTPToken.hpp"
+#include "OTPReplayCache.hpp"
+#include "TokenBatch.hpp"
+
+class TokenVault;
+
+/**
+ * Request handler of the otpgen daemon protocol.
+ *
+ * Every message is a frame: the payload size as 4 byte little-endian integer
+ * followed by the payload. The first byte of a request payload is the Request,
+ * the first byte of a response payload is the Status. Integers are little-endian,
+ * strings are prefixed with their size.
+ *
+ *  Generate:      i64 id, u16 size, label (the label is used when id is 0)
+ *                 -> u8 size, token, u32 remaining validity (0 for HOTP)
+ *  GenerateBatch: u32 offset, u32 count, count * i64 id
+ *                 (count <= maxBatchSize(), the tokens from offset in display order when count is 0,
+ *                 the offset must be 0 otherwise)
+ *                 -> u32 total, u32 count, count * (i64 id, u8 status, u8 size, token)
+ *  Verify:        i64 id, u8 size, token
+ *                 -> (status only)
+ *  List:          u32 offset, u32 limit (no limit when 0)
+ *                 -> u32 total, u32 count, count * (i64 id, u8 type, u8 digits, u32 period, u16 size, label)
+ *
+ * Every response fits into a frame. List and GenerateBatch return at most as
+ * many entries as fit, total is the number of tokens of the request (all tokens
+ * of the vault when no ids are given), the next page starts at offset + count.
+ *
+ * The generation data is kept in a TokenBatch and only rebuilt when the
+ * tokens of the vault changed, requests don't query the database.
+ * Not thread-safe.
+ */
+class TokenService final
+{
+public:
+    enum Request : std::uint8_t {
+        Generate = 1,
+        GenerateBatch,
+        Verify,
+        List,
+    };
+
+    enum Status : std::uint8_t {
+        Ok = 0,
+        MalformedRequest,
+        UnknownRequest,
+        TokenNotFound,
+        GenerationFailed,
+        VerificationFailed,
+    };
+
+    enum Frame {
+        Incomplete = 0,
+        Complete,
+        Oversized,
+    };
+
+    explicit TokenService(TokenVault &vault);
+    ~TokenService();
+
+    TokenService(const TokenService &) = delete;
+    TokenService &operator=(const TokenService &) = delete;
+
+    // handles a request payload and appends the response payload
+    void handle(const std::string &request, std::string &response);
+    void handle(const std::string &request, std::string &response, const std::time_t &time);
+
+    // frames larger than this are rejected
+    static constexpr std::size_t maxFrameSize() { return 64U * 1024U; }
+
+    // most entries of a GenerateBatch response, the longest tokens still fit into a frame
+    static std::size_t maxBatchSize();
+
+    // appends the payload as frame to the buffer
+    static void appendFrame(std::string &buffer, const std::string &payload);
+
+    // checks for a complete frame at offset of the buffer, the payload starts at offset + 4
+    static Frame frame(const std::string &buffer, const std::size_t &offset, std::size_t &payload_size);
+
+private:
+    // rebuilds the batch and the lookup tables when the vault changed
+    void refresh();
+
+    // index of the token in the batch, returns false if there is no such token
+    bool find(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label, std::size_t &index) const;
+
+    TokenVault &_vault;
+    std::uint64_t _revision = 0;
+
+    TokenBatch _batch;
+    std::vector<OTPToken::Label> _labels;
+    std::unordered_map<OTPToken::sqliteTokenID, std::size_t> _ids;
+    std::unordered_map<std::string, std::size_t> _labelIds;
+
+    OTPReplayCache _replayCache;
+};
+
+#endif // TOKENSERVICE_HPP
@@ -0,0 +1,3225 @@
+#include "TokenVault.hpp"
+#include "EncryptedVFS.hpp"
+#include "DurableFile.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <array>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <limits>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <sqlite/sqlite3.h>
+#include <sqlite_modern_cpp.h>
+
+#include <cryptopp/cryptlib.h>
+#include <cryptopp/aes.h>
+#include <cryptopp/sha.h>
+#include <cryptopp/base64.h>
+#include <cryptopp/hkdf.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/files.h>
+#include <cryptopp/gcm.h>
+#include <cryptopp/osrng.h>
+
+namespace {
+    // database version, used for possible migrations
+    static const std::uint32_t DATABASE_VERSION = 0x0f000008;
+
+    // first version which stores the display order in the tokens table
+    static const std::uint32_t DATABASE_VERSION_POSITION = 0x0f000006;
+
+    // first version which stores digits, period and counter as integers instead of BLOBs
+    static const std::uint32_t DATABASE_VERSION_INTEGERS = 0x0f000007;
+
+    // first version which stores the icons in their own table
+    static const std::uint32_t DATABASE_VERSION_ICONS = 0x0f000008;
+
+    // gap between the display positions of two adjacent tokens, leaves room
+    // to move tokens between others without renumbering the whole table
+    static const OTPToken::sqliteSortOrder POSITION_STEP = 1 << 16;
+
+    // number of changes kept for TokenVault::changes()
+    static const std::size_t CHANGE_LOG_SIZE = 4096;
+
+    // token columns in the order expected by the row decoders,
+    // the icon column of the tokens table references the icon by its hash
+    static const char *SELECT_TOKENS = "select tokens.id, type, label, icons.data, secret, digits, period, counter, algorithm "
+                                       "from tokens left join icons on icons.hash = tokens.icon";
+    static const char *SELECT_TOKENS_WITHOUT_ICONS = "select id, type, label, null, secret, digits, period, counter, algorithm "
+                                                     "from tokens";
+
+    // icons are stored once by their SHA-256 hash, no icon has an empty hash (NULL)
+    static const OTPToken::Icon iconHash(const OTPToken::Icon &icon)
+    {
+        if (icon.empty())
+        {
+            return {};
+        }
+
+        OTPToken::Icon hash(CryptoPP::SHA256::DIGESTSIZE);
+        CryptoPP::SHA256().CalculateDigest(hash.data(), icon.data(), icon.size());
+        return hash;
+    }
+
+    // sanitize SQL query and return it as a managed std::string, C pointer from sqlite3_mprintf() is deleted
+    template<class... Args>
+    static inline const std::string sanitizeQuery(const std::string &_template, Args&&... args)
+    {
+        auto statement = sqlite3_mprintf(_template.c_str(), std::forward<Args>(args)...);
+        std::string query(statement);
+        sqlite3_free(statement);
+        return query;
+    }
+}
+
+namespace {
+    // database container v2
+    //  header (authenticated as additional data of every segment):
+    //    magic[8], version[1], reserved[3], segment size[4], plaintext size[8], salt[16], nonce prefix[8]
+    //  followed by the AES-256-GCM encrypted segments, each one followed by its tag,
+    //  the iv of a segment is the nonce prefix followed by the segment index
+    static const unsigned char CONTAINER_MAGIC[8] = {'O', 'T', 'P', 'G', 'E', 'N', 'D', 'B'};
+    static const std::uint8_t CONTAINER_VERSION = 2;
+    static const std::size_t CONTAINER_HEADER_SIZE = 48;
+    static const std::size_t CONTAINER_SALT_SIZE = 16;
+    static const std::size_t CONTAINER_NONCE_SIZE = 8;
+    static const std::size_t CONTAINER_IV_SIZE = 12;
+    static const std::size_t CONTAINER_TAG_SIZE = 16;
+    static const std::size_t CONTAINER_KEY_SIZE = 32;
+
+    // segments are encrypted independently and spread over all cores
+    static const std::uint32_t CONTAINER_SEGMENT_SIZE = 256 * 1024;
+    static const std::uint32_t CONTAINER_MAX_SEGMENT_SIZE = 64 * 1024 * 1024;
+
+    // segments processed per core before the results are written to disk
+    static const std::size_t CONTAINER_SEGMENTS_PER_THREAD = 4;
+
+    struct ContainerHeader {
+        std::uint32_t segment_size = CONTAINER_SEGMENT_SIZE;
+        std::uint64_t size = 0;
+        std::array<unsigned char, CONTAINER_SALT_SIZE> salt{};
+        std::array<unsigned char, CONTAINER_NONCE_SIZE> nonce{};
+
+        std::size_t segmentCount() const
+        {
+            return static_cast<std::size_t>((size + segment_size - 1) / segment_size);
+        }
+
+        void write(unsigned char *out) const
+        {
+            std::memset(out, 0, CONTAINER_HEADER_SIZE);
+            std::memcpy(out, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC));
+            out[8] = CONTAINER_VERSION;
+            for (auto i = 0U; i < 4; ++i)
+            {
+                out[12 + i] = static_cast<unsigned char>(segment_size >> (8 * i));
+            }
+            for (auto i = 0U; i < 8; ++i)
+            {
+                out[16 + i] = static_cast<unsigned char>(size >> (8 * i));
+            }
+            std::memcpy(out + 24, salt.data(), salt.size());
+            std::memcpy(out + 40, nonce.data(), nonce.size());
+        }
+
+        bool read(const unsigned char *in)
+        {
+            if (std::memcmp(in, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) != 0 || in[8] != CONTAINER_VERSION)
+            {
+                return false;
+            }
+
+            segment_size = 0;
+            size = 0;
+            for (auto i = 0U; i < 4; ++i)
+            {
+                segment_size |= static_cast<std::uint32_t>(in[12 + i]) << (8 * i);
+            }
+            for (auto i = 0U; i < 8; ++i)
+            {
+                size |= static_cast<std::uint64_t>(in[16 + i]) << (8 * i);
+            }
+            std::memcpy(salt.data(), in + 24, salt.size());
+            std::memcpy(nonce.data(), in + 40, nonce.size());
+
+            return segment_size != 0 && segment_size <= CONTAINER_MAX_SEGMENT_SIZE && size != 0;
+        }
+
+        void iv(const std::size_t &segment, unsigned char *out) const
+        {
+            std::memcpy(out, nonce.data(), nonce.size());
+            for (auto i = 0U; i < 4; ++i)
+            {
+                out[nonce.size() + i] = static_cast<unsigned char>(segment >> (8 * (3 - i)));
+            }
+        }
+    };
+
+    // journal of single changes next to a container file (<file>.journal)
+    //  header (authenticated as additional data of every record):
+    //    magic[8], version[1], reserved[7], file nonce[8], journal nonce[8]
+    //  followed by the records: size of the change[2] and the AES-256-GCM encrypted change
+    //  followed by its tag, the iv of a record is the journal nonce followed by the record index.
+    //  the file nonce is the nonce of the container the journal belongs to,
+    //  the journal of another container is ignored
+    //  change: operation[1], token id[8], counter[4], position[8] or label,
+    //  positions of many tokens: operation[1] followed by token id[8] and position[8] pairs
+    static const unsigned char JOURNAL_MAGIC[8] = {'O', 'T', 'P', 'G', 'E', 'N', 'J', 'L'};
+    static const std::uint8_t JOURNAL_VERSION = 1;
+    static const std::size_t JOURNAL_HEADER_SIZE = 32;
+    static const std::size_t JOURNAL_MAX_CHANGE_SIZE = 0xffff;
+
+    enum JournalOperation : std::uint8_t {
+        JournalCounter = 1,
+        JournalLabel,
+        JournalPosition,
+        JournalPositions,
+    };
+
+    struct JournalHeader {
+        std::array<unsigned char, CONTAINER_NONCE_SIZE> file_nonce{};
+        std::array<unsigned char, CONTAINER_NONCE_SIZE> nonce{};
+
+        void write(unsigned char *out) const
+        {
+            std::memset(out, 0, JOURNAL_HEADER_SIZE);
+            std::memcpy(out, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+            out[8] = JOURNAL_VERSION;
+            std::memcpy(out + 16, file_nonce.data(), file_nonce.size());
+            std::memcpy(out + 24, nonce.data(), nonce.size());
+        }
+
+        bool read(const unsigned char *in)
+        {
+            if (std::memcmp(in, JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) != 0 || in[8] != JOURNAL_VERSION)
+            {
+                return false;
+            }
+
+            std::memcpy(file_nonce.data(), in + 16, file_nonce.size());
+            std::memcpy(nonce.data(), in + 24, nonce.size());
+            return true;
+        }
+
+        void iv(const std::uint32_t &record, unsigned char *out) const
+        {
+            std::memcpy(out, nonce.data(), nonce.size());
+            for (auto i = 0U; i < 4; ++i)
+            {
+                out[nonce.size() + i] = static_cast<unsigned char>(record >> (8 * (3 - i)));
+            }
+        }
+    };
+
+    // little-endian integers of journal changes
+    template<typename T>
+    static void putInteger(std::string &out, const T &value)
+    {
+        const auto v = static_cast<std::uint64_t>(value);
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+        {
+            out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+        }
+    }
+
+    template<typename T>
+    static bool getInteger(const std::string &in, std::size_t &offset, T &value)
+    {
+        if (in.size() - offset < sizeof(T))
+        {
+            return false;
+        }
+
+        std::uint64_t v = 0;
+        for (std::size_t i = 0; i < sizeof(T); ++i)
+        {
+            v |= static_cast<std::uint64_t>(static_cast<unsigned char>(in[offset + i])) << (8 * i);
+        }
+        value = static_cast<T>(v);
+        offset += sizeof(T);
+        return true;
+    }
+
+    static const std::string journalChange(const JournalOperation &operation, const OTPToken::sqliteTokenID &id)
+    {
+        std::string change(1, static_cast<char>(operation));
+        putInteger(change, id);
+        return change;
+    }
+
+    // calls function(index) for every index in [0, count) using all available cores,
+    // function must not throw
+    template<typename Function>
+    static void parallelFor(const std::size_t &count, const Function &function)
+    {
+        const std::size_t threads = std::min<std::size_t>(count, std::max(1U, std::thread::hardware_concurrency()));
+
+        std::atomic<std::size_t> next{0};
+        const auto worker = [&]{
+            for (auto i = next++; i < count; i = next++)
+            {
+                function(i);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        try {
+            for (std::size_t i = 1; i < threads; ++i)
+            {
+                workers.emplace_back(worker);
+            }
+        } catch (std::system_error &) {
+            // continue with the threads which could be created
+        }
+
+        worker();
+        for (auto&& thread : workers)
+        {
+            thread.join();
+        }
+    }
+
+    static std::size_t segmentBatchSize()
+    {
+        return std::max(1U, std::thread::hardware_concurrency()) * CONTAINER_SEGMENTS_PER_THREAD;
+    }
+}
+
+// prepared statements which are reused for the lifetime of the connection
+enum TokenVault::Statement : int {
+    SelectToken = 0,
+    SelectTokens,
+    SelectTokensWithoutIcons,
+    SelectTokensLike,
+    SelectTokenId,
+    SelectIcon,
+    InsertIcon,
+    InsertToken,
+    InsertTokenAt,
+    UpdateToken,
+    UpdateLabel,
+    UpdateCounter,
+    DeleteToken,
+    CountTokens,
+    SelectDisplayOrder,
+    SelectPosition,
+    SelectLastPosition,
+    UpdatePosition,
+    SelectNextPosition,
+    SelectPreviousPosition,
+    SelectTokenAtPosition,
+    MoveTokenToEnd,
+    SelectTypeName,
+    SelectAlgorithmName,
+
+    StatementCount
+};
+
+class TokenVault::Context final
+{
+public:
+    // idle statements of one kind, every caller gets a statement of its own,
+    // owned by the connection and cleared when it is closed or replaced
+    struct StatementPool {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<sqlite::database_binder>> idle;
+    };
+    std::array<StatementPool, StatementCount> statements;
+
+    // container saves only hold the reader lock, they are serialized by this mutex,
+    // which also guards the session key against concurrent saves
+    std::mutex save_mutex;
+
+    // journal of the container file, the container is known after it was loaded or saved
+    bool journal = false;
+    bool journal_bound = false;
+    std::array<unsigned char, CONTAINER_SALT_SIZE> file_salt{};
+    JournalHeader journal_header;
+
+    // also reset by saves which only hold the reader lock
+    std::atomic<std::uint32_t> journal_records{0};
+
+    void bindJournal(const std::array<unsigned char, CONTAINER_SALT_SIZE> &salt,
+                     const std::array<unsigned char, CONTAINER_NONCE_SIZE> &nonce)
+    {
+        this->journal_bound = true;
+        this->file_salt = salt;
+        this->journal_header.file_nonce = nonce;
+        this->journal_records = 0;
+    }
+
+    void unbindJournal()
+    {
+        this->journal_bound = false;
+        this->journal_records = 0;
+    }
+
+    // the journal has a key of its own, derived from the password and the salt of the container
+    static CryptoPP::SecByteBlock journalKey(const std::string &password,
+                                             const std::array<unsigned char, CONTAINER_SALT_SIZE> &salt)
+    {
+        static const std::string info = "otpgen token journal v1";
+
+        CryptoPP::SecByteBlock key(CONTAINER_KEY_SIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(key, key.size(),
+                       reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                       salt.data(), salt.size(),
+                       reinterpret_cast<const unsigned char*>(info.data()), info.size());
+        return key;
+    }
+
+    // password the paged database was opened with, its journal is opened with it
+    std::string paged_password;
+
+    // key of the current session, derived once per password and salt
+    CryptoPP::SecByteBlock session_key;
+    std::array<unsigned char, CONTAINER_SALT_SIZE> session_salt{};
+    std::string session_password;
+
+    static const std::string statementQuery(const Statement &statement)
+    {
+        const std::string select = SELECT_TOKENS;
+        const std::string select_without_icons = SELECT_TOKENS_WITHOUT_ICONS;
+
+        switch (statement)
+        {
+            case SelectToken:      return select + " where id = ? limit 1;";
+            case SelectTokens:     return select + " where (?1 = 0 or type = ?1) order by position asc, id asc;";
+            case SelectTokensLike: return select + " where label like ? escape '\\' order by position asc, id asc;";
+            case SelectTokenId:    return "select id from tokens where label = ? limit 1;";
+
+            case SelectTokensWithoutIcons: return select_without_icons + " where (?1 = 0 or type = ?1) order by position asc, id asc;";
+
+            case SelectIcon: return "select icons.data from tokens join icons on icons.hash = tokens.icon where tokens.id = ? limit 1;";
+            case InsertIcon: return "insert or ignore into icons (hash, data) values (?, ?);";
+
+            case InsertToken: return "insert into tokens (type, label, icon, secret, digits, period, counter, algorithm, position) "
+                                     "values (?, ?, ?, ?, ?, ?, ?, ?, (select coalesce(max(position), 0) from tokens) + ?);";
+            case InsertTokenAt: return "insert into tokens (type, label, icon, secret, digits, period, counter, algorithm, position) "
+                                       "values (?, ?, ?, ?, ?, ?, ?, ?, ?);";
+            case UpdateToken: return "update tokens set type=?, label=?, icon=?, secret=?, digits=?, period=?, counter=?, algorithm=? "
+                                     "where id = ?;";
+            case UpdateLabel:   return "update tokens set label = ? where id = ?;";
+            case UpdateCounter: return "update tokens set counter = ? where id = ?;";
+            case DeleteToken: return "delete from tokens where id = ?;";
+            case CountTokens: return "select count(*) from tokens where (?1 = 0 or type = ?1);";
+
+            case SelectDisplayOrder:     return "select id from tokens order by position asc, id asc;";
+            case SelectPosition:         return "select position from tokens where id = ? limit 1;";
+            case SelectLastPosition:     return "select coalesce(max(position), 0) from tokens;";
+            case UpdatePosition:         return "update tokens set position = ? where id = ?;";
+            case SelectNextPosition:     return "select min(position) from tokens where position > ? and id != ?;";
+            case SelectPreviousPosition: return "select max(position) from tokens where position < ? and id != ?;";
+            case SelectTokenAtPosition:  return "select id from tokens order by position asc, id asc limit 1 offset ?;";
+            case MoveTokenToEnd:         return "update tokens set position = (select max(position) from tokens) + ? where id = ?;";
+
+            case SelectTypeName:      return "select name from types where id = ? limit 1;";
+            case SelectAlgorithmName: return "select name from algorithms where id = ? limit 1;";
+
+            case StatementCount: break;
+        }
+
+        return {};
+    }
+
+    void clearStatements()
+    {
+        for (auto&& pool : this->statements)
+        {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            try {
+                pool.idle.clear();
+            } catch (sqlite::sqlite_exception &) {
+            }
+        }
+    }
+
+    // label lookup cache, kept coherent by the update hook of the connection,
+    // only labels which were found are cached
+    bool label_cache = false;
+    std::mutex label_mutex;
+    std::unordered_map<std::string, OTPToken::sqliteTokenID> label_ids;
+    std::unordered_map<OTPToken::sqliteTokenID, std::string> id_labels;
+
+    // labels are compared case-insensitive (COLLATE NOCASE, ASCII only)
+    static const std::string labelKey(const OTPToken::Label &label)
+    {
+        auto key = label;
+        for (auto&& c : key)
+        {
+            if (c >= 'A' && c <= 'Z')
+            {
+                c = static_cast<char>(c - 'A' + 'a');
+            }
+        }
+        return key;
+    }
+
+    bool cachedLabel(const OTPToken::Label &label, OTPToken::sqliteTokenID &id)
+    {
+        if (!this->label_cache)
+        {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(this->label_mutex);
+        const auto it = this->label_ids.find(labelKey(label));
+        if (it == this->label_ids.end())
+        {
+            return false;
+        }
+        id = it->second;
+        return true;
+    }
+
+    void cacheLabel(const OTPToken::Label &label, const OTPToken::sqliteTokenID &id)
+    {
+        if (!this->label_cache)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->label_mutex);
+        const auto key = labelKey(label);
+        this->label_ids[key] = id;
+        this->id_labels[id] = key;
+    }
+
+    void clearLabels()
+    {
+        std::lock_guard<std::mutex> lock(this->label_mutex);
+        this->label_ids.clear();
+        this->id_labels.clear();
+    }
+
+    // revision of the token data, changes with every modification of the tokens table
+    // and whenever the database is replaced
+    std::atomic<std::uint64_t> revision{1};
+
+    // recent changes of the tokens with the revision they created,
+    // complete for every revision >= start, modified with the writer lock held
+    struct ChangeLog {
+        struct Entry {
+            std::uint64_t revision;
+            Change change;
+        };
+        std::deque<Entry> entries;
+        std::uint64_t start = 1;
+    };
+    ChangeLog change_log;
+
+    // position updates of the display order functions are reported as Reorder
+    bool reordering = false;
+    struct Reordering final {
+        explicit Reordering(Context &context) : context(context) { context.reordering = true; }
+        ~Reordering() { context.reordering = false; }
+        Context &context;
+    };
+
+    void record(const Change::Operation &operation, const OTPToken::sqliteTokenID &id)
+    {
+        const auto revision = this->revision.fetch_add(1, std::memory_order_release) + 1;
+        this->change_log.entries.push_back({revision, {operation, id}});
+        if (this->change_log.entries.size() > CHANGE_LOG_SIZE)
+        {
+            this->change_log.start = this->change_log.entries.front().revision;
+            this->change_log.entries.pop_front();
+        }
+    }
+
+    // the tokens were replaced as a whole, the changes before are unknown
+    void reset()
+    {
+        const auto revision = this->revision.fetch_add(1, std::memory_order_release) + 1;
+        this->change_log.entries.clear();
+        this->change_log.start = revision;
+    }
+
+    // digest of the columns of a token, except for the position
+    struct TokenDigest {
+        OTPToken::sqliteTokenID id;
+        OTPToken::sqliteSortOrder position;
+        std::size_t hash;
+    };
+    using TokenDigests = std::vector<TokenDigest>;
+
+    // digests of all tokens ordered by id
+    static bool tokenDigests(sqlite::database &db, TokenDigests &digests)
+    {
+        try {
+            db << "select id, position, type || ':' || digits || ':' || period || ':' || counter || ':' || algorithm || ':' || "
+                  "coalesce(hex(icon), '') || ':' || length(label) || ':' || label || secret from tokens order by id asc;"
+               >> [&](const OTPToken::sqliteTokenID &id, const OTPToken::sqliteSortOrder &position, const std::string &row) {
+                digests.push_back({id, position, std::hash<std::string>()(row)});
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+        return true;
+    }
+
+    // records the changes between two sets of digests
+    void recordDifference(const TokenDigests &before, const TokenDigests &after)
+    {
+        std::size_t i = 0, j = 0;
+        while (i < before.size() || j < after.size())
+        {
+            if (j == after.size() || (i < before.size() && before[i].id < after[j].id))
+            {
+                record(Change::Delete, before[i++].id);
+            }
+            else if (i == before.size() || after[j].id < before[i].id)
+            {
+                record(Change::Insert, after[j++].id);
+            }
+            else
+            {
+                if (before[i].hash != after[j].hash)
+                {
+                    record(Change::Update, after[j].id);
+                }
+                if (before[i].position != after[j].position)
+                {
+                    record(Change::Reorder, after[j].id);
+                }
+                ++i;
+                ++j;
+            }
+        }
+    }
+
+    // records the change, the label of an updated or deleted token is unknown here, forget the token
+    static void updateHook(void *context, int operation, const char *database, const char *table, sqlite3_int64 rowid)
+    {
+        if (std::strcmp(database, "main") != 0 || std::strcmp(table, "tokens") != 0)
+        {
+            return;
+        }
+
+        auto self = static_cast<Context*>(context);
+        switch (operation)
+        {
+            case SQLITE_INSERT: self->record(Change::Insert, rowid); break;
+            case SQLITE_DELETE: self->record(Change::Delete, rowid); break;
+            default:            self->record(self->reordering ? Change::Reorder : Change::Update, rowid); break;
+        }
+
+        if (operation == SQLITE_INSERT || !self->label_cache)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(self->label_mutex);
+        const auto it = self->id_labels.find(rowid);
+        if (it != self->id_labels.end())
+        {
+            self->label_ids.erase(it->second);
+            self->id_labels.erase(it);
+        }
+    }
+
+    static void rollbackHook(void *context)
+    {
+        auto self = static_cast<Context*>(context);
+        self->clearLabels();
+        self->reset();
+    }
+
+    void clearSessionKey()
+    {
+        this->session_key.CleanNew(0);
+        this->session_password.clear();
+    }
+
+    const CryptoPP::SecByteBlock &sessionKey(const std::string &password,
+                                             const std::array<unsigned char, CONTAINER_SALT_SIZE> &salt)
+    {
+        if (this->session_key.empty() || this->session_password != password || this->session_salt != salt)
+        {
+            static const std::string info = "otpgen token database v2";
+
+            this->session_key.CleanNew(CONTAINER_KEY_SIZE);
+            CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+            hkdf.DeriveKey(this->session_key, this->session_key.size(),
+                           reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                           salt.data(), salt.size(),
+                           reinterpret_cast<const unsigned char*>(info.data()), info.size());
+            this->session_password = password;
+            this->session_salt = salt;
+        }
+        return this->session_key;
+    }
+};
+
+// statement borrowed from the pool, returned to the pool when destroyed
+class TokenVault::CachedStatement final
+{
+public:
+    CachedStatement(Context::StatementPool &pool, std::unique_ptr<sqlite::database_binder> statement)
+        : _pool(&pool), _statement(std::move(statement))
+    {
+    }
+
+    CachedStatement(CachedStatement &&) = default;
+
+    ~CachedStatement()
+    {
+        if (!this->_statement)
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(this->_pool->mutex);
+        try {
+            this->_pool->idle.emplace_back(std::move(this->_statement));
+        } catch (...) {
+            // the statement is finalized instead
+        }
+    }
+
+    inline sqlite::database_binder &operator* ()
+    { return *this->_statement; }
+
+    template<typename T>
+    inline CachedStatement &operator<< (const T &value)
+    {
+        (*this->_statement) << value;
+        return *this;
+    }
+
+    template<typename T>
+    inline void operator>> (T &&value)
+    { (*this->_statement) >> std::forward<T>(value); }
+
+    // execute the statement
+    inline void operator++ (int)
+    { (*this->_statement)++; }
+
+private:
+    Context::StatementPool *_pool;
+    std::unique_ptr<sqlite::database_binder> _statement;
+};
+
+TokenVault::TokenVault()
+    : _context(std::make_unique<Context>())
+{
+}
+
+TokenVault::TokenVault(const std::string &file, const std::string &password, const StorageFormat &format)
+    : TokenVault()
+{
+    (void) setTokenDatabase(file);
+    (void) setPassword(password);
+    this->_format = format;
+}
+
+TokenVault::~TokenVault()
+{
+    closeDatabase();
+}
+
+TokenVault::CachedStatement TokenVault::cachedStatement(const Statement &statement) const
+{
+    auto &pool = this->_context->statements[statement];
+
+    std::unique_ptr<sqlite::database_binder> cached;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        if (!pool.idle.empty())
+        {
+            cached = std::move(pool.idle.back());
+            pool.idle.pop_back();
+        }
+    }
+
+    if (!cached)
+    {
+        cached = std::make_unique<sqlite::database_binder>((*this->_db) << Context::statementQuery(statement));
+
+        // don't execute on destruction when the statement was never used
+        cached->used(true);
+    }
+
+    return CachedStatement(pool, std::move(cached));
+}
+
+bool TokenVault::databaseConnected() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_status;
+}
+
+TokenVault::Error TokenVault::initDatabase()
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    return initDatabaseLocked();
+}
+
+TokenVault::Error TokenVault::initDatabaseLocked()
+{
+    if (this->_status)
+    {
+        closeDatabaseLocked();
+    }
+
+    // create in-memory database
+    try {
+        this->_db = std::make_shared<sqlite::database>(":memory:");
+        this->_status = true;
+        setupHooks();
+    } catch (sqlite::sqlite_exception &) {
+        this->_status = false;
+        return TokenDatabase::SqlMemoryAllocationError;
+    }
+
+    return TokenDatabase::Success;
+}
+
+void TokenVault::closeDatabase()
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    closeDatabaseLocked();
+}
+
+void TokenVault::closeDatabaseLocked()
+{
+    if (this->_status)
+    {
+        // release cached statements
+        this->_context->clearStatements();
+
+        // the file can be opened by another vault now
+        if (this->_paged)
+        {
+            EncryptedVFS::removePassword(sqlite3_db_filename(this->_db->connection().get(), "main"));
+            this->_context->paged_password.clear();
+        }
+
+        // force close database
+        (void) sqlite3_close_v2(this->_db->connection().get());
+        this->_db = nullptr;
+        this->_status = false;
+        this->_paged = false;
+        this->_context->reset();
+        this->_context->unbindJournal();
+    }
+}
+
+TokenVault::Error TokenVault::openPagedDatabase(const std::string &file)
+{
+    if (!EncryptedVFS::registerVFS())
+    {
+        return TokenDatabase::SqlMemoryAllocationError;
+    }
+
+    // the file header and the key are verified when the file is opened, the open database
+    // is replaced only after that, a wrong password or a foreign file keeps the session
+    const std::string current = this->_paged ? sqlite3_db_filename(this->_db->connection().get(), "main") : "";
+    EncryptedVFS::setPassword(file, this->_password);
+
+    std::shared_ptr<sqlite::database> db;
+    try {
+        sqlite::sqlite_config config;
+        config.zVfs = EncryptedVFS::name;
+        db = std::make_shared<sqlite::database>(file, config);
+
+        // temporary files are not encrypted by the VFS
+        (*db) << "pragma temp_store = memory;";
+        (*db) << "pragma page_size = " + std::to_string(EncryptedVFS::pageSize) + ";";
+
+        // keep all changes until saveTokens(), only the changed pages are written on commit
+        (*db) << "begin;";
+    } catch (sqlite::sqlite_exception &e) {
+        db = nullptr;
+        EncryptedVFS::removePassword(file);
+
+        // the journal of the open database uses the password it was opened with
+        if (!current.empty())
+        {
+            EncryptedVFS::setPassword(current, this->_context->paged_password);
+        }
+
+        switch (e.get_code())
+        {
+            case SQLITE_AUTH:   return TokenDatabase::InvalidCiphertext;
+            case SQLITE_NOTADB: return TokenDatabase::InvalidTokenFile;
+            default:            return TokenDatabase::FileReadFailure;
+        }
+    }
+
+    // closing removes the password of the old file, which can be the same file
+    closeDatabaseLocked();
+    EncryptedVFS::setPassword(file, this->_password);
+
+    this->_db = std::move(db);
+    this->_context->paged_password = this->_password;
+    this->_status = true;
+    this->_paged = true;
+    this->_context->unbindJournal();
+    setupHooks();
+    return TokenDatabase::Success;
+}
+
+bool TokenVault::setPassword(const std::string &password)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    return setPasswordLocked(password);
+}
+
+bool TokenVault::setPasswordLocked(const std::string &password)
+{
+    if (password.empty())
+        return false;
+
+    // remove old password and the key derived from it
+    this->_password.clear();
+    this->_context->clearSessionKey();
+
+    // don't use smart pointers here, already managed/deleted by crypto++ itself
+    CryptoPP::SHA256 hash;
+    CryptoPP::StringSource src(password, true,
+        new CryptoPP::HashFilter(hash,
+            new CryptoPP::Base64Encoder(
+                new CryptoPP::StringSink(this->_password))));
+
+    return true;
+}
+
+bool TokenVault::setTokenDatabase(const std::string &file)
+{
+    if (file.empty())
+    {
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    this->_path = file;
+    this->_context->unbindJournal();
+    return true;
+}
+
+void TokenVault::setStorageFormat(const StorageFormat &format)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    this->_format = format;
+}
+
+TokenVault::StorageFormat TokenVault::storageFormat() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_format;
+}
+
+TokenVault::Error TokenVault::changePassword(const std::string &newPassword)
+{
+    Error status = TokenDatabase::Success;
+
+    if (newPassword.empty())
+    {
+        return TokenDatabase::PasswordEmpty;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+
+    auto pwdStatus = setPasswordLocked(newPassword);
+    if (!pwdStatus)
+    {
+        return TokenDatabase::PasswordHashFailure;
+    }
+
+    // every page must be encrypted again with the new key
+    if (this->_paged)
+    {
+        return writePagedDatabase();
+    }
+
+    status = saveTokensLocked();
+    return status;
+}
+
+void TokenVault::beginTransaction()
+{
+    (*this->_db) << "savepoint tokens;";
+}
+
+void TokenVault::commitTransaction()
+{
+    (*this->_db) << "release tokens;";
+}
+
+void TokenVault::rollbackTransaction()
+{
+    // the rollback hook is not called when rolling back to a savepoint
+    this->_context->clearLabels();
+    this->_context->reset();
+
+    try {
+        (*this->_db) << "rollback to tokens;";
+        (*this->_db) << "release tokens;";
+    } catch (sqlite::sqlite_exception &) {}
+}
+
+void TokenVault::setLabelCache(const bool &enabled)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    this->_context->label_cache = enabled;
+    this->_context->clearLabels();
+}
+
+std::uint64_t TokenVault::revision() const
+{
+    return this->_context->revision.load(std::memory_order_acquire);
+}
+
+bool TokenVault::changes(const std::uint64_t &since, ChangeList &changes) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    const auto &log = this->_context->change_log;
+    if (since < log.start || since > this->_context->revision.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    // entries are ordered by revision
+    const auto first = std::upper_bound(log.entries.begin(), log.entries.end(), since,
+                                        [](const std::uint64_t &revision, const Context::ChangeLog::Entry &entry) {
+        return revision < entry.revision;
+    });
+    for (auto it = first; it != log.entries.end(); ++it)
+    {
+        changes.emplace_back(it->change);
+    }
+    return true;
+}
+
+void TokenVault::setJournal(const bool &enabled)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    this->_context->journal = enabled;
+}
+
+bool TokenVault::journal() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_context->journal;
+}
+
+std::size_t TokenVault::journalSize() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return this->_context->journal_records;
+}
+
+TokenVault::Error TokenVault::appendJournal(const std::string &change)
+{
+    // without a container file (new, legacy or paged database) the whole database is saved
+    if (this->_paged || !this->_context->journal_bound || change.size() > JOURNAL_MAX_CHANGE_SIZE)
+    {
+        return saveTokensLocked();
+    }
+
+    const auto file = this->_path + ".journal";
+    const auto create = this->_context->journal_records == 0;
+    auto &header = this->_context->journal_header;
+
+    try {
+        // every journal file gets a nonce of its own
+        if (create)
+        {
+            CryptoPP::AutoSeededRandomPool rng;
+            rng.GenerateBlock(header.nonce.data(), header.nonce.size());
+        }
+
+        unsigned char header_data[JOURNAL_HEADER_SIZE];
+        header.write(header_data);
+
+        unsigned char iv[CONTAINER_IV_SIZE];
+        header.iv(this->_context->journal_records, iv);
+
+        std::string record;
+        putInteger(record, static_cast<std::uint16_t>(change.size()));
+        record.resize(record.size() + change.size() + CONTAINER_TAG_SIZE);
+        const auto out = reinterpret_cast<unsigned char*>(&record[sizeof(std::uint16_t)]);
+
+        const auto key = Context::journalKey(this->_password, this->_context->file_salt);
+        CryptoPP::GCM<CryptoPP::AES>::Encryption gcm;
+        gcm.SetKeyWithIV(key, key.size(), iv, sizeof(iv));
+        gcm.EncryptAndAuthenticate(out, out + change.size(), CONTAINER_TAG_SIZE, iv, sizeof(iv),
+                                   header_data, JOURNAL_HEADER_SIZE,
+                                   reinterpret_cast<const unsigned char*>(change.data()), change.size());
+
+        std::ofstream stream(file, std::ios_base::out | std::ios_base::binary | (create ? std::ios_base::trunc : std::ios_base::app));
+        if (create)
+        {
+            stream.write(reinterpret_cast<const char*>(header_data), JOURNAL_HEADER_SIZE);
+        }
+        stream.write(record.data(), static_cast<std::streamsize>(record.size()));
+        stream.close();
+
+        // a partially written record would hide all records after it
+        if (!stream || !DurableFile::sync(file) || (create && !DurableFile::sync(DurableFile::directoryOf(file))))
+        {
+            return saveTokensLocked();
+        }
+    } catch (...) {
+        return saveTokensLocked();
+    }
+
+    ++this->_context->journal_records;
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::journalPosition(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteSortOrder &position)
+{
+    auto change = journalChange(JournalPosition, id);
+    putInteger(change, position);
+    return appendJournal(change);
+}
+
+TokenVault::Error TokenVault::journalPositions(const PositionList &positions)
+{
+    // one record for all tokens, too many tokens for a record save the whole database
+    std::string change(1, static_cast<char>(JournalPositions));
+    for (auto&& position : positions)
+    {
+        putInteger(change, position.first);
+        putInteger(change, position.second);
+    }
+    return appendJournal(change);
+}
+
+TokenVault::Error TokenVault::replayJournal()
+{
+    const auto file = this->_path + ".journal";
+    std::ifstream stream(file, std::ios_base::in | std::ios_base::binary);
+    if (!stream)
+    {
+        return TokenDatabase::Success;
+    }
+    const std::string data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    stream.close();
+
+    // the journal of another file, its changes are part of that file
+    JournalHeader header;
+    const auto header_data = reinterpret_cast<const unsigned char*>(data.data());
+    if (!this->_context->journal_bound || data.size() < JOURNAL_HEADER_SIZE || !header.read(header_data) ||
+        header.file_nonce != this->_context->journal_header.file_nonce)
+    {
+        removeJournal();
+        return TokenDatabase::Success;
+    }
+
+    std::size_t offset = JOURNAL_HEADER_SIZE;
+    std::uint32_t records = 0;
+
+    try {
+        const auto key = Context::journalKey(this->_password, this->_context->file_salt);
+        std::string change;
+
+        for (;;)
+        {
+            // a torn record at the end was written during a crash
+            std::size_t next = offset;
+            std::uint16_t size = 0;
+            if (!getInteger(data, next, size) || data.size() - next < size + CONTAINER_TAG_SIZE)
+            {
+                break;
+            }
+
+            unsigned char iv[CONTAINER_IV_SIZE];
+            header.iv(records, iv);
+
+            change.resize(size);
+            CryptoPP::GCM<CryptoPP::AES>::Decryption gcm;
+            gcm.SetKeyWithIV(key, key.size(), iv, sizeof(iv));
+            if (!gcm.DecryptAndVerify(reinterpret_cast<unsigned char*>(&change[0]),
+                                      header_data + next + size, CONTAINER_TAG_SIZE, iv, sizeof(iv),
+                                      header_data, JOURNAL_HEADER_SIZE, header_data + next, size))
+            {
+                break;
+            }
+            offset = next + size + CONTAINER_TAG_SIZE;
+            ++records;
+
+            // changes of tokens which no longer exist are skipped
+            std::size_t position = 1;
+            OTPToken::sqliteTokenID id = 0;
+            if (change.empty() || !getInteger(change, position, id))
+            {
+                continue;
+            }
+
+            try {
+                switch (change[0])
+                {
+                    case JournalCounter: {
+                        OTPToken::CounterType counter = 0;
+                        if (getInteger(change, position, counter))
+                        {
+                            auto statement = cachedStatement(UpdateCounter);
+                            statement << counter << id;
+                            statement++;
+                        }
+                        break;
+                    }
+                    case JournalLabel: {
+                        auto statement = cachedStatement(UpdateLabel);
+                        statement << change.substr(position) << id;
+                        statement++;
+                        break;
+                    }
+                    case JournalPosition: {
+                        OTPToken::sqliteSortOrder value = 0;
+                        if (getInteger(change, position, value))
+                        {
+                            Context::Reordering reordering(*this->_context);
+                            auto statement = cachedStatement(UpdatePosition);
+                            statement << value << id;
+                            statement++;
+                        }
+                        break;
+                    }
+                    case JournalPositions: {
+                        // the id of the first pair was read above
+                        Context::Reordering reordering(*this->_context);
+                        auto statement = cachedStatement(UpdatePosition);
+                        OTPToken::sqliteSortOrder value = 0;
+                        while (getInteger(change, position, value))
+                        {
+                            statement << value << id;
+                            statement++;
+                            if (!getInteger(change, position, id))
+                            {
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                }
+            } catch (sqlite::sqlite_exception &) {
+            }
+        }
+    } catch (...) {
+        return TokenDatabase::DecryptionFailure;
+    }
+
+    this->_context->journal_header = header;
+    this->_context->journal_records = records;
+
+    // new records must follow the last valid one, fold the journal into the file otherwise
+    if (offset != data.size())
+    {
+        return saveTokensLocked();
+    }
+
+    return TokenDatabase::Success;
+}
+
+void TokenVault::removeJournal()
+{
+    std::remove((this->_path + ".journal").c_str());
+    this->_context->journal_records = 0;
+}
+
+void TokenVault::setupHooks()
+{
+    // a new connection holds different tokens
+    this->_context->clearLabels();
+    this->_context->reset();
+    if (!this->_status)
+    {
+        return;
+    }
+
+    const auto connection = this->_db->connection().get();
+    sqlite3_update_hook(connection, &Context::updateHook, this->_context.get());
+    sqlite3_rollback_hook(connection, &Context::rollbackHook, this->_context.get());
+}
+
+TokenVault::Error TokenVault::bindGenericTokenStatement(sqlite::database_binder &statement, const OTPToken &token,
+                                                        const OTPToken::Icon &icon_hash)
+{
+    // BLOB == std::vector<T> in this C++ SQL library
+    // binds the first 8 '?' placeholders, the caller binds
+    // the remaining ones and executes the statement
+    try {
+        statement
+              << token.type()
+              << token.label()
+              << icon_hash // already a std::vector<>, empty binds NULL
+              << TokenDatabase::mangleTokenSecret(token.secret())
+              << token.digitLength()
+              << token.period()
+              << token.counter()
+              << token.algorithm();
+    } catch (sqlite::sqlite_exception &e) {
+        if (e.get_code() == SQLITE_CONSTRAINT)
+        {
+            return TokenDatabase::SqlConstraintViolation;
+        }
+        else
+        {
+            return TokenDatabase::SqlExecutionFailed;
+        }
+    }
+
+    return TokenDatabase::Success;
+}
+
+OTPToken TokenVault::selectToken(const OTPToken::sqliteTokenID &id) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return selectTokenLocked(id);
+}
+
+OTPToken TokenVault::selectTokenLocked(const OTPToken::sqliteTokenID &id) const
+{
+    if (!this->_status)
+    {
+        return {};
+    }
+
+    OTPToken token;
+
+    try {
+        cachedStatement(SelectToken) << id
+              >> [&](const OTPToken::sqliteLongID &id,
+                     const OTPToken::TokenType &type,
+                     OTPToken::Label label,
+                     OTPToken::Icon icon,
+                     const OTPToken::TokenSecret &secret,
+                     const OTPToken::DigitType &digits,
+                     const OTPToken::PeriodType &period,
+                     const OTPToken::CounterType &counter,
+                     const OTPToken::ShaAlgorithm &algorithm)
+        {
+            token = OTPToken(type, std::move(label), std::move(icon), TokenDatabase::unmangleTokenSecret(secret),
+                             digits, period, counter, algorithm);
+            token._id = id;
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    return token;
+}
+
+OTPToken TokenVault::selectToken(const OTPToken::Label &label) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+
+    // get token which matches the label absolute
+    const auto id = tokenIdLocked(label);
+    if (id == 0)
+    {
+        return {};
+    }
+
+    return selectTokenLocked(id);
+}
+
+OTPToken::sqliteTokenID TokenVault::tokenIdLocked(const OTPToken::Label &label) const
+{
+    if (!this->_status)
+    {
+        return 0;
+    }
+
+    OTPToken::sqliteTokenID id = 0;
+    if (this->_context->cachedLabel(label, id))
+    {
+        return id;
+    }
+
+    // exact match on the unique label index
+    try {
+        cachedStatement(SelectTokenId) << label >> [&](const OTPToken::sqliteTokenID &row) {
+            id = row;
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return 0;
+    }
+
+    if (id != 0)
+    {
+        this->_context->cacheLabel(label, id);
+    }
+
+    return id;
+}
+
+TokenVault::OTPTokenList TokenVault::selectTokens(const OTPToken::sqliteTypesID &type) const
+{
+    return selectTokens(type, TokenDatabase::WithIcons);
+}
+
+TokenVault::OTPTokenList TokenVault::selectTokens(const OTPToken::sqliteTypesID &type, const Projection &projection) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return {};
+    }
+
+    OTPTokenList tokens;
+
+    const auto count = tokenCountLocked(type);
+    if (count > 0)
+    {
+        tokens.reserve(static_cast<std::size_t>(count));
+    }
+
+    try {
+        // decode all rows in a single pass
+        cachedStatement(projection == TokenDatabase::WithoutIcons ? SelectTokensWithoutIcons : SelectTokens) << static_cast<int>(type)
+              >> [&](const OTPToken::sqliteLongID &id,
+                     const OTPToken::TokenType &type,
+                     OTPToken::Label label,
+                     OTPToken::Icon icon,
+                     const OTPToken::TokenSecret &secret,
+                     const OTPToken::DigitType &digits,
+                     const OTPToken::PeriodType &period,
+                     const OTPToken::CounterType &counter,
+                     const OTPToken::ShaAlgorithm &algorithm)
+        {
+            // columns are moved into the token, which is built in place
+            auto &token = tokens.emplace_back(type, std::move(label), std::move(icon), TokenDatabase::unmangleTokenSecret(secret),
+                                              digits, period, counter, algorithm);
+            token._id = id;
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    return tokens;
+}
+
+TokenVault::OTPTokenList TokenVault::selectTokens(const OTPToken::Label &label_like) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return {};
+    }
+
+    OTPTokenList tokens;
+
+    try {
+        cachedStatement(SelectTokensLike) << label_like
+              >> [&](const OTPToken::sqliteLongID &id,
+                     const OTPToken::TokenType &type,
+                     OTPToken::Label label,
+                     OTPToken::Icon icon,
+                     const OTPToken::TokenSecret &secret,
+                     const OTPToken::DigitType &digits,
+                     const OTPToken::PeriodType &period,
+                     const OTPToken::CounterType &counter,
+                     const OTPToken::ShaAlgorithm &algorithm)
+        {
+            // columns are moved into the token, which is built in place
+            auto &token = tokens.emplace_back(type, std::move(label), std::move(icon), TokenDatabase::unmangleTokenSecret(secret),
+                                              digits, period, counter, algorithm);
+            token._id = id;
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    return tokens;
+}
+
+const OTPToken::Icon TokenVault::selectIcon(const OTPToken::sqliteTokenID &id) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return {};
+    }
+
+    OTPToken::Icon icon;
+
+    try {
+        cachedStatement(SelectIcon) << id >> [&](const OTPToken::Icon &data) {
+            icon = data;
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    return icon;
+}
+
+void TokenVault::storeIcon(const OTPToken::Icon &hash, const OTPToken::Icon &icon)
+{
+    if (hash.empty())
+    {
+        return;
+    }
+
+    // tokens with the same icon share it
+    auto statement = cachedStatement(InsertIcon);
+    statement << hash << icon;
+    statement++;
+}
+
+TokenVault::Error TokenVault::insertToken(const OTPToken &token)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    try {
+        // the token and its icon are written together
+        beginTransaction();
+
+        const auto hash = iconHash(token.icon());
+        auto statement = cachedStatement(InsertToken);
+        auto status = bindGenericTokenStatement(*statement, token, hash);
+        if (status != TokenDatabase::Success)
+        {
+            rollbackTransaction();
+            return status;
+        }
+
+        // append the new token to the end of the display order
+        statement << POSITION_STEP;
+        statement++;
+
+        storeIcon(hash, token.icon());
+        commitTransaction();
+    } catch (sqlite::sqlite_exception &e) {
+        rollbackTransaction();
+        return e.get_code() == SQLITE_CONSTRAINT ? TokenDatabase::SqlConstraintViolation : TokenDatabase::SqlExecutionFailed;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::insertTokens(const OTPTokenList &tokens, std::vector<Error> *errors)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    if (errors)
+    {
+        errors->assign(tokens.size(), TokenDatabase::Success);
+    }
+
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    Error result = TokenDatabase::Success;
+
+    try {
+        beginTransaction();
+
+        // the display order is read once, all tokens are appended to the end
+        OTPToken::sqliteSortOrder position = 0;
+        cachedStatement(SelectLastPosition) >> position;
+
+        auto statement = cachedStatement(InsertTokenAt);
+
+        for (std::size_t i = 0; i < tokens.size(); ++i)
+        {
+            Error status = TokenDatabase::Success;
+
+            try {
+                const auto hash = iconHash(tokens[i].icon());
+                status = bindGenericTokenStatement(*statement, tokens[i], hash);
+                if (status == TokenDatabase::Success)
+                {
+                    statement << (position + POSITION_STEP);
+                    statement++;
+                    position += POSITION_STEP;
+
+                    storeIcon(hash, tokens[i].icon());
+                }
+            } catch (sqlite::sqlite_exception &e) {
+                status = e.get_code() == SQLITE_CONSTRAINT ? TokenDatabase::SqlConstraintViolation : TokenDatabase::SqlExecutionFailed;
+            }
+
+            // skip the failed token and keep going, report the first error
+            if (status != TokenDatabase::Success)
+            {
+                if (errors)
+                {
+                    (*errors)[i] = status;
+                }
+                if (result == TokenDatabase::Success)
+                {
+                    result = status;
+                }
+            }
+        }
+
+        commitTransaction();
+    } catch (sqlite::sqlite_exception &) {
+        rollbackTransaction();
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    return result;
+}
+
+TokenVault::Error TokenVault::updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    return updateTokenLocked(id, token);
+}
+
+TokenVault::Error TokenVault::updateTokenLocked(const OTPToken::sqliteTokenID &id, const OTPToken &token)
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    try {
+        // the token and its icon are written together
+        beginTransaction();
+
+        const auto hash = iconHash(token.icon());
+        auto statement = cachedStatement(UpdateToken);
+        auto status = bindGenericTokenStatement(*statement, token, hash);
+        if (status != TokenDatabase::Success)
+        {
+            rollbackTransaction();
+            return status;
+        }
+
+        // the previous icon is removed by a trigger when no other token uses it
+        statement << id;
+        statement++;
+
+        storeIcon(hash, token.icon());
+        commitTransaction();
+    } catch (sqlite::sqlite_exception &e) {
+        rollbackTransaction();
+        return e.get_code() == SQLITE_CONSTRAINT ? TokenDatabase::SqlConstraintViolation : TokenDatabase::SqlExecutionFailed;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    auto token = selectTokenLocked(id);
+    if (token.id() == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    token.setLabel(label);
+
+    const auto status = updateTokenLocked(id, token);
+    if (status != TokenDatabase::Success || !this->_context->journal)
+    {
+        return status;
+    }
+
+    auto change = journalChange(JournalLabel, id);
+    change.append(label);
+    return appendJournal(change);
+}
+
+TokenVault::Error TokenVault::setCounter(const OTPToken::sqliteTokenID &id, const OTPToken::CounterType &counter)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    try {
+        auto statement = cachedStatement(UpdateCounter);
+        statement << counter << id;
+        statement++;
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    if (sqlite3_changes(this->_db->connection().get()) == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+    if (!this->_context->journal)
+    {
+        return TokenDatabase::Success;
+    }
+
+    auto change = journalChange(JournalCounter, id);
+    putInteger(change, counter);
+    return appendJournal(change);
+}
+
+TokenVault::Error TokenVault::deleteToken(const OTPToken::sqliteTokenID &id)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    try {
+        auto statement = cachedStatement(DeleteToken);
+        statement << id;
+        statement++;
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    return TokenDatabase::Success;
+}
+
+OTPToken::sqliteTokenID TokenVault::tokenCount(const OTPToken::sqliteTypesID &type) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    return tokenCountLocked(type);
+}
+
+OTPToken::sqliteTokenID TokenVault::tokenCountLocked(const OTPToken::sqliteTypesID &type) const
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    OTPToken::sqliteTokenID count = 0;
+
+    try {
+        cachedStatement(CountTokens) << static_cast<int>(type) >> count;
+    } catch (sqlite::sqlite_exception &) {
+        return -1;
+    }
+
+    return count;
+}
+
+TokenVault::Error TokenVault::swapTokens(const OTPToken &token1, const OTPToken &token2)
+{
+    return swapTokens(token1.label(), token2.label());
+}
+
+TokenVault::Error TokenVault::swapTokens(const OTPToken::Label &label1, const OTPToken::Label &label2)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    auto tokenId1 = tokenIdLocked(label1);
+    if (tokenId1 == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    auto tokenId2 = tokenIdLocked(label2);
+    if (tokenId2 == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    OTPToken::sqliteSortOrder pos1 = 0, pos2 = 0;
+    auto status = tokenPosition(tokenId1, pos1);
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+    status = tokenPosition(tokenId2, pos2);
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+
+    // both tokens move or none
+    try {
+        beginTransaction();
+        Context::Reordering reordering(*this->_context);
+        auto update = cachedStatement(UpdatePosition);
+        update << pos2 << tokenId1;
+        update++;
+        update << pos1 << tokenId2;
+        update++;
+        commitTransaction();
+    } catch (sqlite::sqlite_exception &) {
+        rollbackTransaction();
+        return TokenDatabase::SqlDisplayOrderUpdateFailed;
+    }
+
+    return this->_context->journal ? journalPositions({{tokenId1, pos2}, {tokenId2, pos1}}) : TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::moveToken(const OTPToken &token, const std::size_t &newPos)
+{
+    return moveToken(token.label(), newPos);
+}
+
+TokenVault::Error TokenVault::moveToken(const OTPToken::Label &token, const std::size_t &newPos)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    auto tokenId = tokenIdLocked(token);
+    if (tokenId == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    // find the token which currently is at the new position
+    OTPToken::sqliteTokenID anchorId = 0;
+
+    try {
+        cachedStatement(SelectTokenAtPosition) << static_cast<sqlite3_int64>(newPos) >> [&](const OTPToken::sqliteTokenID &id) {
+            anchorId = id;
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlDisplayOrderGetFailed;
+    }
+
+    // position is past the end, move the token to the end
+    if (anchorId == 0)
+    {
+        try {
+            Context::Reordering reordering(*this->_context);
+            auto statement = cachedStatement(MoveTokenToEnd);
+            statement << POSITION_STEP << tokenId;
+            statement++;
+        } catch (sqlite::sqlite_exception &) {
+            return TokenDatabase::SqlDisplayOrderUpdateFailed;
+        }
+
+        if (!this->_context->journal)
+        {
+            return TokenDatabase::Success;
+        }
+
+        OTPToken::sqliteSortOrder position = 0;
+        const auto status = tokenPosition(tokenId, position);
+        return status == TokenDatabase::Success ? journalPosition(tokenId, position) : status;
+    }
+
+    if (anchorId == tokenId)
+    {
+        return TokenDatabase::Success;
+    }
+
+    return placeToken(tokenId, anchorId, false);
+}
+
+TokenVault::Error TokenVault::moveTokenBelow(const OTPToken &token, const OTPToken &below)
+{
+    return moveTokenBelow(token.label(), below.label());
+}
+
+TokenVault::Error TokenVault::moveTokenBelow(const OTPToken::Label &token, const OTPToken::Label &below)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    auto tokenId1 = tokenIdLocked(token);
+    if (tokenId1 == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    auto tokenId2 = tokenIdLocked(below);
+    if (tokenId2 == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    return placeToken(tokenId1, tokenId2, true);
+}
+
+TokenVault::Error TokenVault::moveTokenAbove(const OTPToken &token, const OTPToken &above)
+{
+    return moveTokenAbove(token.label(), above.label());
+}
+
+TokenVault::Error TokenVault::moveTokenAbove(const OTPToken::Label &token, const OTPToken::Label &above)
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    auto tokenId1 = tokenIdLocked(token);
+    if (tokenId1 == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    auto tokenId2 = tokenIdLocked(above);
+    if (tokenId2 == 0)
+    {
+        return TokenDatabase::SqlEmptyResults;
+    }
+
+    return placeToken(tokenId1, tokenId2, false);
+}
+
+const std::string TokenVault::selectTokenTypeName(const OTPToken::sqliteTypesID &id) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return {};
+    }
+
+    std::string name;
+
+    try {
+        cachedStatement(SelectTypeName) << static_cast<int>(id) >> name;
+    } catch (sqlite::sqlite_exception &) {
+    }
+
+    return name;
+}
+
+const std::string TokenVault::selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id) const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return {};
+    }
+
+    std::string name;
+
+    try {
+        cachedStatement(SelectAlgorithmName) << static_cast<int>(id) >> name;
+    } catch (sqlite::sqlite_exception &) {
+    }
+
+    return name;
+}
+
+TokenVault::Error TokenVault::bootstrapDatabase()
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    // create tables to store types and algorithms
+    for (auto&& table : {"types", "algorithms"})
+    {
+        auto res = createTable(table, {
+            {"id",   "int(1) PRIMARY KEY NOT NULL"},
+            {"name", "text UNIQUE"},
+        });
+        if (res != TokenDatabase::Success)
+        {
+            return res;
+        }
+    }
+
+    // insert static types
+    auto res = insertStaticValues("types", {
+        {OTPToken::TOTP,  "TOTP"},
+        {OTPToken::HOTP,  "HOTP"},
+        {OTPToken::Steam, "Steam"},
+    });
+    if (res != TokenDatabase::Success)
+    {
+        return res;
+    }
+
+    // insert static algorithms
+    res = insertStaticValues("algorithms", {
+        {OTPToken::SHA1,   "SHA1"},
+        {OTPToken::SHA256, "SHA256"},
+        {OTPToken::SHA512, "SHA512"},
+    });
+    if (res != TokenDatabase::Success)
+    {
+        return res;
+    }
+
+    // create config table
+    res = createTable("config", {
+        {"id",   "text PRIMARY KEY NOT NULL"},
+        {"data", "blob"},
+    });
+    if (res != TokenDatabase::Success)
+    {
+        return res;
+    }
+
+    // store database version into config
+    res = storeDatabaseVersion();
+    if (res != TokenDatabase::Success)
+    {
+        return res;
+    }
+
+    // create table to store the tokens
+    res = createTokensTable();
+    if (res != TokenDatabase::Success)
+    {
+        return res;
+    }
+
+    // create table to store the icons
+    return createIconsTable();
+}
+
+TokenVault::Error TokenVault::createTokensTable()
+{
+    auto res = createTable("tokens", {
+        {"id",        "INTEGER PRIMARY KEY NOT NULL"},
+        {"type",      "int(1) NOT NULL"},
+        {"label",     "text NOT NULL UNIQUE COLLATE NOCASE"},
+        {"icon",      "blob"},
+        {"secret",    "text NOT NULL"},
+        {"digits",    "INTEGER NOT NULL DEFAULT 0"},
+        {"period",    "INTEGER NOT NULL DEFAULT 0"},
+        {"counter",   "INTEGER NOT NULL DEFAULT 0"},
+        {"algorithm", "int(1) NOT NULL"},
+        {"position",  "INTEGER NOT NULL DEFAULT 0"},
+    },
+        "FOREIGN KEY(type) REFERENCES types(id), "
+        "FOREIGN KEY(algorithm) REFERENCES algorithms(id)");
+    if (res != TokenDatabase::Success)
+    {
+        return res;
+    }
+
+    // index the display order
+    try {
+        (*this->_db) << sanitizeQuery("create index %Q on %Q (position);", "tokens_position", "tokens");
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlSystemTableCreationError;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::createIconsTable()
+{
+    auto res = createTable("icons", {
+        {"hash", "blob PRIMARY KEY NOT NULL"},
+        {"data", "blob NOT NULL"},
+    });
+    if (res != TokenDatabase::Success)
+    {
+        return res;
+    }
+
+    // remove icons which are no longer used by any token
+    try {
+        (*this->_db) << sanitizeQuery("create index %Q on %Q (icon);", "tokens_icon", "tokens");
+        const auto cleanup = "delete from icons where hash = old.icon and not exists (select 1 from tokens where icon = old.icon);";
+        (*this->_db) << sanitizeQuery("create trigger %Q after delete on %Q when old.icon is not null begin %s end;",
+                                      "tokens_icon_delete", "tokens", cleanup);
+        (*this->_db) << sanitizeQuery("create trigger %Q after update of icon on %Q when old.icon is not null begin %s end;",
+                                      "tokens_icon_update", "tokens", cleanup);
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlSystemTableCreationError;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::createTable(const std::string &table_name, const std::vector<SchemaField> &schema, const std::string &additional)
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    // sanitize table name
+    auto query = sanitizeQuery("create table %Q ", table_name.c_str());
+
+    // prepare schema
+    query += "(";
+    for (auto&& s : schema)
+    {
+        query += sanitizeQuery("%Q %s, ", s.name.c_str(), s.datatype.c_str());
+    }
+    query.erase(query.find_last_of(','));
+
+    // add additional content to query
+    if (!additional.empty())
+    {
+        query += ", " + additional;
+    }
+
+    // finalize query
+    query += ");";
+
+    // execute query
+    try {
+        (*this->_db) << query;
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlSystemTableCreationError;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::insertStaticValues(const std::string &table_name, const std::vector<StaticValueSet> &values)
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    // sanitize table name
+    auto query = sanitizeQuery("insert into %Q ", table_name.c_str());
+
+    // prepare values
+    query += "values ";
+    for (auto&& v : values)
+    {
+        query += sanitizeQuery("(%u, %Q), ", v.id, v.value.c_str());
+    }
+    query.erase(query.find_last_of(','));
+
+    // finalize query
+    query += ";";
+
+    // execute query
+    try {
+        (*this->_db) << query;
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlStaticRecordCreationError;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::tokenPosition(const OTPToken::sqliteTokenID &id, OTPToken::sqliteSortOrder &position)
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    try {
+        cachedStatement(SelectPosition) << id >> position;
+    } catch (sqlite::errors::no_rows &) {
+        return TokenDatabase::SqlEmptyResults;
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlDisplayOrderGetFailed;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::setTokenPosition(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteSortOrder &position)
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    try {
+        Context::Reordering reordering(*this->_context);
+        auto statement = cachedStatement(UpdatePosition);
+        statement << position << id;
+        statement++;
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlDisplayOrderUpdateFailed;
+    }
+
+    return this->_context->journal ? journalPosition(id, position) : TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::placeToken(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteTokenID &anchor, const bool &below)
+{
+    if (id == anchor)
+    {
+        return TokenDatabase::Success;
+    }
+
+    // a second attempt is made after renumbering when there is no gap left
+    for (auto attempt = 0; attempt < 2; ++attempt)
+    {
+        OTPToken::sqliteSortOrder anchorPos = 0;
+        auto status = tokenPosition(anchor, anchorPos);
+        if (status != TokenDatabase::Success)
+        {
+            return status;
+        }
+
+        // find the neighbor on the other side of the anchor, ignoring the token itself
+        std::unique_ptr<OTPToken::sqliteSortOrder> neighborPos;
+
+        try {
+            cachedStatement(below ? SelectNextPosition : SelectPreviousPosition) << anchorPos << id >> [&](std::unique_ptr<OTPToken::sqliteSortOrder> position) {
+                neighborPos = std::move(position);
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return TokenDatabase::SqlDisplayOrderGetFailed;
+        }
+
+        // first or last token, no neighbor
+        if (!neighborPos)
+        {
+            return setTokenPosition(id, below ? anchorPos + POSITION_STEP : anchorPos - POSITION_STEP);
+        }
+
+        const auto gap = below ? *neighborPos - anchorPos : anchorPos - *neighborPos;
+        if (gap > 1)
+        {
+            return setTokenPosition(id, below ? anchorPos + gap / 2 : anchorPos - gap / 2);
+        }
+
+        status = renumberPositions();
+        if (status != TokenDatabase::Success)
+        {
+            return status;
+        }
+    }
+
+    return TokenDatabase::SqlDisplayOrderUpdateFailed;
+}
+
+TokenVault::Error TokenVault::renumberPositions()
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    // spread out all positions evenly, keeps the current order
+    PositionList positions;
+    try {
+        OTPToken::sqliteSortOrder position = 0;
+        cachedStatement(SelectDisplayOrder) >> [&](const OTPToken::sqliteTokenID &id) {
+            position += POSITION_STEP;
+            positions.emplace_back(id, position);
+        };
+
+        beginTransaction();
+        Context::Reordering reordering(*this->_context);
+        auto update = cachedStatement(UpdatePosition);
+
+        for (auto&& entry : positions)
+        {
+            update << entry.second << entry.first;
+            update++;
+        }
+        commitTransaction();
+    } catch (sqlite::sqlite_exception &) {
+        rollbackTransaction();
+        return TokenDatabase::SqlDisplayOrderUpdateFailed;
+    }
+
+    // journaled once the new positions are committed
+    return this->_context->journal ? journalPositions(positions) : TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::migrateDatabase(const std::uint32_t &version)
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    if (version < DATABASE_VERSION_POSITION)
+    {
+        // move the display order from the serialized config blob into an indexed column
+        try {
+            DisplayOrder order;
+            (*this->_db) << sanitizeQuery("select %s from %Q where %s = %Q limit 1;", "data", "config", "id", "order")
+                  >> [&](const DisplayOrder &data) {
+                order = data;
+            };
+
+            beginTransaction();
+            (*this->_db) << sanitizeQuery("alter table %Q add column position INTEGER NOT NULL DEFAULT 0;", "tokens");
+            (*this->_db) << sanitizeQuery("create index %Q on %Q (position);", "tokens_position", "tokens");
+
+            // tokens missing from the old display order stay in front
+            auto update = (*this->_db) << sanitizeQuery("update %Q set position = ? where id = ?;", "tokens");
+            OTPToken::sqliteSortOrder position = 0;
+            for (auto&& id : order)
+            {
+                position += POSITION_STEP;
+                update << position << id;
+                update++;
+            }
+
+            (*this->_db) << sanitizeQuery("delete from %Q where %s = %Q;", "config", "id", "order");
+            commitTransaction();
+        } catch (sqlite::sqlite_exception &) {
+            rollbackTransaction();
+            return TokenDatabase::SqlSchemaValidationFailed;
+        }
+
+        // make all positions unique
+        auto status = renumberPositions();
+        if (status != TokenDatabase::Success)
+        {
+            return status;
+        }
+    }
+
+    if (version < DATABASE_VERSION_INTEGERS)
+    {
+        // digits, period and counter were BLOBs of one-element vectors,
+        // the type of a column can't be changed so the table is rebuilt
+        try {
+            beginTransaction();
+            (*this->_db) << sanitizeQuery("alter table %Q rename to %Q;", "tokens", "tokens_old");
+            (*this->_db) << sanitizeQuery("drop index %Q;", "tokens_position");
+
+            if (createTokensTable() != TokenDatabase::Success)
+            {
+                rollbackTransaction();
+                return TokenDatabase::SqlSchemaValidationFailed;
+            }
+
+            (*this->_db) << sanitizeQuery("insert into %Q (id, type, label, icon, secret, algorithm, position) "
+                                          "select id, type, label, icon, secret, algorithm, position from %Q;", "tokens", "tokens_old");
+
+            auto update = (*this->_db) << sanitizeQuery("update %Q set digits = ?, period = ?, counter = ? where id = ?;", "tokens");
+            (*this->_db) << sanitizeQuery("select id, digits, period, counter from %Q;", "tokens_old")
+                  >> [&](const OTPToken::sqliteTokenID &id,
+                         const std::vector<OTPToken::DigitType> &digits,
+                         const std::vector<OTPToken::PeriodType> &period,
+                         const std::vector<OTPToken::CounterType> &counter)
+            {
+                update << (digits.empty() ? 0U : digits.at(0))
+                       << (period.empty() ? 0U : period.at(0))
+                       << (counter.empty() ? 0U : counter.at(0))
+                       << id;
+                update++;
+            };
+
+            (*this->_db) << sanitizeQuery("drop table %Q;", "tokens_old");
+            commitTransaction();
+        } catch (sqlite::sqlite_exception &) {
+            rollbackTransaction();
+            return TokenDatabase::SqlSchemaValidationFailed;
+        }
+    }
+
+    if (version < DATABASE_VERSION_ICONS)
+    {
+        // icons were stored in the tokens table, move them into
+        // the icons table and reference them by their hash
+        try {
+            beginTransaction();
+            if (createIconsTable() != TokenDatabase::Success)
+            {
+                rollbackTransaction();
+                return TokenDatabase::SqlSchemaValidationFailed;
+            }
+
+            std::vector<OTPToken::sqliteTokenID> ids;
+            (*this->_db) << sanitizeQuery("select id from %Q where length(icon) > 0;", "tokens")
+                  >> [&](const OTPToken::sqliteTokenID &id) {
+                ids.emplace_back(id);
+            };
+
+            auto update = (*this->_db) << sanitizeQuery("update %Q set icon = ? where id = ?;", "tokens");
+            for (auto&& id : ids)
+            {
+                OTPToken::Icon icon;
+                (*this->_db) << sanitizeQuery("select icon from %Q where id = ?;", "tokens") << id
+                      >> [&](const OTPToken::Icon &data) {
+                    icon = data;
+                };
+
+                const auto hash = iconHash(icon);
+                storeIcon(hash, icon);
+                update << hash << id;
+                update++;
+            }
+
+            (*this->_db) << sanitizeQuery("update %Q set icon = null where length(icon) = 0;", "tokens");
+            commitTransaction();
+        } catch (sqlite::sqlite_exception &) {
+            rollbackTransaction();
+            return TokenDatabase::SqlSchemaValidationFailed;
+        }
+    }
+
+    // store the new database version
+    const auto statement = sanitizeQuery("update %Q set %s=? where %s = %Q;", "config", "data", "id", "database");
+
+    try {
+        (*this->_db) << statement << std::vector<std::uint32_t>{DATABASE_VERSION};
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::storeDatabaseVersion()
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    // prepare statement
+    const auto statement = sanitizeQuery("insert into %Q values (?, ?);",
+                                         "config");
+
+    try {
+        (*this->_db) << statement << "database" << std::vector<std::uint32_t>{DATABASE_VERSION};
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::getDatabaseVersion(std::uint32_t &version)
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    // prepare statement
+    const auto statement = sanitizeQuery("select %s from %Q where %s = %Q limit 1;",
+                                         "data", "config", "id", "database");
+
+    std::vector<std::uint32_t> data;
+
+    try {
+        (*this->_db) << statement >> data;
+    } catch (sqlite::sqlite_exception &) {
+        return TokenDatabase::SqlExecutionFailed;
+    }
+
+    if (data.empty())
+    {
+        // assume user manipulation when this field is empty or
+        // doesn't contain a serialized std::vector<>
+        return TokenDatabase::SqlSchemaValidationFailed;
+    }
+
+    // the database version is the first element
+    version = data.at(0);
+
+    return TokenDatabase::Success;
+}
+
+unsigned char *TokenVault::serializeDatabase(std::size_t &size, bool &owned)
+{
+    // database must be open
+    sqlite3_int64 length = 0;
+
+    // deserialized databases are contiguous in memory, use them without a copy
+    auto data = sqlite3_serialize(this->_db->connection().get(), "main", &length, SQLITE_SERIALIZE_NOCOPY);
+    owned = false;
+
+    if (!data)
+    {
+        data = sqlite3_serialize(this->_db->connection().get(), "main", &length, 0);
+        owned = true;
+    }
+
+    if (!data)
+    {
+        size = 0;
+        owned = false;
+        return nullptr;
+    }
+
+    size = static_cast<std::size_t>(length);
+    return data;
+}
+
+bool TokenVault::deserializeDatabase(unsigned char *data, const std::size_t &size, const std::size_t &capacity)
+{
+    if (!data || size == 0)
+    {
+        sqlite3_free(data);
+        return false;
+    }
+
+    // cached statements and labels belong to the old database
+    this->_context->clearStatements();
+    this->_context->clearLabels();
+    this->_context->reset();
+
+    // sqlite takes ownership of the buffer and may grow it when tokens are added
+    // empty database must be open
+    auto rc = sqlite3_deserialize(this->_db->connection().get(), "main", data,
+                                  static_cast<sqlite3_int64>(size),
+                                  static_cast<sqlite3_int64>(capacity),
+                                  SQLITE_DESERIALIZE_FREEONCLOSE | SQLITE_DESERIALIZE_RESIZEABLE);
+    if (rc)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+TokenVault::Error TokenVault::validateSchema()
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    const auto pragma = "pragma table_info(%Q)";
+
+    // newer SQLite versions report the declared type in upper case
+    const auto isType = [](const std::string &type, const std::string &expected) {
+        return type.size() == expected.size() &&
+               std::equal(type.begin(), type.end(), expected.begin(), [](char a, char b) {
+                   return std::tolower(static_cast<unsigned char>(a)) == std::tolower(static_cast<unsigned char>(b));
+               });
+    };
+
+#define SQLITE_PRAGMA_ARGLIST \
+    const sqlite3_int64 &/*cid*/, \
+    const std::string &name, \
+    const std::string &type, \
+    const bool &notnull, \
+    const std::string &dflt_value, \
+    const bool &pk
+
+    const auto verifyStatics = [&](const std::string &table) {
+        const auto statement = sanitizeQuery(pragma, table.c_str());
+
+        bool validId = false, validName = false;
+
+        try {
+            (*this->_db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (isType(type, "int(1)") && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "name")
+                {
+                    validName = (isType(type, "text") && !notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId && validName;
+    };
+
+    const auto verifyConfig = [&] {
+        const auto statement = sanitizeQuery(pragma, "config");
+
+        bool validId = false, validData = false;
+
+        try {
+            (*this->_db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (isType(type, "text") && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "data")
+                {
+                    validData = (isType(type, "blob") && !notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId && validData;
+    };
+
+    const auto verifyTokens = [&] {
+        const auto statement = sanitizeQuery(pragma, "tokens");
+
+        bool validId = false,
+             validType = false,
+             validLabel = false,
+             validIcon = false,
+             validSecret = false,
+             validDigits = false,
+             validPeriod = false,
+             validCounter = false,
+             validAlgorithm = false,
+             validPosition = false;
+
+        try {
+            (*this->_db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "id")
+                {
+                    validId = (isType(type, "INTEGER") && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "type")
+                {
+                    validType = (isType(type, "int(1)") && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "label")
+                {
+                    validLabel = (isType(type, "text") && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "icon")
+                {
+                    validIcon = (isType(type, "blob") && !notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "secret")
+                {
+                    validSecret = (isType(type, "text") && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "digits")
+                {
+                    validDigits = (isType(type, "INTEGER") && notnull && dflt_value == "0" && !pk);
+                }
+                else if (name == "period")
+                {
+                    validPeriod = (isType(type, "INTEGER") && notnull && dflt_value == "0" && !pk);
+                }
+                else if (name == "counter")
+                {
+                    validCounter = (isType(type, "INTEGER") && notnull && dflt_value == "0" && !pk);
+                }
+                else if (name == "algorithm")
+                {
+                    validAlgorithm = (isType(type, "int(1)") && notnull && dflt_value.empty() && !pk);
+                }
+                else if (name == "position")
+                {
+                    validPosition = (isType(type, "INTEGER") && notnull && dflt_value == "0" && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validId &&
+               validType &&
+               validLabel &&
+               validIcon &&
+               validSecret &&
+               validDigits &&
+               validPeriod &&
+               validCounter &&
+               validAlgorithm &&
+               validPosition;
+    };
+
+    const auto verifyIcons = [&] {
+        const auto statement = sanitizeQuery(pragma, "icons");
+
+        bool validHash = false, validData = false;
+
+        try {
+            (*this->_db) << statement >> [&](SQLITE_PRAGMA_ARGLIST)
+            {
+                if (name == "hash")
+                {
+                    validHash = (isType(type, "blob") && notnull && dflt_value.empty() && pk);
+                }
+                else if (name == "data")
+                {
+                    validData = (isType(type, "blob") && notnull && dflt_value.empty() && !pk);
+                }
+            };
+        } catch (sqlite::sqlite_exception &) {
+            return false;
+        }
+
+        return validHash && validData;
+    };
+
+    auto ret = verifyStatics("types");
+    if (!ret) return TokenDatabase::SqlSchemaValidationFailed;
+
+    ret = verifyStatics("algorithms");
+    if (!ret) return TokenDatabase::SqlSchemaValidationFailed;
+
+    ret = verifyConfig();
+    if (!ret) return TokenDatabase::SqlSchemaValidationFailed;
+
+    ret = verifyTokens();
+    if (!ret) return TokenDatabase::SqlSchemaValidationFailed;
+
+    ret = verifyIcons();
+    if (!ret) return TokenDatabase::SqlSchemaValidationFailed;
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::initializeTokens()
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    Error status = TokenDatabase::Success;
+
+    if (this->_format == TokenDatabase::EncryptedPages)
+    {
+        // create a new encrypted database file
+        closeDatabaseLocked();
+        std::remove(this->_path.c_str());
+        std::remove((this->_path + "-journal").c_str());
+        status = openPagedDatabase(this->_path);
+    }
+    else
+    {
+        // allocate a new sqlite database in-memory
+        status = initDatabaseLocked();
+    }
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+
+    // bootstrap a new database from the built-in schema
+    status = bootstrapDatabase();
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+
+    // write to disk
+    status = saveTokensLocked();
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::saveTokens()
+{
+    {
+        // the in-memory database is only read while it is encrypted,
+        // queries keep running during the save
+        std::shared_lock<std::shared_mutex> lock(this->_mutex);
+        if (this->_status && !this->_paged && this->_format == TokenDatabase::Container)
+        {
+            std::lock_guard<std::mutex> save_lock(this->_context->save_mutex);
+            return saveTokensLocked();
+        }
+    }
+
+    // committing or converting the database modifies the connection
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    return saveTokensLocked();
+}
+
+TokenVault::Error TokenVault::saveTokensLocked()
+{
+    // check if the database is open
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    // commit the pending changes, only the changed pages are written
+    if (this->_paged)
+    {
+        try {
+            (*this->_db) << "commit;";
+            (*this->_db) << "begin;";
+        } catch (sqlite::sqlite_exception &) {
+            return TokenDatabase::FileWriteFailure;
+        }
+        return TokenDatabase::Success;
+    }
+
+    // move the in-memory database into a new encrypted database file
+    if (this->_format == TokenDatabase::EncryptedPages)
+    {
+        const auto status = writePagedDatabase();
+        if (status == TokenDatabase::Success)
+        {
+            removeJournal();
+        }
+        return status;
+    }
+
+    // serialize the sqlite database
+    std::size_t size = 0;
+    bool owned = false;
+    auto data = serializeDatabase(size, owned);
+    if (!data)
+    {
+        return TokenDatabase::SqlSerializationError;
+    }
+
+    // encrypt the database directly into the file, the journal is part of it now
+    auto status = encryptDatabaseFile(this->_password, data, size, this->_path);
+    if (owned)
+    {
+        sqlite3_free(data);
+    }
+    if (status == TokenDatabase::Success)
+    {
+        removeJournal();
+    }
+    return status;
+}
+
+TokenVault::Error TokenVault::writePagedDatabase()
+{
+    if (!this->_status)
+    {
+        return TokenDatabase::SqlDatabaseNotOpen;
+    }
+
+    if (!EncryptedVFS::registerVFS())
+    {
+        return TokenDatabase::SqlMemoryAllocationError;
+    }
+
+    // copy the database into a new file and replace the database afterwards
+    const auto temp_file = this->_path + ".tmp";
+    std::remove(temp_file.c_str());
+    std::remove((temp_file + "-journal").c_str());
+    EncryptedVFS::setPassword(temp_file, this->_password);
+
+    auto rc = SQLITE_ERROR;
+    try {
+        sqlite::sqlite_config config;
+        config.zVfs = EncryptedVFS::name;
+        sqlite::database target(temp_file, config);
+        target << "pragma temp_store = memory;";
+        target << "pragma page_size = " + std::to_string(EncryptedVFS::pageSize) + ";";
+
+        // includes the pending changes of the current connection
+        auto backup = sqlite3_backup_init(target.connection().get(), "main", this->_db->connection().get(), "main");
+        if (backup)
+        {
+            rc = sqlite3_backup_step(backup, -1);
+            sqlite3_backup_finish(backup);
+        }
+    } catch (sqlite::sqlite_exception &) {
+        rc = SQLITE_ERROR;
+    }
+    EncryptedVFS::removePassword(temp_file);
+
+    if (rc != SQLITE_DONE)
+    {
+        std::remove(temp_file.c_str());
+        std::remove((temp_file + "-journal").c_str());
+        return TokenDatabase::FileWriteFailure;
+    }
+
+    // the connection stays open until the copy replaced the file, a failed save keeps the session
+    if (!DurableFile::sync(temp_file))
+    {
+        std::remove(temp_file.c_str());
+        return TokenDatabase::FileWriteFailure;
+    }
+    if (!DurableFile::rename(temp_file, this->_path))
+    {
+        if (!this->_paged)
+        {
+            std::remove(temp_file.c_str());
+            return TokenDatabase::FileWriteFailure;
+        }
+
+        // the open database file can't be replaced on some platforms, the old file is kept
+        closeDatabaseLocked();
+        if (!DurableFile::rename(temp_file, this->_path))
+        {
+            // the pending changes were discarded with the connection, the copy has all of them
+            const auto status = openPagedDatabase(temp_file);
+            return status == TokenDatabase::Success ? TokenDatabase::FileWriteFailure : status;
+        }
+    }
+
+    // persist the rename
+    (void) DurableFile::sync(DurableFile::directoryOf(this->_path));
+    return openPagedDatabase(this->_path);
+}
+
+TokenVault::Error TokenVault::loadTokens()
+{
+    std::unique_lock<std::shared_mutex> lock(this->_mutex);
+    Error status = TokenDatabase::Success;
+
+    // the difference to the tokens loaded before is recorded as changes,
+    // instead of starting the change log over
+    Context::TokenDigests before;
+    auto log = this->_context->change_log;
+    const auto compare = this->_status && Context::tokenDigests(*this->_db, before);
+
+    if (EncryptedVFS::isEncryptedFile(this->_path))
+    {
+        // work directly on the encrypted database file, unsaved changes are discarded
+        status = openPagedDatabase(this->_path);
+        if (status != TokenDatabase::Success)
+        {
+            return status;
+        }
+    }
+    else
+    {
+        // decrypt the file into memory allocated by sqlite
+        unsigned char *data = nullptr;
+        std::size_t size = 0, capacity = 0;
+        status = decryptDatabaseFile(this->_password, this->_path, data, size, capacity);
+        if (status != TokenDatabase::Success)
+        {
+            return status;
+        }
+
+        // allocate memory for a database, if not yet initialized
+        if (!this->_status || this->_paged)
+        {
+            status = initDatabaseLocked();
+            if (status != TokenDatabase::Success)
+            {
+                sqlite3_free(data);
+                return status;
+            }
+        }
+
+        // deserialize the sqlite database, takes ownership of the buffer
+        auto ret = deserializeDatabase(data, size, capacity);
+        if (!ret)
+        {
+            return TokenDatabase::SqlDeserializationError;
+        }
+    }
+
+    // perform a query in this function to avoid failure later
+    // FIXME: still couldn't figure out why this happens, but
+    // it works after the first execution in the same function
+    std::uint32_t version = 0;
+    (void) getDatabaseVersion(version);
+
+    // upgrade databases created by older versions
+    status = getDatabaseVersion(version);
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+    if (version < DATABASE_VERSION)
+    {
+        status = migrateDatabase(version);
+        if (status != TokenDatabase::Success)
+        {
+            return status;
+        }
+    }
+
+    // validate the schema of the database
+    status = validateSchema();
+    if (status != TokenDatabase::Success)
+    {
+        return status;
+    }
+
+    // apply the changes which were journaled since the file was saved
+    if (!this->_paged)
+    {
+        status = replayJournal();
+        if (status != TokenDatabase::Success)
+        {
+            return status;
+        }
+    }
+
+    Context::TokenDigests after;
+    if (compare && Context::tokenDigests(*this->_db, after))
+    {
+        this->_context->change_log = std::move(log);
+        this->_context->recordDifference(before, after);
+    }
+
+    return TokenDatabase::Success;
+}
+
+const TokenVault::DisplayOrder TokenVault::displayOrder() const
+{
+    std::shared_lock<std::shared_mutex> lock(this->_mutex);
+    if (!this->_status)
+    {
+        return {};
+    }
+
+    DisplayOrder order;
+
+    try {
+        cachedStatement(SelectDisplayOrder) >> [&](const OTPToken::sqliteTokenID &id) {
+            order.emplace_back(id);
+        };
+    } catch (sqlite::sqlite_exception &) {
+        return {};
+    }
+
+    return order;
+}
+
+TokenVault::Error TokenVault::encryptDatabaseFile(const std::string &password,
+                                                        const unsigned char *data, const std::size_t &size, const std::string &file)
+{
+    // write into a temporary file first and replace the database afterwards,
+    // a failure during writing never leaves a truncated database behind
+    const auto temp_file = file + ".tmp";
+    ContainerHeader header;
+
+    try {
+        std::ofstream stream(temp_file, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+        if (!stream)
+        {
+            return TokenDatabase::FileWriteFailure;
+        }
+
+        // reuse the salt and key of the current session, a fresh nonce is used for every save
+        CryptoPP::AutoSeededRandomPool rng;
+        header.size = size;
+        if (this->_context->session_key.empty() || this->_context->session_password != password)
+        {
+            rng.GenerateBlock(header.salt.data(), header.salt.size());
+        }
+        else
+        {
+            header.salt = this->_context->session_salt;
+        }
+        rng.GenerateBlock(header.nonce.data(), header.nonce.size());
+
+        const auto &key = this->_context->sessionKey(password, header.salt);
+
+        unsigned char header_data[CONTAINER_HEADER_SIZE];
+        header.write(header_data);
+        stream.write(reinterpret_cast<const char*>(header_data), CONTAINER_HEADER_SIZE);
+
+        // encrypt a batch of segments in parallel and write it in one go,
+        // only the last segment of the database can be shorter than the segment size
+        const auto segments = header.segmentCount();
+        const auto batch = std::min(segments, segmentBatchSize());
+        const auto stride = header.segment_size + CONTAINER_TAG_SIZE;
+        std::vector<unsigned char> buffer(batch * stride);
+
+        for (std::size_t first = 0; first < segments && stream; first += batch)
+        {
+            const auto count = std::min(batch, segments - first);
+            std::atomic<bool> failed{false};
+
+            parallelFor(count, [&](const std::size_t &i) {
+                const auto segment = first + i;
+                const auto offset = segment * header.segment_size;
+                const auto length = std::min<std::size_t>(header.segment_size, size - offset);
+                auto out = buffer.data() + i * stride;
+
+                try {
+                    unsigned char iv[CONTAINER_IV_SIZE];
+                    header.iv(segment, iv);
+
+                    CryptoPP::GCM<CryptoPP::AES>::Encryption gcm;
+                    gcm.SetKeyWithIV(key, key.size(), iv, sizeof(iv));
+                    gcm.EncryptAndAuthenticate(out, out + length, CONTAINER_TAG_SIZE, iv, sizeof(iv),
+                                               header_data, CONTAINER_HEADER_SIZE, data + offset, length);
+                } catch (...) {
+                    failed = true;
+                }
+            });
+
+            if (failed)
+            {
+                stream.close();
+                std::remove(temp_file.c_str());
+                return TokenDatabase::EncryptionFailure;
+            }
+
+            const auto last = first + count - 1;
+            const auto last_length = std::min<std::size_t>(header.segment_size, size - last * header.segment_size);
+            stream.write(reinterpret_cast<const char*>(buffer.data()),
+                         static_cast<std::streamsize>((count - 1) * stride + last_length + CONTAINER_TAG_SIZE));
+        }
+
+        stream.close();
+        if (!stream)
+        {
+            std::remove(temp_file.c_str());
+            return TokenDatabase::FileWriteFailure;
+        }
+    } catch (...) {
+        std::remove(temp_file.c_str());
+        return TokenDatabase::EncryptionFailure;
+    }
+
+    if (!DurableFile::replace(temp_file, file))
+    {
+        return TokenDatabase::FileWriteFailure;
+    }
+
+    // journals of the previous file no longer apply
+    this->_context->bindJournal(header.salt, header.nonce);
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::decryptDatabaseFile(const std::string &password, const std::string &file,
+                                                        unsigned char *&data, std::size_t &size, std::size_t &capacity)
+{
+    data = nullptr;
+    size = 0;
+    capacity = 0;
+
+    std::ifstream stream(file, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    if (!stream)
+    {
+        return TokenDatabase::FileReadFailure;
+    }
+
+    const auto stream_size = stream.tellg();
+    stream.seekg(0, std::ios::beg);
+    if (stream_size < 0)
+    {
+        return TokenDatabase::FileReadFailure;
+    }
+    if (stream_size == 0)
+    {
+        return TokenDatabase::FileEmpty;
+    }
+
+    // files without a container header were written by older versions
+    unsigned char header_data[CONTAINER_HEADER_SIZE];
+    ContainerHeader header;
+    if (static_cast<std::size_t>(stream_size) < CONTAINER_HEADER_SIZE ||
+        !stream.read(reinterpret_cast<char*>(header_data), CONTAINER_HEADER_SIZE) ||
+        !header.read(header_data))
+    {
+        stream.close();
+        this->_context->unbindJournal();
+        return decryptLegacyDatabaseFile(password, file, data, size, capacity);
+    }
+
+    // reject truncated or extended files before allocating anything
+    const auto segments = header.segmentCount();
+    if (static_cast<std::uint64_t>(stream_size) != CONTAINER_HEADER_SIZE + header.size + segments * CONTAINER_TAG_SIZE ||
+        header.size > std::numeric_limits<std::size_t>::max())
+    {
+        return TokenDatabase::InvalidTokenFile;
+    }
+
+    capacity = static_cast<std::size_t>(header.size);
+    data = static_cast<unsigned char*>(sqlite3_malloc64(capacity));
+    if (!data)
+    {
+        capacity = 0;
+        return TokenDatabase::SqlMemoryAllocationError;
+    }
+
+    const auto fail = [&](const Error &error) {
+        sqlite3_free(data);
+        data = nullptr;
+        capacity = 0;
+        return error;
+    };
+
+    try {
+        const auto &key = this->_context->sessionKey(password, header.salt);
+
+        // read a batch of segments and decrypt it in parallel straight into the database buffer
+        const auto batch = std::min(segments, segmentBatchSize());
+        const auto stride = header.segment_size + CONTAINER_TAG_SIZE;
+        std::vector<unsigned char> buffer(batch * stride);
+
+        for (std::size_t first = 0; first < segments; first += batch)
+        {
+            const auto count = std::min(batch, segments - first);
+            const auto last = first + count - 1;
+            const auto last_length = std::min<std::size_t>(header.segment_size, capacity - last * header.segment_size);
+            if (!stream.read(reinterpret_cast<char*>(buffer.data()),
+                             static_cast<std::streamsize>((count - 1) * stride + last_length + CONTAINER_TAG_SIZE)))
+            {
+                return fail(TokenDatabase::FileReadFailure);
+            }
+
+            std::atomic<bool> failed{false};
+            parallelFor(count, [&](const std::size_t &i) {
+                const auto segment = first + i;
+                const auto offset = segment * header.segment_size;
+                const auto length = std::min<std::size_t>(header.segment_size, capacity - offset);
+                const auto in = buffer.data() + i * stride;
+
+                try {
+                    unsigned char iv[CONTAINER_IV_SIZE];
+                    header.iv(segment, iv);
+
+                    CryptoPP::GCM<CryptoPP::AES>::Decryption gcm;
+                    gcm.SetKeyWithIV(key, key.size(), iv, sizeof(iv));
+                    if (!gcm.DecryptAndVerify(data + offset, in + length, CONTAINER_TAG_SIZE, iv, sizeof(iv),
+                                              header_data, CONTAINER_HEADER_SIZE, in, length))
+                    {
+                        failed = true;
+                    }
+                } catch (...) {
+                    failed = true;
+                }
+            });
+
+            if (failed)
+            {
+                return fail(TokenDatabase::InvalidCiphertext);
+            }
+        }
+    } catch (...) {
+        return fail(TokenDatabase::DecryptionFailure);
+    }
+
+    this->_context->bindJournal(header.salt, header.nonce);
+    size = capacity;
+    return TokenDatabase::Success;
+}
+
+TokenVault::Error TokenVault::decryptLegacyDatabaseFile(const std::string &password, const std::string &file,
+                                                              unsigned char *&data, std::size_t &size, std::size_t &capacity)
+{
+    data = nullptr;
+    size = 0;
+    capacity = 0;
+
+    std::ifstream stream(file, std::ios_base::in | std::ios_base::binary | std::ios_base::ate);
+    if (!stream)
+    {
+        return TokenDatabase::FileReadFailure;
+    }
+
+    const auto stream_size = stream.tellg();
+    stream.seekg(0, std::ios::beg);
+    if (stream_size <= 0)
+    {
+        return TokenDatabase::FileReadFailure;
+    }
+
+    // the plaintext is never larger than the ciphertext
+    capacity = static_cast<std::size_t>(stream_size);
+    data = static_cast<unsigned char*>(sqlite3_malloc64(capacity));
+    if (!data)
+    {
+        capacity = 0;
+        return TokenDatabase::SqlMemoryAllocationError;
+    }
+
+    try {
+        CryptoPP::SecByteBlock key(CryptoPP::AES::MAX_KEYLENGTH + CryptoPP::AES::BLOCKSIZE);
+        CryptoPP::HKDF<CryptoPP::SHA256> hkdf;
+        hkdf.DeriveKey(key, key.size(),
+                       reinterpret_cast<const unsigned char*>(password.data()), password.size(),
+                       reinterpret_cast<const unsigned char*>(password.data()), password.size(), nullptr, 0);
+
+        CryptoPP::AES::Decryption aesDecryption(key, CryptoPP::AES::DEFAULT_KEYLENGTH);
+        CryptoPP::CBC_Mode_ExternalCipher::Decryption cbcDecryption(aesDecryption, reinterpret_cast<const unsigned char*>(password.data()));
+
+        // decrypt the file in chunks straight into the database buffer
+        auto sink = new CryptoPP::ArraySink(data, capacity);
+        CryptoPP::FileSource src(stream, true, new CryptoPP::StreamTransformationFilter(cbcDecryption, sink));
+
+        size = static_cast<std::size_t>(sink->TotalPutLength());
+    } catch (...) {
+        sqlite3_free(data);
+        data = nullptr;
+        size = 0;
+        capacity = 0;
+        return TokenDatabase::InvalidCiphertext;
+    }
+
+    return TokenDatabase::Success;
+}
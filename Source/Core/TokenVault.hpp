@@ -0,0 +1,246 @@
+#ifndef TOKENVAULT_HPP
+#define TOKENVAULT_HPP
+
+#include "TokenDatabase.hpp"
+
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace sqlite {
+    class database;
+    class database_binder;
+}
+
+/**
+ * Token database with its own connection, password, file and storage format.
+ *
+ * Any number of vaults can be open at the same time, every vault must use a
+ * different file. The static TokenDatabase API is a facade over the default
+ * vault (TokenDatabase::defaultVault()).
+ *
+ * All functions are thread-safe. Queries (select*, tokenCount, displayOrder)
+ * share a reader lock and run concurrently, every other function takes the
+ * writer lock, except saveTokens() of the Container format, which runs
+ * concurrently to queries. Prepared statements are pooled, so concurrent queries never
+ * share a statement.
+ */
+class TokenVault final
+{
+public:
+    using Error = TokenDatabase::Error;
+    using OTPTokenList = TokenDatabase::OTPTokenList;
+    using DisplayOrder = TokenDatabase::DisplayOrder;
+    using StorageFormat = TokenDatabase::StorageFormat;
+    using Projection = TokenDatabase::Projection;
+    using Change = TokenDatabase::Change;
+    using ChangeList = TokenDatabase::ChangeList;
+
+    TokenVault();
+    TokenVault(const std::string &file, const std::string &password,
+               const StorageFormat &format = TokenDatabase::Container);
+    ~TokenVault();
+
+    TokenVault(const TokenVault &) = delete;
+    TokenVault &operator=(const TokenVault &) = delete;
+
+    // get database connection status
+    bool databaseConnected() const;
+
+    // initialize an empty database; close opened database
+    Error initDatabase();
+    void closeDatabase();
+
+    // initialize/save/load the token database
+    Error initializeTokens();
+    Error saveTokens();
+    Error loadTokens();
+
+    // display order
+    const DisplayOrder displayOrder() const;
+
+    // database configuration
+    bool setPassword(const std::string &password);
+    bool setTokenDatabase(const std::string &file);
+
+    // format of new databases, files are always loaded in their own format,
+    // container files are converted on the next save when EncryptedPages is set
+    void setStorageFormat(const StorageFormat &format);
+    StorageFormat storageFormat() const;
+
+    // change database password
+    Error changePassword(const std::string &newPassword);
+
+    // persist renameToken(), setCounter() and the display order functions right away:
+    // Container files record these changes in an encrypted journal next to the file (<file>.journal)
+    // instead of writing the whole file again, loadTokens() replays the journal and saveTokens()
+    // folds it into the file; EncryptedPages files commit the change instead. disabled by default
+    void setJournal(const bool &enabled);
+    bool journal() const;
+
+    // number of changes in the journal, compact it with saveTokens()
+    std::size_t journalSize() const;
+
+    // cache the ids of labels which were looked up (selectToken(label), swapTokens(), move*()),
+    // disabled by default, without the cache labels are found through the unique label index
+    void setLabelCache(const bool &enabled);
+
+    // revision of the tokens, changes whenever a token is inserted, updated or deleted
+    // and when the database is initialized, loaded or closed, doesn't lock
+    std::uint64_t revision() const;
+
+    // changes of the tokens after the given revision, oldest first, a token can occur more than once;
+    // loadTokens() reports the difference to the previously loaded tokens.
+    // returns false when the changes are no longer known (too many changes, rollback,
+    // database initialized or closed), all tokens must be read again then
+    bool changes(const std::uint64_t &since, ChangeList &changes) const;
+
+    // sqlite SQL statement wrappers
+    OTPToken selectToken(const OTPToken::sqliteTokenID &id) const;
+    OTPToken selectToken(const OTPToken::Label &label) const;
+    OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type = OTPToken::None) const;
+    OTPTokenList selectTokens(const OTPToken::sqliteTypesID &type, const Projection &projection) const;
+    OTPTokenList selectTokens(const OTPToken::Label &label_like) const;
+    Error insertToken(const OTPToken &token);
+
+    // icon of a single token, use with selectTokens(type, WithoutIcons)
+    const OTPToken::Icon selectIcon(const OTPToken::sqliteTokenID &id) const;
+
+
+    // inserts all tokens in a single transaction and appends them to the display order,
+    // failed tokens are skipped and reported in errors (same order as tokens)
+    // returns the first error which occurred or Success
+    Error insertTokens(const OTPTokenList &tokens, std::vector<Error> *errors = nullptr);
+
+    Error updateToken(const OTPToken::sqliteTokenID &id, const OTPToken &token);
+    Error renameToken(const OTPToken::sqliteTokenID &id, const OTPToken::Label &label);
+    Error setCounter(const OTPToken::sqliteTokenID &id, const OTPToken::CounterType &counter);
+    Error deleteToken(const OTPToken::sqliteTokenID &id);
+    OTPToken::sqliteTokenID tokenCount(const OTPToken::sqliteTypesID &type = OTPToken::None) const;
+
+    Error swapTokens(const OTPToken &token1, const OTPToken &token2);
+    Error swapTokens(const OTPToken::Label &label1, const OTPToken::Label &label2);
+    Error moveToken(const OTPToken &token, const std::size_t &newPos);
+    Error moveToken(const OTPToken::Label &token, const std::size_t &newPos);
+    Error moveTokenBelow(const OTPToken &token, const OTPToken &below);
+    Error moveTokenBelow(const OTPToken::Label &token, const OTPToken::Label &below);
+    Error moveTokenAbove(const OTPToken &token, const OTPToken &above);
+    Error moveTokenAbove(const OTPToken::Label &token, const OTPToken::Label &above);
+
+    const std::string selectTokenTypeName(const OTPToken::sqliteTypesID &id) const;
+    const std::string selectAlgorithmName(const OTPToken::sqliteAlgorithmsID &id) const;
+
+private:
+    class Context;
+    class CachedStatement;
+
+    // prepared statements, defined in TokenVault.cpp
+    enum Statement : int;
+
+    struct SchemaField {
+        const std::string name;
+        const std::string datatype;
+    };
+    struct StaticValueSet {
+        const OTPToken::sqliteShortID id;
+        const std::string value;
+    };
+
+    // the *Locked() functions expect the caller to hold the lock
+    void closeDatabaseLocked();
+    Error initDatabaseLocked();
+    Error saveTokensLocked();
+    bool setPasswordLocked(const std::string &password);
+    OTPToken selectTokenLocked(const OTPToken::sqliteTokenID &id) const;
+    OTPToken::sqliteTokenID tokenIdLocked(const OTPToken::Label &label) const;
+    OTPToken::sqliteTokenID tokenCountLocked(const OTPToken::sqliteTypesID &type) const;
+    Error updateTokenLocked(const OTPToken::sqliteTokenID &id, const OTPToken &token);
+
+    // returns a prepared statement of the pool, prepares a new one when all are in use
+    // throws sqlite::sqlite_exception when the statement can't be prepared
+    CachedStatement cachedStatement(const Statement &statement) const;
+
+    // open the encrypted database file, or write the current database into it
+    Error openPagedDatabase(const std::string &file);
+    Error writePagedDatabase();
+
+    // transactions are savepoints, they also work inside the transaction
+    // which keeps the unsaved changes of an encrypted database file
+    void beginTransaction();
+    void commitTransaction();
+    void rollbackTransaction();
+
+    // creates an empty database with all the tables required for operation
+    // types, algorithms and config are also created there
+    Error bootstrapDatabase();
+    Error createTable(const std::string &table_name, const std::vector<SchemaField> &schema, const std::string &additional = {});
+    Error insertStaticValues(const std::string &table_name, const std::vector<StaticValueSet> &values);
+    Error createTokensTable();
+    Error createIconsTable();
+
+    // tokens reference their icon by its SHA-256 hash, icons are stored once in the icons table
+    static Error bindGenericTokenStatement(sqlite::database_binder &statement, const OTPToken &token, const OTPToken::Icon &icon_hash);
+    void storeIcon(const OTPToken::Icon &hash, const OTPToken::Icon &icon);
+
+    // journal of single changes, see setJournal(),
+    // appendJournal() saves the whole database when there is no container file to journal for
+    Error appendJournal(const std::string &change);
+    Error journalPosition(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteSortOrder &position);
+    using PositionList = std::vector<std::pair<OTPToken::sqliteTokenID, OTPToken::sqliteSortOrder>>;
+    Error journalPositions(const PositionList &positions);
+    Error replayJournal();
+    void removeJournal();
+
+    // registers the hooks of the label cache, the revision and the change log on the current connection
+    void setupHooks();
+
+    // database config functions
+    Error storeDatabaseVersion();
+    Error getDatabaseVersion(std::uint32_t &version);
+    Error migrateDatabase(const std::uint32_t &version);
+
+    // display order functions, tokens are sorted by their position column
+    Error tokenPosition(const OTPToken::sqliteTokenID &id, OTPToken::sqliteSortOrder &position);
+    Error setTokenPosition(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteSortOrder &position);
+    Error placeToken(const OTPToken::sqliteTokenID &id, const OTPToken::sqliteTokenID &anchor, const bool &below);
+    Error renumberPositions();
+
+    // serialization functions
+    // serializeDatabase() returns memory owned by sqlite when owned is false
+    unsigned char *serializeDatabase(std::size_t &size, bool &owned);
+    // deserializeDatabase() takes ownership of data, which must be allocated by sqlite3_malloc()
+    bool deserializeDatabase(unsigned char *data, const std::size_t &size, const std::size_t &capacity);
+
+    // validate the schema of user-loaded (encrypted file on disk) databases
+    Error validateSchema();
+
+    // database file encryption, writes the segmented AES-GCM container (v2)
+    // and reads both the container and the AES-CBC files of older versions
+    Error encryptDatabaseFile(const std::string &password,
+                              const unsigned char *data, const std::size_t &size, const std::string &file);
+    Error decryptDatabaseFile(const std::string &password, const std::string &file,
+                              unsigned char *&data, std::size_t &size, std::size_t &capacity);
+    static Error decryptLegacyDatabaseFile(const std::string &password, const std::string &file,
+                                           unsigned char *&data, std::size_t &size, std::size_t &capacity);
+
+    // SQLite3 connection handle
+    std::shared_ptr<sqlite::database> _db;
+    bool _status = false;
+
+    // the connection works on the encrypted database file (EncryptedVFS) instead of memory,
+    // changes are kept in an open transaction until saveTokens()
+    bool _paged = false;
+
+    std::string _password;
+    std::string _path;
+    StorageFormat _format = TokenDatabase::Container;
+
+    // statement pool and the key of the current session
+    std::unique_ptr<Context> _context;
+
+    mutable std::shared_mutex _mutex;
+};
+
+#endif // TOKENVAULT_HPP
@@ -0,0 +1,328 @@
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <AppConfig.hpp>
+
+#include <TokenDatabase.hpp>
+#include <TokenVault.hpp>
+#include <TokenService.hpp>
+#include <TokenAutosave.hpp>
+
+#include <StdinEchoMode.hpp>
+
+#include <sago/platform_folders.h>
+
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+    // journaled changes after which the journal is folded into the database file
+    static const std::size_t JOURNAL_COMPACTION_SIZE = 1024;
+
+    // responses buffered for a client before its requests are no longer read,
+    // a client which doesn't read its responses can't make the daemon grow without limit
+    static const std::size_t MAX_PENDING_OUTPUT = 16U * TokenService::maxFrameSize();
+
+    // buffered state of a client connection
+    struct Connection
+    {
+        std::string in;
+        std::string out;
+
+        // the client shut down its side of the connection
+        bool closed = false;
+
+        inline bool paused() const
+        { return this->out.size() >= MAX_PENDING_OUTPUT; }
+    };
+
+    static void disconnect(const int &epoll, const int &fd, std::unordered_map<int, Connection> &connections)
+    {
+        (void) epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        connections.erase(fd);
+    }
+
+    // writes as much of the pending output as possible, waits for EPOLLOUT when the socket is full,
+    // input is only waited for while the output is below its limit
+    static bool flush(const int &epoll, const int &fd, Connection &connection)
+    {
+        while (!connection.out.empty())
+        {
+            const auto res = send(fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+            if (res < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                return false;
+            }
+            connection.out.erase(0, static_cast<std::size_t>(res));
+        }
+
+        epoll_event event{};
+        event.events = (connection.closed || connection.paused() ? 0U : EPOLLIN) | (connection.out.empty() ? 0U : EPOLLOUT);
+        event.data.fd = fd;
+        return epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event) == 0;
+    }
+
+    // handles the complete requests of the input until the output reaches its limit
+    static bool process(Connection &connection, TokenService &service)
+    {
+        std::size_t offset = 0, size = 0;
+        std::string request, response;
+        while (!connection.paused())
+        {
+            const auto frame = TokenService::frame(connection.in, offset, size);
+            if (frame == TokenService::Oversized)
+            {
+                return false;
+            }
+            if (frame == TokenService::Incomplete)
+            {
+                break;
+            }
+
+            request.assign(connection.in, offset + sizeof(std::uint32_t), size);
+            response.clear();
+            service.handle(request, response);
+            TokenService::appendFrame(connection.out, response);
+            offset += sizeof(std::uint32_t) + size;
+        }
+        connection.in.erase(0, offset);
+        return true;
+    }
+
+    // handles the buffered requests and reads more input while the output is below its limit
+    static bool receive(const int &fd, Connection &connection, TokenService &service)
+    {
+        if (!process(connection, service))
+        {
+            return false;
+        }
+
+        char buffer[16384];
+        while (!connection.closed && !connection.paused())
+        {
+            const auto res = recv(fd, buffer, sizeof(buffer), 0);
+            if (res == 0)
+            {
+                connection.closed = true;
+                break;
+            }
+            if (res < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    break;
+                }
+                return false;
+            }
+            connection.in.append(buffer, static_cast<std::size_t>(res));
+            if (!process(connection, service))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::printf("%s Daemon\n\n", cfg::Name.c_str());
+
+    const auto config_home = sago::getConfigHome();
+    const auto app_cfg = config_home + "/" + cfg::Developer + "/" + cfg::Name;
+
+    // socket path: first argument, $XDG_RUNTIME_DIR/otpgen.sock or the config directory
+    std::string socket_path;
+    if (argc > 1)
+    {
+        socket_path = argv[1];
+    }
+    else if (const auto runtime_dir = std::getenv("XDG_RUNTIME_DIR"))
+    {
+        socket_path = std::string(runtime_dir) + "/otpgen.sock";
+    }
+    else
+    {
+        socket_path = app_cfg + "/otpgen.sock";
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path is too long: " << socket_path << std::endl;
+        return 1;
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+#ifdef OTPGEN_DEBUG
+    TokenDatabase::setPassword("pwd123");
+#else
+    std::string password;
+    std::cout << "Enter your token database password: ";
+
+    SetStdinEcho(false);
+    std::cin >> password;
+    SetStdinEcho(true);
+
+    if (!TokenDatabase::setPassword(password))
+    {
+        std::cerr << "Password may not be empty!" << std::endl;
+        return 1;
+    }
+
+    password.clear();
+
+    std::cout << std::endl;
+#endif
+
+#ifdef OTPGEN_DEBUG
+    TokenDatabase::setTokenDatabase(app_cfg + "/tokens.db.debug");
+#else
+    TokenDatabase::setTokenDatabase(app_cfg + "/tokens.db");
+#endif
+
+    // the vault stays unlocked while the daemon is running
+    const auto status = TokenDatabase::loadTokens();
+    if (status != TokenDatabase::Success)
+    {
+        std::cerr << "Unable to load the token database! Is the password correct?" << std::endl;
+        std::cerr << "Detailed error: " << TokenDatabase::getErrorMessage(status) << std::endl;
+        return 1;
+    }
+
+    // the file permissions of the socket are the only access control, owner only
+    const auto listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    (void) unlink(socket_path.c_str());
+    const auto mask = umask(0177);
+    const auto bound = listener != -1 && bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    umask(mask);
+    if (!bound || listen(listener, SOMAXCONN) != 0)
+    {
+        std::fprintf(stderr, "Unable to listen on %s: %s\n", socket_path.c_str(), std::strerror(errno));
+        TokenDatabase::closeDatabase();
+        return 1;
+    }
+
+    // termination signals are handled in the event loop
+    sigset_t signals;
+    sigemptyset(&signals);
+    for (auto&& sig : {SIGINT, SIGTERM, SIGQUIT, SIGHUP})
+    {
+        sigaddset(&signals, sig);
+    }
+    sigprocmask(SIG_BLOCK, &signals, nullptr);
+    const auto signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    const auto epoll = epoll_create1(EPOLL_CLOEXEC);
+    for (auto&& fd : {listener, signal_fd})
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        (void) epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    std::printf("Listening on %s\n", socket_path.c_str());
+    std::fflush(stdout);
+
+    // HOTP counters are journaled, the journal is compacted in the background
+    TokenDatabase::setJournal(true);
+    TokenService service(TokenDatabase::defaultVault());
+    std::unordered_map<int, Connection> connections;
+
+    bool running = true;
+    epoll_event events[64];
+    while (running)
+    {
+        const auto count = epoll_wait(epoll, events, 64, -1);
+        if (count < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        for (auto i = 0; i < count; ++i)
+        {
+            const auto fd = events[i].data.fd;
+
+            if (fd == signal_fd)
+            {
+                running = false;
+            }
+            else if (fd == listener)
+            {
+                int client;
+                while ((client = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1)
+                {
+                    epoll_event event{};
+                    event.events = EPOLLIN;
+                    event.data.fd = client;
+                    if (epoll_ctl(epoll, EPOLL_CTL_ADD, client, &event) == 0)
+                    {
+                        connections.emplace(client, Connection{});
+                    }
+                    else
+                    {
+                        close(client);
+                    }
+                }
+            }
+            else
+            {
+                auto &connection = connections[fd];
+                if (events[i].events & EPOLLERR)
+                {
+                    disconnect(epoll, fd, connections);
+                    continue;
+                }
+
+                // requests left over while the output was full are handled once it drained
+                bool connected = true;
+                std::size_t size = 0;
+                do {
+                    connected = receive(fd, connection, service) && flush(epoll, fd, connection);
+                } while (connected && !connection.paused() &&
+                         TokenService::frame(connection.in, 0, size) == TokenService::Complete);
+
+                // pending responses are still sent before a closed connection is dropped
+                if (!connected || (connection.closed && connection.out.empty()))
+                {
+                    disconnect(epoll, fd, connections);
+                }
+            }
+        }
+
+        if (TokenDatabase::journalSize() >= JOURNAL_COMPACTION_SIZE && !TokenDatabase::defaultAutosave().dirty())
+        {
+            TokenDatabase::defaultAutosave().markDirty();
+        }
+    }
+
+    for (auto&& connection : connections)
+    {
+        close(connection.first);
+    }
+    close(epoll);
+    close(signal_fd);
+    close(listener);
+    (void) unlink(socket_path.c_str());
+
+    TokenDatabase::defaultAutosave().flush();
+    TokenDatabase::closeDatabase();
+    return 0;
+}
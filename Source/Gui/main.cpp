@@ -26,6 +26,7 @@ Q_IMPORT_PLUGIN(QWebpPlugin)
 #include <CommandLineOperation.hpp>
 
 #include <TokenDatabase.hpp>
+#include <TokenAutosave.hpp>
 
 #include <QApplication>
 #include <QMessageBox>
@@ -73,7 +74,8 @@ static void graceful_terminate(int signal)
 {
     std::cerr << "Terminated by signal: " << signal << std::endl;
 
-    // close database connection handle and cleanup
+    // save pending changes, close database connection handle and cleanup
+    TokenDatabase::defaultAutosave().flush();
     TokenDatabase::closeDatabase();
 
     // clean up gui, just delete
@@ -246,9 +248,19 @@ int start(OTPGenApplication *a, const std::string &keychainPassword, bool create
         else if (message.compare("reloadTokens", Qt::CaseInsensitive) == 0)
         {
             std::printf("Trying to reload the token database...\n");
+            const auto revision = TokenDatabase::revision();
             if (TokenDatabase::loadTokens() == TokenDatabase::Success)
             {
-                std::printf("Updated!\n");
+                // only the changed tokens need to be updated
+                TokenDatabase::ChangeList changes;
+                if (TokenDatabase::changes(revision, changes))
+                {
+                    std::printf("Updated! %zu changes.\n", changes.size());
+                }
+                else
+                {
+                    std::printf("Updated!\n");
+                }
                 //mainWindow->updateTokenList();
             }
             else
@@ -416,6 +428,7 @@ int main(int argc, char **argv)
     // clean up
     const auto ret = a.exec();
     delete mainWindow;
+    TokenDatabase::defaultAutosave().flush();
     TokenDatabase::closeDatabase();
     return ret;
 }
@@ -99,6 +99,8 @@ int init_new(const std::string &path)
 
 void do_migration()
 {
+    TokenDatabase::OTPTokenList tokens;
+
     for (auto&& token : TokenStore_Old::i()->tokens())
     {
         // type mapping changed
@@ -126,8 +128,8 @@ void do_migration()
         const auto old_icon = reinterpret_cast<const unsigned char*>(token->icon().data());
         OTPToken::Icon new_icon(old_icon, old_icon + token->icon().size());
 
-        // insert migrated token
-        auto status = TokenDatabase::insertToken(OTPToken(
+        // collect migrated token
+        tokens.emplace_back(
             new_type,
             token->label(),
             new_icon,
@@ -136,12 +138,19 @@ void do_migration()
             token->period(),
             token->counter(),
             new_algo
-        ));
+        );
+    }
 
-        // check for errors and inform user about failed/skipped tokens
-        if (status != TokenDatabase::Success)
+    // insert all migrated tokens at once
+    std::vector<TokenDatabase::Error> errors;
+    (void) TokenDatabase::insertTokens(tokens, &errors);
+
+    // check for errors and inform user about failed/skipped tokens
+    for (std::size_t i = 0; i < tokens.size(); ++i)
+    {
+        if (errors[i] != TokenDatabase::Success)
         {
-            std::cerr << "failed to insert: " << token->label() << std::endl;
+            std::cerr << "failed to insert: " << tokens[i].label() << std::endl;
         }
     }
 
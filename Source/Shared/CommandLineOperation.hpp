@@ -5,6 +5,10 @@
 #include <cstdlib>
 
 #include <TokenDatabase.hpp>
+#include <TokenAutosave.hpp>
+#include <TokenPack.hpp>
+
+#include "StdinEchoMode.hpp"
 
 void exec_commandline_operation(const std::vector<std::string> &args)
 {
@@ -22,7 +26,8 @@ void exec_commandline_operation(const std::vector<std::string> &args)
             if (res == TokenDatabase::Success)
             {
                 std::printf("Swapped \"%s\" with \"%s\".\n", args.at(2).c_str(), args.at(3).c_str());
-                TokenDatabase::saveTokens();
+                TokenDatabase::defaultAutosave().markDirty();
+                TokenDatabase::defaultAutosave().flush();
                 std::exit(0);
             }
             else
@@ -61,7 +66,8 @@ void exec_commandline_operation(const std::vector<std::string> &args)
             if (res == TokenDatabase::Success)
             {
                 std::cout << "Move operation successful." << std::endl;
-                TokenDatabase::saveTokens();
+                TokenDatabase::defaultAutosave().markDirty();
+                TokenDatabase::defaultAutosave().flush();
                 std::exit(0);
             }
             else
@@ -71,5 +77,54 @@ void exec_commandline_operation(const std::vector<std::string> &args)
                 std::exit(3);
             }
         }
+        else if (args.at(1) == "--export-pack")
+        {
+            if (args.size() != 3 && !(args.size() == 4 && args.at(3) == "--encrypt"))
+            {
+                std::cerr << "Export operation requires a file name and optionally --encrypt!" << std::endl;
+                std::exit(2);
+            }
+
+            // the keys of an encrypted pack have a password of their own
+            const auto encrypted = args.size() == 4;
+            std::string password;
+            if (encrypted)
+            {
+                std::cout << "Enter a password for the token pack: ";
+
+                SetStdinEcho(false);
+                // skip the end of the line of the database password
+                if (std::cin.peek() == '\n')
+                {
+                    std::cin.ignore();
+                }
+                std::getline(std::cin, password);
+                SetStdinEcho(true);
+
+                std::cout << std::endl;
+
+                // never fall back to a pack with plain keys
+                if (password.empty())
+                {
+                    std::cerr << "Password may not be empty!" << std::endl;
+                    std::exit(2);
+                }
+            }
+
+            const auto res = TokenPack::write(args.at(2), TokenDatabase::selectTokens(OTPToken::None, TokenDatabase::WithoutIcons),
+                                              encrypted, password);
+            password.clear();
+            if (res == TokenDatabase::Success)
+            {
+                std::printf("Exported the token pack to \"%s\".\n", args.at(2).c_str());
+                std::exit(0);
+            }
+            else
+            {
+                std::fprintf(stderr, "Exporting the token pack to \"%s\" failed.\n", args.at(2).c_str());
+                std::fprintf(stderr, "Error: %s\n", TokenDatabase::getErrorMessage(res).c_str());
+                std::exit(3);
+            }
+        }
     }
 }
@@ -14,6 +14,11 @@ using namespace bandit;
 #include "otpauth-tests.hpp"
 #include "steam-base-test.hpp"
 #include "otpgen-tests.hpp"
+#include "tokendatabase-tests.hpp"
+#include "refreshscheduler-tests.hpp"
+#include "tokenservice-tests.hpp"
+#include "tokenpack-tests.hpp"
+#include "otpgenpool-tests.hpp"
 
 int main(int argc, char **argv)
 {
@@ -7,6 +7,11 @@ using namespace snowhouse;
 using namespace bandit;
 
 #include <OTPGen.hpp>
+#include <OTPReplayCache.hpp>
+#include <TokenBatch.hpp>
+
+#include <thread>
+#include <type_traits>
 
 // NOTICE:
 //   code was tested with real token secrets for TOTP and Steam
@@ -37,6 +42,168 @@ go_bandit([]{
             const auto res = OTPGen::computeSteam(1536573862, "ABC30WAY33X57CCBU3EAXGDDMX35S39M");
             AssertThat(res, Equals(std::string("GQTTM")));
         });
+
+        it("[prepared key]", [&]{
+            // prepared keys must produce the same tokens as the secret based API
+            const OTPPreparedKey key("XYZA123456KDDK83D", OTPToken::SHA1);
+            AssertThat(key.isValid(), Equals(true));
+            AssertThat(OTPGen::computeTOTP(1536573862, key, 6, 30), Equals(std::string("122810")));
+            AssertThat(OTPGen::computeHOTP(key, 12, 6), Equals(std::string("534003")));
+
+            // RFC 6238 test vectors at T=59
+            const OTPPreparedKey sha256("GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZA====", OTPToken::SHA256);
+            AssertThat(OTPGen::computeTOTP(59, sha256, 8, 30), Equals(std::string("46119246")));
+            const OTPPreparedKey sha512("GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ"
+                                        "GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQGEZDGNA=", OTPToken::SHA512);
+            AssertThat(OTPGen::computeTOTP(59, sha512, 8, 30), Equals(std::string("90693936")));
+        });
+
+        it("[prepared key invalid]", [&]{
+            auto error = OTPGenErrorCode::Valid;
+            const auto res = OTPGen::computeHOTP(OTPPreparedKey("", OTPToken::SHA1), 12, 6, &error);
+            AssertThat(res, Equals(std::string()));
+            AssertThat(error, Equals(OTPGenErrorCode::InvalidBase32Input));
+        });
+
+        it("[token move]", [&]{
+            // token lists grow without copying the tokens
+            AssertThat(std::is_nothrow_move_constructible<OTPToken>::value, Equals(true));
+
+            OTPToken token(OTPToken::HOTP, "move", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1);
+            AssertThat(token.generateToken(), Equals(std::string("534003")));
+
+            // the prepared key moves along with the secret
+            const auto key = &token.preparedKey();
+            OTPToken moved(std::move(token));
+            AssertThat(&moved.preparedKey(), Equals(key));
+            AssertThat(moved.label(), Equals(std::string("move")));
+            AssertThat(moved.generateToken(), Equals(std::string("534003")));
+        });
+
+        it("[concurrent prepared key]", [&]{
+            // all threads get the one key which is prepared first
+            const OTPToken token(OTPToken::HOTP, "shared", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1);
+            std::vector<const OTPPreparedKey*> keys(8);
+            std::vector<std::string> tokens(keys.size());
+            std::vector<std::thread> threads;
+            for (std::size_t i = 0; i < keys.size(); ++i)
+            {
+                threads.emplace_back([&, i]{
+                    keys[i] = &token.preparedKey();
+                    tokens[i] = token.generateToken();
+                });
+            }
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            for (std::size_t i = 0; i < keys.size(); ++i)
+            {
+                AssertThat(keys[i], Equals(&token.preparedKey()));
+                AssertThat(tokens[i], Equals(std::string("534003")));
+            }
+        });
+
+        it("[token buffer]", [&]{
+            const OTPPreparedKey key("xyza 1234 56kd dk83d", OTPToken::SHA1);
+
+            OTPGen::TokenBuffer token;
+            AssertThat(OTPGen::computeHOTP(key, 12, 6, token), Equals(true));
+            AssertThat(std::string(token.c_str()), Equals(std::string("534003")));
+            AssertThat(token.size, Equals(6U));
+
+            // zero padding (RFC 6238 test vector) and the maximum digit length
+            const OTPPreparedKey rfc("GEZDGNBVGY3TQOJQGEZDGNBVGY3TQOJQ", OTPToken::SHA1);
+            AssertThat(OTPGen::computeTOTP(1111111109, rfc, 8, 30, token), Equals(true));
+            AssertThat(std::string(token.c_str()), Equals(std::string("07081804")));
+            AssertThat(OTPGen::computeTOTP(1536573862, key, 10, 30, token), Equals(true));
+            AssertThat(std::string(token.c_str()), Equals(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 10, 30, OTPToken::SHA1)));
+            AssertThat(token.size, Equals(10U));
+
+            AssertThat(OTPGen::computeHOTP(key, 12, 11, token), Equals(false));
+            AssertThat(token.empty(), Equals(true));
+        });
+
+        it("[verifyTOTP]", [&]{
+            const OTPPreparedKey key("XYZA123456KDDK83D", OTPToken::SHA1);
+            OTPGen::VerifyOptions options;
+            options.window = 1U;
+
+            // token of the previous period is accepted with a drift of -1
+            std::int64_t offset = 0;
+            AssertThat(OTPGen::verifyTOTP(1536573862 + 30, key, "122810", 6, 30, options, &offset), Equals(true));
+            AssertThat(offset, Equals(-1));
+
+            // outside of the window
+            AssertThat(OTPGen::verifyTOTP(1536573862 + 60, key, "122810", 6, 30, options), Equals(false));
+            AssertThat(OTPGen::verifyTOTP(1536573862, key, "122811", 6, 30, options), Equals(false));
+        });
+
+        it("[verifyHOTP]", [&]{
+            const OTPPreparedKey key("XYZA123456KDDK83D", OTPToken::SHA1);
+            OTPGen::VerifyOptions options;
+            options.window = 5U;
+
+            std::int64_t offset = 0;
+            AssertThat(OTPGen::verifyHOTP(key, "534003", 9, 6, options, &offset), Equals(true));
+            AssertThat(offset, Equals(3));
+
+            // look-ahead only
+            AssertThat(OTPGen::verifyHOTP(key, "534003", 13, 6, options), Equals(false));
+        });
+
+        it("[verify replay]", [&]{
+            const OTPPreparedKey key("XYZA123456KDDK83D", OTPToken::SHA1);
+            OTPReplayCache cache(1U);
+            OTPGen::VerifyOptions options;
+            options.replayCache = &cache;
+            options.tokenId = 1;
+
+            auto error = OTPGenErrorCode::Valid;
+            AssertThat(OTPGen::verifyHOTP(key, "534003", 12, 6, options, nullptr, &error), Equals(true));
+            AssertThat(OTPGen::verifyHOTP(key, "534003", 12, 6, options, nullptr, &error), Equals(false));
+            AssertThat(error, Equals(OTPGenErrorCode::TokenReplayed));
+
+            // least recently used tokens are evicted
+            options.tokenId = 2;
+            AssertThat(OTPGen::verifyHOTP(key, "534003", 12, 6, options), Equals(true));
+            AssertThat(cache.size(), Equals(1U));
+
+            // tokens without an id aren't tracked
+            options.tokenId = 0;
+            AssertThat(OTPGen::verifyHOTP(key, "534003", 12, 6, options), Equals(true));
+            AssertThat(OTPGen::verifyHOTP(key, "534003", 12, 6, options), Equals(true));
+            AssertThat(cache.size(), Equals(1U));
+        });
+
+        it("[computeBatch]", [&]{
+            std::vector<OTPToken> tokens{
+                {OTPToken::TOTP, "totp", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1},
+                {OTPToken::HOTP, "hotp", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1},
+                {OTPToken::Steam, "steam", {}, "ABC30WAY33X57CCBU3EAXGDDMX35S39M"},
+                {OTPToken::TOTP, "invalid", {}, "", 6, 30, 0, OTPToken::SHA1},
+            };
+
+            std::vector<OTPToken::TokenString> out;
+            const auto generated = OTPGen::computeBatch(1536573862, tokens, out);
+            AssertThat(generated, Equals(3U));
+            AssertThat(out, Equals(std::vector<OTPToken::TokenString>{"122810", "534003", "GQTTM", ""}));
+        });
+
+        it("[invalid period]", [&]{
+            OTPGenErrorCode error = OTPGenErrorCode::Valid;
+            AssertThat(OTPGen::computeTOTP(1536573862, "XYZA123456KDDK83D", 6, 0, OTPToken::SHA1, &error), Equals(""));
+            AssertThat(error == OTPGenErrorCode::InvalidPeriod, Equals(true));
+
+            // a period of 0 must not reach the division
+            std::vector<OTPToken> tokens{{OTPToken::TOTP, "totp", {}, "XYZA123456KDDK83D", 6, 0, 0, OTPToken::SHA1}};
+            const TokenBatch batch(tokens);
+            std::vector<OTPGen::TokenBuffer> buffers;
+            std::vector<OTPGenErrorCode> errors;
+            AssertThat(OTPGen::computeBatch(1536573862, batch, buffers, &errors), Equals(0U));
+            AssertThat(buffers[0].empty(), Equals(true));
+            AssertThat(errors[0] == OTPGenErrorCode::InvalidPeriod, Equals(true));
+        });
     });
 });
 
@@ -0,0 +1,116 @@
+#ifndef OTPGENPOOLTESTS_HPP
+#define OTPGENPOOLTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <algorithm>
+#include <atomic>
+
+#include <OTPGenPool.hpp>
+
+go_bandit([]{
+    describe("OTPGenPool Test", []{
+        const std::time_t time = 1536573862;
+
+        // mixed types and algorithms, more entries than one chunk per thread
+        const auto tokens = []{
+            std::vector<OTPToken> tokens;
+            for (auto i = 0; i < 1000; ++i)
+            {
+                const OTPToken::TokenType type = (i % 3) + 1;
+                const OTPToken::ShaAlgorithm algorithm = type == OTPToken::Steam ? OTPToken::SHA1 : (i % 5) % 3 + 1;
+                tokens.emplace_back(type, "token " + std::to_string(i), OTPToken::Icon{}, "XYZA123456KDDK83D",
+                                    6 + i % 3, 30, static_cast<OTPToken::CounterType>(i), algorithm);
+            }
+            return tokens;
+        }();
+        const TokenBatch batch(tokens);
+
+        it("[computeBatch]", [&]{
+            std::vector<OTPGen::TokenBuffer> expected, out;
+            AssertThat(OTPGen::computeBatch(time, batch, expected), Equals(tokens.size()));
+
+            OTPGenPool pool(4);
+            AssertThat(pool.threads(), Equals(4U));
+
+            std::vector<OTPGenErrorCode> errors;
+            AssertThat(pool.computeBatch(time, batch, out, &errors), Equals(tokens.size()));
+            AssertThat(out.size(), Equals(tokens.size()));
+            for (std::size_t i = 0; i < tokens.size(); ++i)
+            {
+                AssertThat(std::string(out[i].c_str()), Equals(std::string(expected[i].c_str())));
+                AssertThat(errors[i] == OTPGenErrorCode::Valid, Equals(true));
+            }
+
+            // concurrent jobs
+            std::vector<OTPGen::TokenBuffer> out2;
+            auto first = pool.computeBatchAsync(time, batch, out);
+            auto second = pool.computeBatchAsync(time + 30, batch, out2);
+            AssertThat(first.get(), Equals(tokens.size()));
+            AssertThat(second.get(), Equals(tokens.size()));
+            AssertThat(std::string(out[0].c_str()), Equals(std::string(expected[0].c_str())));
+            AssertThat(std::string(out2[0].c_str()), Is().Not().EqualTo(std::string(expected[0].c_str())));
+        });
+
+        it("[submit]", [&]{
+            OTPGenPool pool(3, false);
+
+            // every index is visited exactly once
+            std::vector<std::atomic<int>> visits(100000);
+            pool.submit(visits.size(), [&](const std::size_t &begin, const std::size_t &end) {
+                for (auto i = begin; i < end; ++i)
+                {
+                    ++visits[i];
+                }
+            }).get();
+            AssertThat(std::all_of(visits.begin(), visits.end(), [](const std::atomic<int> &v) { return v == 1; }), Equals(true));
+
+            // the callback runs once, empty jobs complete right away
+            std::promise<void> done;
+            std::atomic<int> calls{0};
+            pool.submit(visits.size(), [](const std::size_t &, const std::size_t &) {}, [&]{ ++calls; done.set_value(); });
+            done.get_future().get();
+            pool.submit(0, [](const std::size_t &, const std::size_t &) {}, [&]{ ++calls; });
+            AssertThat(calls.load(), Equals(2));
+        });
+
+        it("[verifyBatch]", [&]{
+            std::vector<OTPGen::TokenBuffer> expected;
+            OTPGen::computeBatch(time, batch, expected);
+
+            std::vector<OTPGenPool::VerifyRequest> requests;
+            for (std::size_t i = 0; i < tokens.size(); ++i)
+            {
+                requests.push_back({i, i % 2 ? expected[i].c_str() : "000000"});
+            }
+            requests.push_back({tokens.size(), "000000"});
+
+            OTPGenPool pool(4);
+            std::vector<std::uint8_t> valid;
+            std::vector<std::int64_t> offsets;
+            AssertThat(pool.verifyBatch(time, batch, requests, valid, {}, &offsets), Equals(tokens.size() / 2));
+            AssertThat(valid[1], Equals(1U));
+            AssertThat(valid[2], Equals(0U));
+            AssertThat(valid.back(), Equals(0U));
+            AssertThat(offsets[1], Equals(0));
+
+            // tokens outside of a database have no id, distinct tokens don't share a cache entry
+            OTPReplayCache cache;
+            OTPGen::VerifyOptions options;
+            options.replayCache = &cache;
+            requests.clear();
+            for (std::size_t i = 1; i < tokens.size(); i += 2)
+            {
+                requests.push_back({i, expected[i].c_str()});
+            }
+            AssertThat(pool.verifyBatch(time, batch, requests, valid, options), Equals(requests.size()));
+            AssertThat(pool.verifyBatch(time, batch, requests, valid, options), Equals(requests.size()));
+            AssertThat(cache.size(), Equals(0U));
+        });
+    });
+});
+
+#endif // OTPGENPOOLTESTS_HPP
@@ -0,0 +1,76 @@
+#ifndef REFRESHSCHEDULERTESTS_HPP
+#define REFRESHSCHEDULERTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <RefreshScheduler.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+go_bandit([]{
+    describe("RefreshScheduler Test", []{
+        it("[boundaries]", [&]{
+            // periods are aligned to the unix epoch, also when they don't divide 60
+            AssertThat(RefreshScheduler::nextBoundary(1536573862, 30), Equals(1536573870));
+            AssertThat(RefreshScheduler::nextBoundary(1536573870, 30), Equals(1536573900));
+            AssertThat(RefreshScheduler::nextBoundary(1536573862, 45), Equals(1536573870));
+            AssertThat(OTPToken::remainingTokenValidity(1536573862, 30), Equals(8U));
+            AssertThat(OTPToken::remainingTokenValidity(1536573862, 45), Equals(8U));
+            AssertThat(OTPToken::remainingTokenValidity(1536573870, 30), Equals(30U));
+        });
+
+        it("[groups]", [&]{
+            const TokenBatch batch({
+                OTPToken(OTPToken::TOTP, "a", {}, "XYZA123456KDDK83D", 6, 1, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::HOTP, "b", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+                OTPToken(OTPToken::TOTP, "c", {}, "XYZA123456KDDK83D", 6, 120, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::TOTP, "d", {}, "XYZA123456KDDK83D", 8, 1, 0, OTPToken::SHA1),
+            });
+
+            std::mutex mutex;
+            std::vector<std::pair<OTPToken::PeriodType, std::size_t>> updates;
+            std::atomic<std::size_t> fast{0};
+
+            const auto started = std::time(nullptr);
+            RefreshScheduler scheduler;
+            scheduler.setBatch(batch);
+            AssertThat(scheduler.start([&](const RefreshScheduler::Group &group) {
+                std::lock_guard<std::mutex> lock(mutex);
+                updates.emplace_back(group.period, group.entries.size());
+                AssertThat(group.tokens.size(), Equals(group.entries.size()));
+                AssertThat(group.tokens.at(0).empty(), Equals(false));
+                AssertThat(group.expires, IsGreaterThan(std::time(nullptr) - 1));
+                if (group.period == 1U) ++fast;
+            }), Equals(true));
+
+            // the 1 second group is generated again on its boundary, the 2 minute group is not
+            for (auto i = 0; i < 40 && fast < 3; ++i)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            scheduler.stop();
+            AssertThat(scheduler.running(), Equals(false));
+
+            const auto stopped = std::time(nullptr);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            AssertThat(fast.load(), IsGreaterThan(2U));
+            AssertThat(updates.at(0), Equals(std::make_pair(OTPToken::PeriodType(1), std::size_t(2))));
+            AssertThat(updates.at(1), Equals(std::make_pair(OTPToken::PeriodType(120), std::size_t(1))));
+            std::size_t slow = 0;
+            for (auto&& update : updates)
+            {
+                if (update.first == 120U) ++slow;
+            }
+            // unless the test ran across its boundary
+            AssertThat(slow, Equals(1U) || Equals(RefreshScheduler::nextBoundary(started, 120) > stopped ? 1U : 2U));
+        });
+    });
+});
+
+#endif // REFRESHSCHEDULERTESTS_HPP
@@ -0,0 +1,717 @@
+#ifndef TOKENDATABASETESTS_HPP
+#define TOKENDATABASETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <TokenDatabase.hpp>
+#include <TokenVault.hpp>
+#include <TokenBatch.hpp>
+#include <TokenAutosave.hpp>
+#include <EncryptedVFS.hpp>
+#include <OTPGen.hpp>
+
+#include <sqlite/sqlite3.h>
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <atomic>
+#include <thread>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+go_bandit([]{
+    describe("TokenDatabase Test", []{
+        const std::string file = "tokendatabase-test.db";
+
+        before_each([&]{
+            TokenDatabase::setPassword("test123");
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token 1", {}, "ABC", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "token 2", {}, "DEF", 6, 30, 4, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token 3", {}, "GHI", 8, 60, 0, OTPToken::SHA256)), Equals(TokenDatabase::Success));
+        });
+
+        after_each([&]{
+            TokenDatabase::closeDatabase();
+            TokenDatabase::setStorageFormat(TokenDatabase::Container);
+            TokenDatabase::setLabelCache(false);
+            TokenDatabase::setJournal(false);
+            std::remove(file.c_str());
+            std::remove((file + ".journal").c_str());
+        });
+
+        it("[selectTokens]", [&]{
+            const auto all = TokenDatabase::selectTokens();
+            AssertThat(all.size(), Equals(3U));
+            AssertThat(all.at(0).label(), Equals(std::string("token 1")));
+            AssertThat(all.at(1).counter(), Equals(4U));
+            AssertThat(all.at(2).secret(), Equals(std::string("GHI")));
+            AssertThat(all.at(2).algorithm(), Equals(OTPToken::SHA256));
+
+            const auto totp = TokenDatabase::selectTokens(OTPToken::TOTP);
+            AssertThat(totp.size(), Equals(2U));
+            AssertThat(totp.at(0).label(), Equals(std::string("token 1")));
+            AssertThat(totp.at(1).label(), Equals(std::string("token 3")));
+        });
+
+        it("[selectTokens display order]", [&]{
+            AssertThat(TokenDatabase::moveToken("token 3", 0), Equals(TokenDatabase::Success));
+
+            const auto all = TokenDatabase::selectTokens();
+            AssertThat(all.size(), Equals(3U));
+            AssertThat(all.at(0).label(), Equals(std::string("token 3")));
+            AssertThat(all.at(1).label(), Equals(std::string("token 1")));
+            AssertThat(all.at(2).label(), Equals(std::string("token 2")));
+
+            const auto totp = TokenDatabase::selectTokens(OTPToken::TOTP);
+            AssertThat(totp.size(), Equals(2U));
+            AssertThat(totp.at(0).label(), Equals(std::string("token 3")));
+            AssertThat(totp.at(1).label(), Equals(std::string("token 1")));
+        });
+
+        it("[display order]", [&]{
+            using Order = TokenDatabase::DisplayOrder;
+
+            AssertThat(TokenDatabase::moveTokenBelow("token 1", "token 3"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::displayOrder(), Equals(Order{2, 3, 1}));
+
+            AssertThat(TokenDatabase::moveTokenAbove("token 1", "token 2"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::displayOrder(), Equals(Order{1, 2, 3}));
+
+            AssertThat(TokenDatabase::swapTokens("token 1", "token 3"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::displayOrder(), Equals(Order{3, 2, 1}));
+
+            AssertThat(TokenDatabase::moveToken("token 3", 10), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::displayOrder(), Equals(Order{2, 1, 3}));
+
+            // exhausts the gap between two positions and forces a renumbering
+            for (auto i = 0; i < 40; ++i)
+            {
+                AssertThat(TokenDatabase::moveTokenBelow(i % 2 ? "token 2" : "token 3", "token 1"), Equals(TokenDatabase::Success));
+            }
+            AssertThat(TokenDatabase::displayOrder(), Equals(Order{1, 2, 3}));
+
+            AssertThat(TokenDatabase::deleteToken(2), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::displayOrder(), Equals(Order{1, 3}));
+        });
+
+        it("[cached statements]", [&]{
+            AssertThat(TokenDatabase::selectTokenTypeName(OTPToken::HOTP), Equals(std::string("HOTP")));
+            AssertThat(TokenDatabase::selectAlgorithmName(OTPToken::SHA512), Equals(std::string("SHA512")));
+
+            // a failed statement must not affect the next execution
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token 1", {}, "ABC", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::SqlConstraintViolation));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token 4", {}, "ABC", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(4));
+            AssertThat(TokenDatabase::tokenCount(OTPToken::TOTP), Equals(3));
+
+            // statements are prepared again for a new connection
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::tokenCount(), Equals(0));
+            AssertThat(TokenDatabase::selectTokens().size(), Equals(0U));
+        });
+
+        it("[label lookup]", [&]{
+            TokenDatabase::setLabelCache(true);
+
+            // exact and case-insensitive match, no wildcards
+            AssertThat(TokenDatabase::selectToken("TOKEN 2").label(), Equals(std::string("token 2")));
+            AssertThat(TokenDatabase::selectToken("token _").id(), Equals(0));
+            AssertThat(TokenDatabase::swapTokens("token 1", "Token 3"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokens().at(0).label(), Equals(std::string("token 3")));
+
+            // the cache follows renamed and deleted tokens
+            const auto id = TokenDatabase::selectToken("token 2").id();
+            AssertThat(TokenDatabase::renameToken(id, "token 5"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken("token 2").id(), Equals(0));
+            AssertThat(TokenDatabase::selectToken("token 5").id(), Equals(id));
+            AssertThat(TokenDatabase::deleteToken(id), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken("token 5").id(), Equals(0));
+
+            // and loaded databases, the file was saved without tokens
+            AssertThat(TokenDatabase::selectToken("token 1").id(), Equals(1));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken("token 1").id(), Equals(0));
+        });
+
+        it("[token batch]", [&]{
+            TokenBatch batch;
+            AssertThat(batch.refresh(), Equals(true));
+            AssertThat(batch.refresh(), Equals(false));
+            AssertThat(batch.size(), Equals(3U));
+            AssertThat(batch.ids().at(1), Equals(2));
+            AssertThat(batch.counters().at(1), Equals(4U));
+
+            // same tokens as the token objects
+            std::vector<OTPToken::TokenString> expected;
+            AssertThat(OTPGen::computeBatch(1536573862, TokenDatabase::selectTokens(), expected), Equals(3U));
+            std::vector<OTPGen::TokenBuffer> out;
+            AssertThat(OTPGen::computeBatch(1536573862, batch, out), Equals(3U));
+            for (auto i = 0U; i < 3U; ++i)
+            {
+                AssertThat(std::string(out.at(i).c_str()), Equals(expected.at(i)));
+            }
+
+            // only rebuilt after a change
+            AssertThat(TokenDatabase::updateToken(2, OTPToken(OTPToken::HOTP, "token 2", {}, "DEF", 6, 30, 5, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(batch.refresh(), Equals(true));
+            AssertThat(batch.counters().at(1), Equals(5U));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(batch.refresh(), Equals(false));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(batch.refresh(), Equals(true));
+            AssertThat(batch.refresh(), Equals(false));
+        });
+
+        it("[changes]", [&]{
+            TokenDatabase::ChangeList changes;
+            auto revision = TokenDatabase::revision();
+            AssertThat(TokenDatabase::changes(revision, changes), Equals(true));
+            AssertThat(changes.empty(), Equals(true));
+
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token 4", {}, "JKL", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::renameToken(1, "token 5"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveTokenAbove("token 3", "token 5"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::deleteToken(2), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::changes(revision, changes), Equals(true));
+            AssertThat(changes.size(), Equals(4U));
+            AssertThat(changes.at(0).operation, Equals(TokenDatabase::Change::Insert));
+            AssertThat(changes.at(0).id, Equals(4));
+            AssertThat(changes.at(1).operation, Equals(TokenDatabase::Change::Update));
+            AssertThat(changes.at(1).id, Equals(1));
+            AssertThat(changes.at(2).operation, Equals(TokenDatabase::Change::Reorder));
+            AssertThat(changes.at(2).id, Equals(3));
+            AssertThat(changes.at(3).operation, Equals(TokenDatabase::Change::Delete));
+            AssertThat(changes.at(3).id, Equals(2));
+
+            // loading reports the difference to the file
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::updateToken(3, OTPToken(OTPToken::TOTP, "token 3", {}, "GHI", 6, 60, 0, OTPToken::SHA256)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveTokenAbove("token 4", "token 3"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token 6", {}, "MNO", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            revision = TokenDatabase::revision();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            changes.clear();
+            AssertThat(TokenDatabase::changes(revision, changes), Equals(true));
+            AssertThat(changes.size(), Equals(3U));
+            AssertThat(changes.at(0).operation, Equals(TokenDatabase::Change::Update));
+            AssertThat(changes.at(0).id, Equals(3));
+            AssertThat(changes.at(1).operation, Equals(TokenDatabase::Change::Reorder));
+            AssertThat(changes.at(1).id, Equals(4));
+            AssertThat(changes.at(2).operation, Equals(TokenDatabase::Change::Delete));
+            AssertThat(changes.at(2).id, Equals(5));
+
+            // unknown after the database was replaced
+            TokenDatabase::closeDatabase();
+            changes.clear();
+            AssertThat(TokenDatabase::changes(revision, changes), Equals(false));
+            AssertThat(TokenDatabase::changes(TokenDatabase::revision(), changes), Equals(true));
+            AssertThat(changes.empty(), Equals(true));
+        });
+
+        it("[insertTokens]", [&]{
+            const TokenDatabase::OTPTokenList tokens = {
+                OTPToken(OTPToken::TOTP, "bulk 1", {}, "ABC", 6, 30, 0, OTPToken::SHA1),
+                OTPToken(OTPToken::TOTP, "token 2", {}, "ABC", 6, 30, 0, OTPToken::SHA1), // duplicate
+                OTPToken(OTPToken::HOTP, "bulk 2", {}, "DEF", 6, 30, 2, OTPToken::SHA1),
+            };
+
+            std::vector<TokenDatabase::Error> errors;
+            AssertThat(TokenDatabase::insertTokens(tokens, &errors), Equals(TokenDatabase::SqlConstraintViolation));
+            AssertThat(errors.size(), Equals(3U));
+            AssertThat(errors.at(0), Equals(TokenDatabase::Success));
+            AssertThat(errors.at(1), Equals(TokenDatabase::SqlConstraintViolation));
+            AssertThat(errors.at(2), Equals(TokenDatabase::Success));
+
+            // valid tokens are appended in order
+            const auto all = TokenDatabase::selectTokens();
+            AssertThat(all.size(), Equals(5U));
+            AssertThat(all.at(3).label(), Equals(std::string("bulk 1")));
+            AssertThat(all.at(4).label(), Equals(std::string("bulk 2")));
+            AssertThat(all.at(4).counter(), Equals(2U));
+        });
+
+        it("[save and load]", [&]{
+            AssertThat(TokenDatabase::moveTokenAbove("token 3", "token 1"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+
+            // the loaded database must still accept new tokens
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::Steam, "token 4", {}, "JKL", 5, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+
+            const auto all = TokenDatabase::selectTokens();
+            AssertThat(all.size(), Equals(4U));
+            AssertThat(all.at(0).label(), Equals(std::string("token 3")));
+            AssertThat(all.at(1).label(), Equals(std::string("token 1")));
+            AssertThat(all.at(2).label(), Equals(std::string("token 2")));
+            AssertThat(all.at(3).label(), Equals(std::string("token 4")));
+        });
+
+        it("[load wrong password]", [&]{
+            AssertThat(TokenDatabase::setPassword("wrong123"), Equals(true));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+            AssertThat(TokenDatabase::selectTokens().size(), Equals(3U));
+
+            // the open encrypted database and its unsaved changes are kept
+            AssertThat(TokenDatabase::setPassword("test123"), Equals(true));
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "unsaved", {}, "JKL", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+
+            AssertThat(TokenDatabase::setPassword("wrong123"), Equals(true));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+            AssertThat(TokenDatabase::selectTokens().size(), Equals(4U));
+            AssertThat(TokenDatabase::selectToken("unsaved").label(), Equals(std::string("unsaved")));
+
+            AssertThat(TokenDatabase::setPassword("test123"), Equals(true));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokens().size(), Equals(4U));
+        });
+
+        it("[container]", [&]{
+            // spans several segments of the container
+            TokenDatabase::OTPTokenList tokens;
+            for (auto i = 0; i < 400; ++i)
+            {
+                tokens.emplace_back(OTPToken::TOTP, "icon " + std::to_string(i), OTPToken::Icon(2048, static_cast<unsigned char>(i)),
+                                    "ABC", 6, 30, 0, OTPToken::SHA1);
+            }
+            AssertThat(TokenDatabase::insertTokens(tokens), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+
+            std::string data;
+            {
+                std::ifstream stream(file, std::ios_base::binary);
+                data.assign(std::istreambuf_iterator<char>(stream), {});
+            }
+            AssertThat(data.size(), IsGreaterThan(2U * 256U * 1024U));
+            AssertThat(data.substr(0, 8), Equals(std::string("OTPGENDB")));
+
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            const auto all = TokenDatabase::selectTokens();
+            AssertThat(all.size(), Equals(403U));
+            AssertThat(all.at(402).icon(), Equals(OTPToken::Icon(2048, 143)));
+
+            // a modified segment fails the authentication
+            data[data.size() / 2] ^= 1;
+            {
+                std::ofstream stream(file, std::ios_base::binary | std::ios_base::trunc);
+                stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+            }
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+        });
+
+        it("[icons]", [&]{
+            // tokens with the same icon share a single copy of it
+            TokenDatabase::OTPTokenList tokens;
+            for (auto i = 0; i < 100; ++i)
+            {
+                tokens.emplace_back(OTPToken::TOTP, "icon " + std::to_string(i), OTPToken::Icon(16384, 0x42),
+                                    "ABC", 6, 30, 0, OTPToken::SHA1);
+            }
+            AssertThat(TokenDatabase::insertTokens(tokens), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            {
+                std::ifstream stream(file, std::ios_base::binary | std::ios_base::ate);
+                AssertThat(static_cast<std::size_t>(stream.tellg()), IsLessThan(100U * 1024U));
+            }
+
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken("icon 0").icon(), Equals(OTPToken::Icon(16384, 0x42)));
+
+            // the light projection leaves the icons out
+            const auto light = TokenDatabase::selectTokens(OTPToken::TOTP, TokenDatabase::WithoutIcons);
+            AssertThat(light.size(), Equals(102U));
+            AssertThat(light.at(2).label(), Equals(std::string("icon 0")));
+            AssertThat(light.at(2).icon().empty(), Equals(true));
+            AssertThat(TokenDatabase::selectIcon(light.at(2).id()), Equals(OTPToken::Icon(16384, 0x42)));
+            AssertThat(TokenDatabase::selectIcon(1).empty(), Equals(true));
+
+            // the icon is kept while any token still uses it
+            AssertThat(TokenDatabase::deleteToken(light.at(2).id()), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectIcon(light.at(3).id()), Equals(OTPToken::Icon(16384, 0x42)));
+            AssertThat(TokenDatabase::updateToken(light.at(3).id(), OTPToken(OTPToken::TOTP, "icon 1", OTPToken::Icon(16, 0x01),
+                                                                              "ABC", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectIcon(light.at(3).id()), Equals(OTPToken::Icon(16, 0x01)));
+            AssertThat(TokenDatabase::selectIcon(light.at(4).id()), Equals(OTPToken::Icon(16384, 0x42)));
+        });
+
+        it("[encrypted pages]", [&]{
+            const auto magic = [&]{
+                std::ifstream stream(file, std::ios_base::binary);
+                std::string data(8, '\0');
+                stream.read(&data[0], 8);
+                return data;
+            };
+
+            // the in-memory database is converted on save
+            TokenDatabase::setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(magic(), Equals(std::string("OTPGENPG")));
+
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "token 4", {}, "JKL", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveTokenAbove("token 4", "token 1"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+
+            // unsaved changes are discarded when loading
+            AssertThat(TokenDatabase::deleteToken(1), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            auto all = TokenDatabase::selectTokens();
+            AssertThat(all.size(), Equals(4U));
+            AssertThat(all.at(0).label(), Equals(std::string("token 4")));
+            AssertThat(all.at(3).label(), Equals(std::string("token 3")));
+
+            // re-encrypts all pages with the new key
+            AssertThat(TokenDatabase::changePassword("new123"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::setPassword("test123"), Equals(true));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+            AssertThat(TokenDatabase::setPassword("new123"), Equals(true));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokens().size(), Equals(4U));
+
+            // encrypted files stay in their format
+            TokenDatabase::setStorageFormat(TokenDatabase::Container);
+            AssertThat(TokenDatabase::updateToken(2, OTPToken(OTPToken::HOTP, "token 2", {}, "DEF", 6, 30, 5, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(magic(), Equals(std::string("OTPGENPG")));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(2).counter(), Equals(5U));
+        });
+
+        it("[failed save]", [&]{
+            const std::string vaultFile = "failed-save-test.db", directory = "failed-save-test.d";
+            std::remove(vaultFile.c_str());
+            TokenVault vault(vaultFile, "vault");
+            AssertThat(vault.initializeTokens(), Equals(TokenDatabase::Success));
+            AssertThat(vault.insertToken(OTPToken(OTPToken::TOTP, "unsaved", {}, "ABC", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+
+            // the converted file can't replace a directory, the session is kept
+            AssertThat(mkdir(directory.c_str(), 0700), Equals(0));
+            std::ofstream(directory + "/file") << "x";
+            vault.setStorageFormat(TokenDatabase::EncryptedPages);
+            AssertThat(vault.setTokenDatabase(directory), Equals(true));
+            AssertThat(vault.saveTokens(), Equals(TokenDatabase::FileWriteFailure));
+            AssertThat(vault.selectTokens().size(), Equals(1U));
+            AssertThat(std::ifstream(directory + ".tmp").good(), Equals(false));
+
+            AssertThat(vault.setTokenDatabase(vaultFile), Equals(true));
+            AssertThat(vault.saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(vault.loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(vault.selectToken("unsaved").label(), Equals(std::string("unsaved")));
+
+            vault.closeDatabase();
+            std::remove(vaultFile.c_str());
+            std::remove((directory + "/file").c_str());
+            rmdir(directory.c_str());
+        });
+
+        it("[encrypted journal]", [&]{
+            const std::string pagedFile = "journal-test.db", journal = pagedFile + "-journal";
+            const auto remove = [&]{
+                std::remove(pagedFile.c_str());
+                std::remove(journal.c_str());
+            };
+            const auto read = [](const std::string &path) {
+                std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+                return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+            };
+            const auto open = [&]{
+                sqlite3 *db = nullptr;
+                AssertThat(sqlite3_open_v2(pagedFile.c_str(), &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, EncryptedVFS::name), Equals(SQLITE_OK));
+                // the header keeps no record count without syncs, the records of a copied journal are played back
+                sqlite3_exec(db, "pragma temp_store = memory; pragma synchronous = off;", nullptr, nullptr, nullptr);
+                return db;
+            };
+            const auto sum = [](sqlite3 *db) {
+                sqlite3_stmt *stmt = nullptr;
+                auto value = -1;
+                if (sqlite3_prepare_v2(db, "select sum(v) from t;", -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW)
+                {
+                    value = sqlite3_column_int(stmt, 0);
+                }
+                sqlite3_finalize(stmt);
+                return value;
+            };
+            // commits an update and returns the journal as it was before the commit
+            const auto update = [&](const int &v) {
+                auto db = open();
+                AssertThat(sqlite3_exec(db, ("begin; update t set v = " + std::to_string(v) + ";").c_str(), nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+                const auto hot = read(journal);
+                AssertThat(sqlite3_exec(db, "commit;", nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+                sqlite3_close(db);
+                return hot;
+            };
+
+            remove();
+            AssertThat(EncryptedVFS::registerVFS(), Equals(true));
+
+            // nothing is opened or created without a password
+            sqlite3 *unkeyed = nullptr;
+            AssertThat(sqlite3_open_v2(pagedFile.c_str(), &unkeyed, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, EncryptedVFS::name), Is().Not().EqualTo(SQLITE_OK));
+            sqlite3_close(unkeyed);
+            AssertThat(std::ifstream(pagedFile).good(), Equals(false));
+
+            EncryptedVFS::setPassword(pagedFile, "test123");
+            auto db = open();
+            AssertThat(sqlite3_exec(db, "pragma page_size = 4096; create table t (v integer, data blob);"
+                                        "with recursive n(i) as (select 1 union all select i + 1 from n where i < 100) "
+                                        "insert into t select 1, zeroblob(1000) from n;", nullptr, nullptr, nullptr), Equals(SQLITE_OK));
+            sqlite3_close(db);
+
+            // a crash after the database was written, the journal restores the old pages
+            auto hot = update(2);
+            AssertThat(hot.size(), IsGreaterThan(3U * 4096U));
+            std::ofstream(journal, std::ios_base::out | std::ios_base::binary) << hot;
+            db = open();
+            AssertThat(sum(db), Equals(100));
+            sqlite3_close(db);
+            AssertThat(std::ifstream(journal).good(), Equals(false));
+
+            // a modified journal is not played back
+            hot = update(2);
+            hot[hot.size() / 2] ^= 0x01;
+            std::ofstream(journal, std::ios_base::out | std::ios_base::binary) << hot;
+            db = open();
+            AssertThat(sum(db), Equals(-1));
+            sqlite3_close(db);
+
+            std::remove(journal.c_str());
+            db = open();
+            AssertThat(sum(db), Equals(200));
+            sqlite3_close(db);
+
+            EncryptedVFS::removePassword(pagedFile);
+            remove();
+        });
+
+        it("[load legacy database]", [&]{
+            // AES-CBC database written by an older version
+            const std::string legacy = "legacy-test.db";
+            {
+                std::ifstream in("TokenDatabase/legacy-cbc.db", std::ios_base::binary);
+                std::ofstream out(legacy, std::ios_base::binary | std::ios_base::trunc);
+                out << in.rdbuf();
+            }
+
+            TokenDatabase::setTokenDatabase(legacy);
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokens().size(), Equals(2U));
+            AssertThat(TokenDatabase::selectTokens().at(1).label(), Equals(std::string("legacy 2")));
+
+            // digits, period and counter were migrated from BLOBs to integers
+            const auto token = TokenDatabase::selectToken("legacy 2");
+            AssertThat(token.digitLength(), Equals(6U));
+            AssertThat(token.period(), Equals(30U));
+            AssertThat(token.counter(), Equals(4U));
+
+            // saving upgrades the file to the current container
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectTokens().size(), Equals(2U));
+
+            std::remove(legacy.c_str());
+        });
+
+        it("[vaults]", [&]{
+            // every vault has its own file, password and connection
+            const std::string file1 = "vault-test-1.db", file2 = "vault-test-2.db";
+            {
+                TokenVault vault1(file1, "vault1", TokenDatabase::EncryptedPages);
+                TokenVault vault2(file2, "vault2", TokenDatabase::EncryptedPages);
+                AssertThat(vault1.initializeTokens(), Equals(TokenDatabase::Success));
+                AssertThat(vault2.initializeTokens(), Equals(TokenDatabase::Success));
+
+                AssertThat(vault1.insertToken(OTPToken(OTPToken::TOTP, "vault 1", {}, "ABC", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+                AssertThat(vault2.insertToken(OTPToken(OTPToken::TOTP, "vault 2", {}, "DEF", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+                AssertThat(vault1.saveTokens(), Equals(TokenDatabase::Success));
+                AssertThat(vault2.saveTokens(), Equals(TokenDatabase::Success));
+
+                AssertThat(vault1.selectTokens().size(), Equals(1U));
+                AssertThat(vault2.selectToken(1).label(), Equals(std::string("vault 2")));
+
+                // the default vault is not affected
+                AssertThat(TokenDatabase::selectTokens().size(), Equals(3U));
+            }
+
+            TokenVault vault1(file1, "vault1");
+            TokenVault vault2(file2, "vault1");
+            AssertThat(vault1.loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(vault1.selectToken(1).label(), Equals(std::string("vault 1")));
+            AssertThat(vault2.loadTokens(), Equals(TokenDatabase::InvalidCiphertext));
+
+            vault1.closeDatabase();
+            std::remove(file1.c_str());
+            std::remove(file2.c_str());
+        });
+
+        it("[autosave]", [&]{
+            {
+                TokenAutosave autosave(TokenDatabase::defaultVault(), std::chrono::milliseconds(100));
+                AssertThat(autosave.flush(), Equals(TokenDatabase::Success));
+                AssertThat(autosave.saveCount(), Equals(0U));
+
+                // a burst of edits is saved once after the quiet period
+                for (auto i = 0; i < 5; ++i)
+                {
+                    AssertThat(TokenDatabase::renameToken(1, "token 1 v" + std::to_string(i)), Equals(TokenDatabase::Success));
+                    autosave.markDirty();
+                }
+                AssertThat(autosave.dirty(), Equals(true));
+                for (auto i = 0; i < 100 && autosave.saveCount() == 0U; ++i)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                }
+                AssertThat(autosave.saveCount(), Equals(1U));
+                AssertThat(autosave.dirty(), Equals(false));
+                AssertThat(autosave.lastError(), Equals(TokenDatabase::Success));
+
+                // pending edits are saved by flush() and the destructor
+                AssertThat(TokenDatabase::renameToken(2, "token 2 flushed"), Equals(TokenDatabase::Success));
+                autosave.markDirty();
+                AssertThat(autosave.flush(), Equals(TokenDatabase::Success));
+                AssertThat(autosave.saveCount(), Equals(2U));
+
+                AssertThat(TokenDatabase::renameToken(3, "token 3 destroyed"), Equals(TokenDatabase::Success));
+                autosave.setDelay(std::chrono::hours(1));
+                autosave.markDirty();
+            }
+
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            const auto all = TokenDatabase::selectTokens();
+            AssertThat(all.at(0).label(), Equals(std::string("token 1 v4")));
+            AssertThat(all.at(1).label(), Equals(std::string("token 2 flushed")));
+            AssertThat(all.at(2).label(), Equals(std::string("token 3 destroyed")));
+        });
+
+        it("[journal]", [&]{
+            const auto read = [](const std::string &path) {
+                std::ifstream stream(path, std::ios_base::in | std::ios_base::binary);
+                return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+            };
+            const auto journal = file + ".journal";
+
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            const auto saved = read(file);
+            TokenDatabase::setJournal(true);
+
+            // changes are appended to the journal, the file is not written
+            AssertThat(TokenDatabase::setCounter(2, 9), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::renameToken(1, "token 1 journaled"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::moveTokenAbove("token 3", "token 1 journaled"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::setCounter(7, 1), Equals(TokenDatabase::SqlEmptyResults));
+            AssertThat(TokenDatabase::journalSize(), Equals(3U));
+            AssertThat(read(file) == saved, Equals(true));
+            AssertThat(read(journal).size() < 200U, Equals(true));
+
+            // and replayed when the file is loaded
+            const auto replay = [&]{
+                TokenDatabase::closeDatabase();
+                AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+                const auto all = TokenDatabase::selectTokens();
+                AssertThat(all.size(), Equals(3U));
+                AssertThat(all.at(0).label(), Equals(std::string("token 3")));
+                AssertThat(all.at(1).label(), Equals(std::string("token 1 journaled")));
+                AssertThat(all.at(2).counter(), Equals(9U));
+            };
+            replay();
+            AssertThat(TokenDatabase::journalSize(), Equals(3U));
+
+            // a torn record at the end is dropped, the journal continues after the valid records
+            {
+                std::ofstream stream(journal, std::ios_base::out | std::ios_base::binary | std::ios_base::app);
+                stream << "torn";
+            }
+            replay();
+            AssertThat(TokenDatabase::setCounter(2, 10), Equals(TokenDatabase::Success));
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(2).counter(), Equals(10U));
+
+            // saving folds the journal into the file, journals of older files are ignored
+            const auto old_journal = read(journal);
+            AssertThat(TokenDatabase::renameToken(1, "token 1 saved"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::journalSize(), Equals(0U));
+            AssertThat(std::ifstream(journal).good(), Equals(false));
+            {
+                std::ofstream stream(journal, std::ios_base::out | std::ios_base::binary);
+                stream << old_journal;
+            }
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::selectToken(1).label(), Equals(std::string("token 1 saved")));
+            AssertThat(std::ifstream(journal).good(), Equals(false));
+        });
+
+        it("[journal display order]", [&]{
+            AssertThat(TokenDatabase::saveTokens(), Equals(TokenDatabase::Success));
+            TokenDatabase::setJournal(true);
+
+            // moving tokens into the same gap again and again renumbers all positions,
+            // which is journaled as one record
+            for (auto i = 0; i < 20; ++i)
+            {
+                const auto records = TokenDatabase::journalSize();
+                AssertThat(TokenDatabase::moveTokenAbove(i % 2 ? "token 2" : "token 3", i % 2 ? "token 3" : "token 2"), Equals(TokenDatabase::Success));
+                AssertThat(TokenDatabase::journalSize() - records, IsLessThan(3U));
+            }
+            AssertThat(TokenDatabase::journalSize(), IsGreaterThan(20U));
+
+            // a swap is one record too
+            const auto records = TokenDatabase::journalSize();
+            AssertThat(TokenDatabase::swapTokens("token 1", "token 3"), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::journalSize(), Equals(records + 1U));
+
+            const auto order = TokenDatabase::selectTokens();
+            TokenDatabase::closeDatabase();
+            AssertThat(TokenDatabase::loadTokens(), Equals(TokenDatabase::Success));
+            const auto replayed = TokenDatabase::selectTokens();
+            AssertThat(replayed.size(), Equals(order.size()));
+            for (std::size_t i = 0; i < order.size(); ++i)
+            {
+                AssertThat(replayed.at(i).label(), Equals(order.at(i).label()));
+            }
+        });
+
+        it("[concurrent selectTokens]", [&]{
+            std::atomic<int> failures{0};
+            std::vector<std::thread> threads;
+            for (auto i = 0; i < 4; ++i)
+            {
+                threads.emplace_back([&]{
+                    for (auto j = 0; j < 200; ++j)
+                    {
+                        const auto tokens = TokenDatabase::selectTokens();
+                        if (tokens.size() != 3U || tokens.at(2).label() != "token 3" ||
+                            TokenDatabase::selectToken("token 2").counter() != 4U)
+                        {
+                            ++failures;
+                        }
+                    }
+                });
+            }
+
+            // writers wait for the readers
+            for (auto j = 0; j < 20; ++j)
+            {
+                AssertThat(TokenDatabase::renameToken(1, j % 2 ? "token 1" : "token 1 renamed"), Equals(TokenDatabase::Success));
+            }
+
+            for (auto&& thread : threads)
+            {
+                thread.join();
+            }
+            AssertThat(failures.load(), Equals(0));
+        });
+    });
+});
+
+#endif // TOKENDATABASETESTS_HPP
@@ -0,0 +1,161 @@
+#ifndef TOKENPACKTESTS_HPP
+#define TOKENPACKTESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <fstream>
+#include <iterator>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <TokenPack.hpp>
+#include <DurableFile.hpp>
+
+go_bandit([]{
+    describe("TokenPack Test", []{
+        const std::string file = "tokenpack-test.pack";
+        const std::time_t time = 1536573862;
+
+        const TokenDatabase::OTPTokenList tokens = {
+            OTPToken(OTPToken::TOTP, "Token 1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1),
+            OTPToken(OTPToken::HOTP, "token 2", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1),
+            OTPToken(OTPToken::TOTP, "Token 3", {}, "XYZA123456KDDK83D", 8, 60, 0, OTPToken::SHA512),
+            OTPToken(OTPToken::Steam, "Steam", {}, "XYZA123456KDDK83D", 5, 30, 0, OTPToken::SHA1),
+        };
+
+        const auto expected = [&](const OTPToken &token) -> OTPToken::TokenString {
+            switch (token.type())
+            {
+                case OTPToken::TOTP:
+                    return OTPGen::computeTOTP(time, token.secret(), token.digitLength(), token.period(), token.algorithm());
+                case OTPToken::HOTP:
+                    return OTPGen::computeHOTP(token.secret(), token.counter(), token.digitLength(), token.algorithm());
+                case OTPToken::Steam:
+                    return OTPGen::computeSteam(time, token.secret());
+            }
+            return {};
+        };
+
+        after_each([&]{
+            std::remove(file.c_str());
+        });
+
+        it("[generate]", [&]{
+            AssertThat(TokenPack::write(file, tokens), Equals(TokenDatabase::Success));
+
+            TokenPack pack;
+            AssertThat(pack.open(file), Equals(TokenDatabase::Success));
+            AssertThat(pack.encrypted(), Equals(false));
+            AssertThat(pack.size(), Equals(tokens.size()));
+
+            OTPGen::TokenBuffer token;
+            for (std::size_t i = 0; i < tokens.size(); ++i)
+            {
+                AssertThat(pack.label(i), Equals(tokens[i].label()));
+                AssertThat(pack.digits(i), Equals(tokens[i].digitLength()));
+                AssertThat(pack.counter(i), Equals(tokens[i].counter()));
+                AssertThat(pack.compute(i, time, token), Equals(true));
+                AssertThat(std::string(token.c_str()), Equals(expected(tokens[i])));
+            }
+
+            // out of range
+            AssertThat(pack.compute(tokens.size(), time, token), Equals(false));
+            AssertThat(pack.key(tokens.size()).isValid(), Equals(false));
+
+            // only the owner can read the keys
+            struct stat info;
+            AssertThat(stat(file.c_str(), &info), Equals(0));
+            AssertThat(info.st_mode & 0777, Equals(0600U));
+            AssertThat(std::ifstream(file + ".tmp").good(), Equals(false));
+        });
+
+        it("[find]", [&]{
+            AssertThat(TokenPack::write(file, tokens), Equals(TokenDatabase::Success));
+
+            TokenPack pack;
+            AssertThat(pack.open(file), Equals(TokenDatabase::Success));
+
+            std::size_t index = 0;
+            AssertThat(pack.find("TOKEN 2", index), Equals(true));
+            AssertThat(index, Equals(1U));
+            AssertThat(pack.find("steam", index), Equals(true));
+            AssertThat(index, Equals(3U));
+            AssertThat(pack.find("Token 4", index), Equals(false));
+
+            OTPGen::VerifyOptions options;
+            std::int64_t offset = 0;
+            AssertThat(pack.verify(1, time, expected(tokens[1]), options, &offset), Equals(true));
+            AssertThat(offset, Equals(0));
+            AssertThat(pack.verify(0, time, "000000", options), Equals(false));
+        });
+
+        it("[encrypted]", [&]{
+            // an encrypted pack is never written without a password
+            AssertThat(TokenPack::write(file, tokens, true), Equals(TokenDatabase::PasswordEmpty));
+            AssertThat(std::ifstream(file).good(), Equals(false));
+
+            AssertThat(TokenPack::write(file, tokens, true, "pack123"), Equals(TokenDatabase::Success));
+
+            TokenPack pack;
+            AssertThat(pack.open(file), Equals(TokenDatabase::PasswordEmpty));
+            AssertThat(pack.open(file, "wrong"), Equals(TokenDatabase::InvalidCiphertext));
+            AssertThat(pack.isOpen(), Equals(false));
+
+            AssertThat(pack.open(file, "pack123"), Equals(TokenDatabase::Success));
+            AssertThat(pack.encrypted(), Equals(true));
+
+            OTPGen::TokenBuffer token;
+            AssertThat(pack.compute(2, time, token), Equals(true));
+            AssertThat(std::string(token.c_str()), Equals(expected(tokens[2])));
+            pack.close();
+
+            // the record is authenticated, a modified digit length breaks the key
+            std::ifstream in(file, std::ios_base::binary);
+            std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            in.close();
+            data[96 + 48 * 2 + 42] = 6;
+            std::ofstream(file, std::ios_base::binary | std::ios_base::trunc) << data;
+
+            AssertThat(pack.open(file, "pack123"), Equals(TokenDatabase::Success));
+            AssertThat(pack.key(2).isValid(), Equals(false));
+            AssertThat(pack.compute(2, time, token), Equals(false));
+        });
+
+        it("[invalid]", [&]{
+            TokenPack pack;
+            AssertThat(pack.open(file), Equals(TokenDatabase::FileReadFailure));
+
+            AssertThat(TokenPack::write(file, tokens), Equals(TokenDatabase::Success));
+            std::ofstream(file, std::ios_base::binary | std::ios_base::app) << "x";
+            AssertThat(pack.open(file), Equals(TokenDatabase::InvalidTokenFile));
+            AssertThat(pack.size(), Equals(0U));
+        });
+
+        it("[failed replace]", [&]{
+            const auto read = [&]{
+                std::ifstream in(file, std::ios_base::binary);
+                return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            };
+
+            AssertThat(TokenPack::write(file, tokens), Equals(TokenDatabase::Success));
+            const auto before = read();
+
+            // a directory can't replace the pack, the old pack is kept
+            const auto temp_file = file + ".tmp";
+            AssertThat(mkdir(temp_file.c_str(), 0700), Equals(0));
+            AssertThat(DurableFile::replace(temp_file, file), Equals(false));
+            rmdir(temp_file.c_str());
+            AssertThat(read(), Equals(before));
+
+            TokenPack pack;
+            AssertThat(pack.open(file), Equals(TokenDatabase::Success));
+            AssertThat(pack.size(), Equals(tokens.size()));
+        });
+    });
+});
+
+#endif // TOKENPACKTESTS_HPP
@@ -0,0 +1,190 @@
+#ifndef TOKENSERVICETESTS_HPP
+#define TOKENSERVICETESTS_HPP
+
+#include <bandit/bandit.h>
+
+using namespace snowhouse;
+using namespace bandit;
+
+#include <TokenDatabase.hpp>
+#include <TokenService.hpp>
+#include <OTPGen.hpp>
+
+go_bandit([]{
+    describe("TokenService Test", []{
+        const std::string file = "tokenservice-test.db";
+        const std::time_t time = 1536573862;
+
+        // little-endian request encoding
+        const auto put = [](std::string &buffer, std::uint64_t value, const std::size_t &size) {
+            for (std::size_t i = 0; i < size; ++i, value >>= 8)
+            {
+                buffer.push_back(static_cast<char>(value & 0xff));
+            }
+        };
+
+        before_each([&]{
+            TokenDatabase::setPassword("test123");
+            TokenDatabase::setTokenDatabase(file);
+            AssertThat(TokenDatabase::initializeTokens(), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, "Token 1", {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::HOTP, "token 2", {}, "XYZA123456KDDK83D", 6, 0, 12, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+        });
+
+        after_each([&]{
+            TokenDatabase::closeDatabase();
+            std::remove(file.c_str());
+        });
+
+        it("[generate]", [&]{
+            TokenService service(TokenDatabase::defaultVault());
+
+            // by label, case-insensitive
+            std::string request(1, TokenService::Generate), response;
+            put(request, 0, 8);
+            put(request, 7, 2);
+            request.append("token 1");
+            service.handle(request, response, time);
+            AssertThat(response, Equals(std::string("\x00\x06" "122810" "\x08\x00\x00\x00", 12)));
+
+            // by id
+            request.assign(1, TokenService::Generate);
+            put(request, 2, 8);
+            put(request, 0, 2);
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response, Equals(std::string("\x00\x06" "534003" "\x00\x00\x00\x00", 12)));
+
+            request.assign(1, TokenService::Generate);
+            put(request, 3, 8);
+            put(request, 0, 2);
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response, Equals(std::string(1, TokenService::TokenNotFound)));
+
+            // truncated request
+            request.resize(5);
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response, Equals(std::string(1, TokenService::MalformedRequest)));
+        });
+
+        it("[batch and list]", [&]{
+            TokenService service(TokenDatabase::defaultVault());
+
+            std::string request(1, TokenService::GenerateBatch), response;
+            put(request, 0, 4);
+            put(request, 0, 4);
+            service.handle(request, response, time);
+            AssertThat(response.size(), Equals(1U + 4U + 4U + 2U * (8U + 1U + 1U + 6U)));
+            AssertThat(response.substr(1, 8), Equals(std::string("\x02\x00\x00\x00\x02\x00\x00\x00", 8)));
+            AssertThat(response.substr(19, 6), Equals(std::string("122810")));
+            AssertThat(response.substr(35, 6), Equals(std::string("534003")));
+
+            // the next page
+            request.assign(1, TokenService::GenerateBatch);
+            put(request, 1, 4);
+            put(request, 0, 4);
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response.size(), Equals(1U + 4U + 4U + 8U + 1U + 1U + 6U));
+            AssertThat(response.substr(19, 6), Equals(std::string("534003")));
+
+            // more ids than fit into a response
+            request.assign(1, TokenService::GenerateBatch);
+            put(request, 0, 4);
+            put(request, TokenService::maxBatchSize() + 1, 4);
+            request.append((TokenService::maxBatchSize() + 1) * 8, '\x01');
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response, Equals(std::string(1, TokenService::MalformedRequest)));
+
+            // changes of the vault are picked up
+            AssertThat(TokenDatabase::renameToken(1, "renamed"), Equals(TokenDatabase::Success));
+            request.assign(1, TokenService::List);
+            put(request, 0, 4);
+            put(request, 0, 4);
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response.size(), Equals(1U + 4U + 4U + 8U + 1U + 1U + 4U + 2U + 7U + 8U + 1U + 1U + 4U + 2U + 7U));
+            AssertThat(response.substr(25, 7), Equals(std::string("renamed")));
+
+            request.assign(1, TokenService::List);
+            put(request, 1, 4);
+            put(request, 1, 4);
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response.size(), Equals(1U + 4U + 4U + 8U + 1U + 1U + 4U + 2U + 7U));
+            AssertThat(response.substr(25, 7), Equals(std::string("token 2")));
+        });
+
+        it("[frame limit]", [&]{
+            TokenService service(TokenDatabase::defaultVault());
+
+            // only two of the long labels fit into a frame
+            const std::string label(30000, 'x');
+            for (auto i = 0; i < 3; ++i)
+            {
+                AssertThat(TokenDatabase::insertToken(OTPToken(OTPToken::TOTP, label + std::to_string(i), {}, "XYZA123456KDDK83D", 6, 30, 0, OTPToken::SHA1)), Equals(TokenDatabase::Success));
+            }
+
+            std::string request(1, TokenService::List), response;
+            put(request, 0, 4);
+            put(request, 0, 4);
+            service.handle(request, response, time);
+            AssertThat(response.size(), IsLessThan(TokenService::maxFrameSize() + 1));
+            AssertThat(response.substr(1, 8), Equals(std::string("\x05\x00\x00\x00\x04\x00\x00\x00", 8)));
+
+            request.assign(1, TokenService::List);
+            put(request, 4, 4);
+            put(request, 0, 4);
+            response.clear();
+            service.handle(request, response, time);
+            AssertThat(response.substr(1, 8), Equals(std::string("\x05\x00\x00\x00\x01\x00\x00\x00", 8)));
+            AssertThat(response.substr(25), Equals(label + "2"));
+        });
+
+        it("[verify]", [&]{
+            TokenService service(TokenDatabase::defaultVault());
+
+            const auto verify = [&](const OTPToken::sqliteTokenID &id, const std::string &code) {
+                std::string request(1, TokenService::Verify), response;
+                put(request, static_cast<std::uint64_t>(id), 8);
+                put(request, code.size(), 1);
+                request.append(code);
+                service.handle(request, response, time);
+                return static_cast<TokenService::Status>(response.at(0));
+            };
+
+            AssertThat(verify(1, "122810"), Equals(TokenService::Ok));
+            AssertThat(verify(1, "122810"), Equals(TokenService::VerificationFailed)); // replayed
+            AssertThat(verify(1, "000000"), Equals(TokenService::VerificationFailed));
+
+            // the hotp counter moves on
+            AssertThat(verify(2, "534003"), Equals(TokenService::Ok));
+            AssertThat(TokenDatabase::selectToken(2).counter(), Equals(13U));
+            AssertThat(verify(2, "534003"), Equals(TokenService::VerificationFailed));
+
+            // the batch of the service has the new counter
+            std::string request(1, TokenService::Generate), response;
+            put(request, 2, 8);
+            put(request, 0, 2);
+            service.handle(request, response, time);
+            AssertThat(response.substr(2, 6), Equals(OTPGen::computeHOTP("XYZA123456KDDK83D", 13, 6, OTPToken::SHA1)));
+        });
+
+        it("[frames]", [&]{
+            std::string buffer;
+            TokenService::appendFrame(buffer, "abc");
+            AssertThat(buffer, Equals(std::string("\x03\x00\x00\x00" "abc", 7)));
+
+            std::size_t size = 0;
+            AssertThat(TokenService::frame(buffer, 0, size), Equals(TokenService::Complete));
+            AssertThat(size, Equals(3U));
+            AssertThat(TokenService::frame(buffer.substr(0, 5), 0, size), Equals(TokenService::Incomplete));
+            AssertThat(TokenService::frame(std::string("\xff\xff\xff\x00", 4), 0, size), Equals(TokenService::Oversized));
+        });
+    });
+});
+
+#endif // TOKENSERVICETESTS_HPP